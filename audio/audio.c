@@ -351,11 +351,21 @@ fail:
     return NULL;
 }
 
+// Max. number of unused frame structs kept by a pool.
+#define MAX_FREE_FRAMES 32
+
 struct mp_audio_pool {
     AVBufferPool *avpool;
     int element_size;
+    int64_t num_allocs;
+    struct mp_audio *free_frames[MAX_FREE_FRAMES];
+    int num_free_frames;
 };
 
+// The pool av_buffer_pool_get() is being called for on this thread. The
+// AVBufferPool alloc callback has no context argument.
+static __thread struct mp_audio_pool *allocating_pool;
+
 struct mp_audio_pool *mp_audio_pool_create(void *ta_parent)
 {
     return talloc_zero(ta_parent, struct mp_audio_pool);
@@ -367,32 +377,65 @@ static void mp_audio_pool_destructor(void *p)
     av_buffer_pool_uninit(&pool->avpool);
 }
 
+// Called by av_buffer_pool_get() if it has no unused buffer.
+static AVBufferRef *pool_alloc(int size)
+{
+    if (allocating_pool)
+        allocating_pool->num_allocs++;
+    return av_buffer_alloc(size);
+}
+
+// Make sure buffers of the given size (in bytes) can be taken from the pool
+// without reallocating it. Growing the pool discards all cached buffers, so
+// reserving the largest size needed in advance avoids reallocations later.
+// Returns false on error.
+bool mp_audio_pool_reserve(struct mp_audio_pool *pool, int size)
+{
+    if (size < 0)
+        return false;
+    if (pool->avpool && size <= pool->element_size)
+        return true;
+    size_t alloc = ta_calc_prealloc_elems(size);
+    if (alloc >= INT_MAX)
+        return false;
+    av_buffer_pool_uninit(&pool->avpool);
+    pool->element_size = alloc;
+    pool->avpool = av_buffer_pool_init(pool->element_size, pool_alloc);
+    if (!pool->avpool)
+        return false;
+    talloc_set_destructor(pool, mp_audio_pool_destructor);
+    return true;
+}
+
+static AVBufferRef *mp_audio_pool_get_buffer(struct mp_audio_pool *pool)
+{
+    allocating_pool = pool;
+    AVBufferRef *buf = av_buffer_pool_get(pool->avpool);
+    allocating_pool = NULL;
+    return buf;
+}
+
 // Allocate data using the given format and number of samples.
 // Returns NULL on error.
 struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
                                    const struct mp_audio *fmt, int samples)
 {
     int size = get_plane_size(fmt, samples);
-    if (size < 0)
+    if (!mp_audio_pool_reserve(pool, size))
         return NULL;
-    if (!pool->avpool || size > pool->element_size) {
-        size_t alloc = ta_calc_prealloc_elems(size);
-        if (alloc >= INT_MAX)
-            return NULL;
-        av_buffer_pool_uninit(&pool->avpool);
-        pool->element_size = alloc;
-        pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
-        if (!pool->avpool)
-            return NULL;
-        talloc_set_destructor(pool, mp_audio_pool_destructor);
+    struct mp_audio *new;
+    if (pool->num_free_frames) {
+        new = pool->free_frames[--pool->num_free_frames];
+        talloc_steal(NULL, new);
+    } else {
+        new = talloc_ptrtype(NULL, new);
     }
-    struct mp_audio *new = talloc_ptrtype(NULL, new);
     talloc_set_destructor(new, mp_audio_destructor);
     *new = *fmt;
     mp_audio_set_null_data(new);
     new->samples = samples;
     for (int n = 0; n < new->num_planes; n++) {
-        new->allocated[n] = av_buffer_pool_get(pool->avpool);
+        new->allocated[n] = mp_audio_pool_get_buffer(pool);
         if (!new->allocated[n]) {
             talloc_free(new);
             return NULL;
@@ -402,6 +445,37 @@ struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
     return new;
 }
 
+// Free the frame, like talloc_free(), but keep the struct itself for reuse by
+// mp_audio_pool_get(). The frame doesn't need to come from this pool.
+void mp_audio_pool_release(struct mp_audio_pool *pool, struct mp_audio *frame)
+{
+    if (!frame)
+        return;
+    if (pool->num_free_frames == MAX_FREE_FRAMES) {
+        talloc_free(frame);
+        return;
+    }
+    mp_audio_destructor(frame);
+    talloc_set_destructor(frame, NULL);
+    talloc_free_children(frame);
+    talloc_steal(pool, frame);
+    pool->free_frames[pool->num_free_frames++] = frame;
+}
+
+// Number of audio data buffers the pool had to allocate, as opposed to
+// recycling a previously released buffer. Once the pool has warmed up, this
+// stays constant as long as the size of the requested buffers doesn't grow.
+int64_t mp_audio_pool_num_allocs(struct mp_audio_pool *pool)
+{
+    return pool->num_allocs;
+}
+
+// Size of the buffers the pool currently hands out (0 if none yet).
+int mp_audio_pool_element_size(struct mp_audio_pool *pool)
+{
+    return pool->element_size;
+}
+
 // Return a copy of the given frame.
 // Returns NULL on error.
 struct mp_audio *mp_audio_pool_new_copy(struct mp_audio_pool *pool,
@@ -426,6 +500,10 @@ int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
         return -1;
     mp_audio_copy(new, 0, data, 0, data->samples);
     mp_audio_copy_attributes(new, data);
-    mp_audio_steal_data(data, new);
+    talloc_set_destructor(data, mp_audio_destructor);
+    mp_audio_destructor(data);
+    *data = *new;
+    mp_audio_set_null_data(new);
+    mp_audio_pool_release(pool, new);
     return 0;
 }
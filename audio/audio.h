@@ -80,11 +80,15 @@ struct mp_audio *mp_audio_from_avframe(struct AVFrame *avframe);
 
 struct mp_audio_pool;
 struct mp_audio_pool *mp_audio_pool_create(void *ta_parent);
+bool mp_audio_pool_reserve(struct mp_audio_pool *pool, int size);
 struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
                                    const struct mp_audio *fmt, int samples);
 struct mp_audio *mp_audio_pool_new_copy(struct mp_audio_pool *pool,
                                         struct mp_audio *frame);
 int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
                                  struct mp_audio *frame);
+void mp_audio_pool_release(struct mp_audio_pool *pool, struct mp_audio *frame);
+int64_t mp_audio_pool_num_allocs(struct mp_audio_pool *pool);
+int mp_audio_pool_element_size(struct mp_audio_pool *pool);
 
 #endif
@@ -16,6 +16,7 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <assert.h>
 
@@ -26,7 +27,11 @@
 #include "format.h"
 
 struct mp_audio_buffer {
+    // Circular buffer. buffer->samples is the allocated size. The buffered
+    // data starts at sample offset start, and wraps around to offset 0.
     struct mp_audio *buffer;
+    int start;
+    int samples;
 };
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
@@ -44,7 +49,8 @@ void mp_audio_buffer_reinit(struct mp_audio_buffer *ab, struct mp_audio *fmt)
 {
     mp_audio_copy_config(ab->buffer, fmt);
     mp_audio_realloc(ab->buffer, 1);
-    ab->buffer->samples = 0;
+    ab->buffer->samples = 1;
+    ab->start = ab->samples = 0;
 }
 
 void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
@@ -64,17 +70,84 @@ void mp_audio_buffer_get_format(struct mp_audio_buffer *ab,
     mp_audio_copy_config(out_fmt, ab->buffer);
 }
 
+// Map a position in [0, 2 * size) to the internal buffer.
+static int wrap(struct mp_audio_buffer *ab, int pos)
+{
+    return pos >= ab->buffer->samples ? pos - ab->buffer->samples : pos;
+}
+
+// Set out to the given range of the internal buffer (must not wrap).
+static void get_span(struct mp_audio_buffer *ab, int pos, int samples,
+                     struct mp_audio *out)
+{
+    *out = *ab->buffer;
+    mp_audio_skip_samples(out, pos);
+    out->samples = samples;
+}
+
+static void reverse_bytes(uint8_t *p, size_t size)
+{
+    for (size_t n = 0; n < size / 2; n++)
+        MPSWAP(uint8_t, p[n], p[size - 1 - n]);
+}
+
+// Move the data within the internal buffer, so that it starts at offset 0.
+// Rotating each plane by reversing both parts and then the whole plane
+// needs neither a second buffer nor a temporary copy.
+static void rotate(struct mp_audio_buffer *ab)
+{
+    struct mp_audio *buf = ab->buffer;
+    size_t head = (size_t)ab->start * buf->sstride;
+    size_t size = (size_t)buf->samples * buf->sstride;
+    for (int n = 0; n < buf->num_planes; n++) {
+        uint8_t *plane = buf->planes[n];
+        reverse_bytes(plane, head);
+        reverse_bytes(plane + head, size - head);
+        reverse_bytes(plane, size);
+    }
+    ab->start = 0;
+}
+
+// Move the data to a new internal buffer with the given size, so that it
+// starts at offset 0.
+static void rearrange(struct mp_audio_buffer *ab, int size)
+{
+    assert(size >= ab->samples);
+    struct mp_audio *new = talloc_zero(ab, struct mp_audio);
+    mp_audio_copy_config(new, ab->buffer);
+    mp_audio_realloc(new, size);
+    new->samples = size;
+    struct mp_audio a, b;
+    mp_audio_buffer_peek(ab, &a, &b);
+    mp_audio_copy(new, 0, &a, 0, a.samples);
+    mp_audio_copy(new, a.samples, &b, 0, b.samples);
+    talloc_free(ab->buffer);
+    ab->buffer = new;
+    ab->start = 0;
+}
+
+// Make the internal buffer large enough for the given number of samples.
+static void reserve(struct mp_audio_buffer *ab, int samples)
+{
+    if (samples > ab->buffer->samples) {
+        size_t alloc = ta_calc_prealloc_elems(samples);
+        if (alloc > INT_MAX)
+            abort(); // oom
+        rearrange(ab, alloc);
+    }
+}
+
 // Make the total size of the internal buffer at least this number of samples.
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
-    mp_audio_realloc_min(ab->buffer, samples);
+    reserve(ab, samples);
 }
 
 // Get number of samples that can be written without forcing a resize of the
 // internal buffer.
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
 {
-    return mp_audio_get_allocated_size(ab->buffer) - ab->buffer->samples;
+    return ab->buffer->samples - ab->samples;
 }
 
 // Get a pointer to the end of the buffer (where writing would append). If the
@@ -85,16 +158,20 @@ void mp_audio_buffer_get_write_buffer(struct mp_audio_buffer *ab, int samples,
                                       struct mp_audio *out_buffer)
 {
     assert(samples >= 0);
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples + samples);
-    *out_buffer = *ab->buffer;
-    out_buffer->samples = ab->buffer->samples + samples;
-    mp_audio_skip_samples(out_buffer, ab->buffer->samples);
+    reserve(ab, ab->samples + samples);
+    int pos = wrap(ab, ab->start + ab->samples);
+    int space = pos < ab->start ? ab->start - pos : ab->buffer->samples - pos;
+    if (space < samples) {
+        rotate(ab);
+        pos = ab->samples;
+    }
+    get_span(ab, pos, samples, out_buffer);
 }
 
 void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= mp_audio_buffer_get_write_available(ab));
-    ab->buffer->samples += samples;
+    ab->samples += samples;
 }
 
 // Append data to the end of the buffer.
@@ -102,51 +179,71 @@ void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
 // For now always copies the data.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa)
 {
-    int offset = ab->buffer->samples;
-    ab->buffer->samples += mpa->samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, offset, mpa, 0, mpa->samples);
+    reserve(ab, ab->samples + mpa->samples);
+    int pos = wrap(ab, ab->start + ab->samples);
+    int part = MPMIN(mpa->samples, ab->buffer->samples - pos);
+    mp_audio_copy(ab->buffer, pos, mpa, 0, part);
+    mp_audio_copy(ab->buffer, 0, mpa, part, mpa->samples - part);
+    ab->samples += mpa->samples;
 }
 
 // Prepend silence to the start of the buffer.
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    int oldlen = ab->buffer->samples;
-    ab->buffer->samples += samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, samples, ab->buffer, 0, oldlen);
-    mp_audio_fill_silence(ab->buffer, 0, samples);
+    reserve(ab, ab->samples + samples);
+    int start = ab->start - samples;
+    if (start < 0)
+        start += ab->buffer->samples;
+    int part = MPMIN(samples, ab->buffer->samples - start);
+    mp_audio_fill_silence(ab->buffer, start, part);
+    mp_audio_fill_silence(ab->buffer, 0, samples - part);
+    ab->start = start;
+    ab->samples += samples;
+}
+
+// Get the current readable data. Since the buffer is circular, the data is
+// returned as two consecutive spans. out_b->samples is 0 if the data is
+// contiguous.
+void mp_audio_buffer_peek(struct mp_audio_buffer *ab, struct mp_audio *out_a,
+                          struct mp_audio *out_b)
+{
+    int part = MPMIN(ab->samples, ab->buffer->samples - ab->start);
+    get_span(ab, ab->start, part, out_a);
+    get_span(ab, 0, ab->samples - part, out_b);
 }
 
-// Get the start of the current readable buffer.
-void mp_audio_buffer_peek(struct mp_audio_buffer *ab, struct mp_audio *out_mpa)
+// Move the data so that mp_audio_buffer_peek() returns it as a single span.
+// This moves the data within the internal buffer if it wraps around its end.
+void mp_audio_buffer_make_contiguous(struct mp_audio_buffer *ab)
 {
-    *out_mpa = *ab->buffer;
+    if (ab->start + ab->samples > ab->buffer->samples)
+        rotate(ab);
 }
 
 // Skip leading samples. (Used with mp_audio_buffer_peek() to read data.)
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
-    assert(samples >= 0 && samples <= ab->buffer->samples);
-    mp_audio_copy(ab->buffer, 0, ab->buffer, samples,
-                  ab->buffer->samples - samples);
-    ab->buffer->samples -= samples;
+    assert(samples >= 0 && samples <= ab->samples);
+    ab->start = wrap(ab, ab->start + samples);
+    ab->samples -= samples;
+    if (!ab->samples)
+        ab->start = 0;
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
-    ab->buffer->samples = 0;
+    ab->start = ab->samples = 0;
 }
 
 // Return number of buffered audio samples
 int mp_audio_buffer_samples(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples;
+    return ab->samples;
 }
 
 // Return amount of buffered audio in seconds.
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples / (double)ab->buffer->rate;
+    return ab->samples / (double)ab->buffer->rate;
 }
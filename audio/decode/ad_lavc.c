@@ -214,7 +214,7 @@ static int decode_packet(struct dec_audio *da, struct mp_audio **out)
             mpkt->pts = MP_NOPTS_VALUE; // don't reset PTS next time
         }
         if (mpkt->len == 0 || ret < 0) {
-            talloc_free(mpkt);
+            free_demux_packet(mpkt);
             priv->packet = NULL;
         }
         // LATM may need many packets to find mux info
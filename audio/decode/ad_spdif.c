@@ -265,7 +265,7 @@ static int decode_packet(struct dec_audio *da, struct mp_audio **out)
             return AD_ERR;
     }
     int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
-    talloc_free(mpkt);
+    free_demux_packet(mpkt);
     avio_flush(spdif_ctx->lavf_ctx->pb);
     if (ret < 0)
         return AD_ERR;
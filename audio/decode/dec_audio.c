@@ -201,7 +201,7 @@ static bool copy_output(struct af_stream *afs, struct mp_audio_buffer *outbuf,
         if (!mpa)
             return false; // out of data
         mp_audio_buffer_append(outbuf, mpa);
-        talloc_free(mpa);
+        mp_audio_pool_release(afs->pool, mpa);
     }
     return true;
 }
@@ -19,6 +19,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "common/common.h"
@@ -48,6 +50,7 @@ extern const struct af_info af_info_lavcac3enc;
 extern const struct af_info af_info_lavrresample;
 extern const struct af_info af_info_sweep;
 extern const struct af_info af_info_hrtf;
+extern const struct af_info af_info_convolver;
 extern const struct af_info af_info_ladspa;
 extern const struct af_info af_info_center;
 extern const struct af_info af_info_sinesuppress;
@@ -74,6 +77,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_lavrresample,
     &af_info_sweep,
     &af_info_hrtf,
+    &af_info_convolver,
 #if HAVE_LADSPA
     &af_info_ladspa,
 #endif
@@ -121,7 +125,7 @@ const struct m_obj_list af_obj_list = {
 static void af_forget_frames(struct af_instance *af)
 {
     for (int n = 0; n < af->num_out_queued; n++)
-        talloc_free(af->out_queued[n]);
+        mp_audio_pool_release(af->out_pool, af->out_queued[n]);
     af->num_out_queued = 0;
 }
 
@@ -208,7 +212,8 @@ static struct af_instance *af_create(struct af_stream *s, char *name,
         .data = talloc_zero(af, struct mp_audio),
         .log = mp_log_new(af, s->log, name),
         .replaygain_data = s->replaygain_data,
-        .out_pool = mp_audio_pool_create(af),
+        .out_pool = s->pool,
+        .max_out_ratio = 1,
     };
     struct m_config *config = m_config_from_obj_desc(af, s->log, &desc);
     if (m_config_apply_defaults(config, name, s->opts->af_defs) < 0)
@@ -523,6 +528,9 @@ static int af_reinit(struct af_stream *s)
     af_copy_unset_fields(&s->output, &s->filter_output);
     if (mp_audio_config_equals(&s->output, &s->filter_output)) {
         s->initialized = 1;
+        s->num_frames = 0;
+        s->num_allocs = mp_audio_pool_num_allocs(s->pool);
+        s->pool_size = mp_audio_pool_element_size(s->pool);
         af_print_filter_chain(s, NULL, MSGL_V);
         return AF_OK;
     }
@@ -550,6 +558,7 @@ struct af_stream *af_new(struct mpv_global *global)
 {
     struct af_stream *s = talloc_zero(NULL, struct af_stream);
     s->log = mp_log_new(s, global->log, "!af");
+    s->pool = mp_audio_pool_create(s);
 
     static const struct af_info in = { .name = "in" };
     s->first = talloc(s, struct af_instance);
@@ -558,6 +567,8 @@ struct af_stream *af_new(struct mpv_global *global)
         .log = s->log,
         .control = input_control,
         .filter_frame = dummy_filter,
+        .out_pool = s->pool,
+        .max_out_ratio = 1,
         .priv = s,
         .data = &s->input,
     };
@@ -569,6 +580,8 @@ struct af_stream *af_new(struct mpv_global *global)
         .log = s->log,
         .control = output_control,
         .filter_frame = dummy_filter,
+        .out_pool = s->pool,
+        .max_out_ratio = 1,
         .priv = s,
         .data = &s->filter_output,
     };
@@ -581,6 +594,8 @@ struct af_stream *af_new(struct mpv_global *global)
 
 void af_destroy(struct af_stream *s)
 {
+    if (!s)
+        return;
     af_uninit(s);
     talloc_free(s);
 }
@@ -663,6 +678,30 @@ struct af_instance *af_find_by_label(struct af_stream *s, char *label)
     return NULL;
 }
 
+// Send a filter specific command (AF_CONTROL_COMMAND, with arg pointing to a
+// char *[2] of command name and argument) to the filter with the given label.
+int af_send_command(struct af_stream *s, char *label, char *cmd, char *arg)
+{
+    struct af_instance *af = af_find_by_label(s, label);
+    if (!af) {
+        MP_ERR(s, "Audio filter '%s' not found.\n", label);
+        return AF_ERROR;
+    }
+    char *args[2] = {cmd, arg};
+    int r = af->control(af, AF_CONTROL_COMMAND, args);
+    if (r == AF_UNKNOWN) {
+        MP_ERR(s, "Audio filter '%s' doesn't support command '%s'.\n",
+               label, cmd);
+        return AF_ERROR;
+    }
+    if (r != AF_OK) {
+        MP_ERR(s, "Audio filter '%s': invalid argument '%s' for command "
+               "'%s'.\n", label, arg, cmd);
+        return AF_ERROR;
+    }
+    return AF_OK;
+}
+
 /* Remove the first filter that matches this name. Return number of filters
  * removed (0, 1), or a negative error code if reinit after removing failed.
  */
@@ -757,14 +796,38 @@ static void read_remaining(struct af_instance *af)
 
 static int af_do_filter(struct af_instance *af, struct mp_audio *frame)
 {
-    if (frame)
+    if (frame) {
         assert(mp_audio_config_equals(&af->fmt_in, frame));
+        if (af->in_place && af_make_writeable(af, frame) < 0) {
+            MP_ERR(af, "Could not allocate frame.\n");
+            talloc_free(frame);
+            return -1;
+        }
+    }
     int r = af->filter_frame(af, frame);
     if (r < 0)
         MP_ERR(af, "Error filtering frame.\n");
     return r;
 }
 
+// Number of frames after (re)init or growing the pool during which buffer
+// allocations are expected.
+#define AF_WARMUP_FRAMES 50
+
+// Size the chain's frame pool for the largest frame a filter can output when
+// the chain is fed frames with the given number of samples.
+static void af_reserve_frames(struct af_stream *s, int samples)
+{
+    double ratio = 1;
+    int64_t size = 0;
+    for (struct af_instance *af = s->first; af; af = af->next) {
+        ratio *= af->max_out_ratio;
+        int64_t out_samples = samples * ratio + 1;
+        size = MPMAX(size, out_samples * af->fmt_out.sstride);
+    }
+    mp_audio_pool_reserve(s->pool, MPMIN(size, INT_MAX / 2));
+}
+
 // Input a frame into the filter chain. Ownership of frame is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int af_filter_frame(struct af_stream *s, struct mp_audio *frame)
@@ -774,6 +837,28 @@ int af_filter_frame(struct af_stream *s, struct mp_audio *frame)
         talloc_free(frame);
         return -1;
     }
+    // Frames are recycled through the pool, so allocations are expected only
+    // while the pool warms up, or if frames get larger. Growing the pool (here
+    // or on demand in mp_audio_pool_get()) replaces the cached buffers, so it
+    // warms up again.
+    int pool_size = mp_audio_pool_element_size(s->pool);
+    if (pool_size != s->pool_size) {
+        s->pool_size = pool_size;
+        s->num_frames = 0;
+    }
+    int64_t num_allocs = mp_audio_pool_num_allocs(s->pool);
+    if (num_allocs != s->num_allocs) {
+        MP_DBG(s, "Allocated %"PRId64" audio buffers after %"PRId64
+               " frames.\n", num_allocs - s->num_allocs, s->num_frames);
+        if (s->num_frames > AF_WARMUP_FRAMES && !s->warned_allocs) {
+            MP_WARN(s, "Audio buffers are still being allocated after %d "
+                    "frames (reported only once).\n", AF_WARMUP_FRAMES);
+            s->warned_allocs = true;
+        }
+        s->num_allocs = num_allocs;
+    }
+    s->num_frames++;
+    af_reserve_frames(s, frame->samples);
     return af_do_filter(s->first, frame);
 }
 
@@ -75,6 +75,14 @@ struct af_instance {
     double delay; /* Delay caused by the filter, in seconds of audio consumed
                    * without corresponding output */
     bool auto_inserted; // inserted by af.c, such as conversion filters
+    /* If set, filter_frame() modifies the frame it's passed and outputs it.
+     * af.c makes the frame writeable before passing it to the filter. */
+    bool in_place;
+    /* Expected maximum number of output samples per input sample. Filters
+     * which change the number of samples (resampling, speed changes) set
+     * this, so that the chain's frame pool can be sized in advance. If a
+     * filter outputs more, the pool still grows on demand. Default: 1. */
+    double max_out_ratio;
     char *label;
 
     struct mp_audio fmt_in, fmt_out;
@@ -82,7 +90,7 @@ struct af_instance {
     struct mp_audio **out_queued;
     int num_out_queued;
 
-    struct mp_audio_pool *out_pool;
+    struct mp_audio_pool *out_pool; // shared by all filters in the chain
 };
 
 // Current audio stream
@@ -101,6 +109,17 @@ struct af_stream {
     struct mp_log *log;
     struct MPOpts *opts;
     struct replaygain_data *replaygain_data;
+
+    // Used for all frames allocated by filters.
+    struct mp_audio_pool *pool;
+    // Number of frames filtered since the last reinit, and the pool's
+    // allocation count as of the last frame. Steady state playback is
+    // expected not to allocate.
+    int64_t num_frames;
+    int64_t num_allocs;
+    // Size of the pool's buffers as of the last frame.
+    int pool_size;
+    bool warned_allocs;
 };
 
 // Return values
@@ -127,6 +146,7 @@ enum af_control {
     AF_CONTROL_GET_PAN_BALANCE,
     AF_CONTROL_SET_PLAYBACK_SPEED,
     AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE,
+    AF_CONTROL_COMMAND,
 };
 
 // Argument for AF_CONTROL_SET_PAN_LEVEL
@@ -143,6 +163,7 @@ struct af_instance *af_add(struct af_stream *s, char *name, char *label,
                            char **args);
 int af_remove_by_label(struct af_stream *s, char *label);
 struct af_instance *af_find_by_label(struct af_stream *s, char *label);
+int af_send_command(struct af_stream *s, char *label, char *cmd, char *arg);
 struct af_instance *af_control_any_rev(struct af_stream *s, int cmd, void *arg);
 void af_control_all(struct af_stream *s, int cmd, void *arg);
 void af_seek_reset(struct af_stream *s);
@@ -41,10 +41,6 @@ static int filter_##name(struct af_instance *af, struct mp_audio *data) \
 { \
     if (!data) \
         return 0; \
-    if (af_make_writeable(af, data) < 0) { \
-        talloc_free(data); \
-        return -1; \
-    } \
     bs2b_cross_feed_##name(((struct af_bs2b*)(af->priv))->filter, \
         (data->planes[0]), data->samples); \
     af_add_output_frame(af, data); \
@@ -131,6 +127,7 @@ static int af_open(struct af_instance *af)
     struct af_bs2b *s = af->priv;
     af->control = control;
     af->uninit  = uninit;
+    af->in_place = true;
 
     // NULL means failed initialization
     if (!(s->filter = bs2b_open())) {
@@ -30,6 +30,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 // Data for specific instances of this filter
 typedef struct af_center_s
@@ -61,23 +62,20 @@ static int filter_frame(struct af_instance* af, struct mp_audio* data)
 {
   if (!data)
     return 0;
-  if (af_make_writeable(af, data) < 0) {
-    talloc_free(data);
-    return -1;
-  }
   struct mp_audio*    c   = data;        // Current working data
   af_center_t*  s   = af->priv; // Setup for this instance
   float*        a   = c->planes[0];      // Audio data
   int           nch = c->nch;    // Number of channels
-  int           len = c->samples*c->nch;         // Number of samples in current audio block
   int           ch  = s->ch;     // Channel in which to insert the center audio
-  register int  i;
 
-  // Run filter
-  for(i=0;i<len;i+=nch){
-    // Average left and right
-    a[i+ch] = (a[i]/2) + (a[i+1]/2);
-  }
+  // Average left and right, leave the other channels alone
+  float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS] = {{0}};
+  for(int i=0;i<nch;i++)
+    matrix[i][i] = 1;
+  matrix[ch][ch] = 0;
+  matrix[ch][0] = 0.5;
+  matrix[ch][1] = 0.5;
+  af_dsp_mix_float(a, nch, a, nch, matrix, c->samples);
 
   af_add_output_frame(af, data);
   return 0;
@@ -87,6 +85,7 @@ static int filter_frame(struct af_instance* af, struct mp_audio* data)
 static int af_open(struct af_instance* af){
   af->control=control;
   af->filter_frame = filter_frame;
+  af->in_place = true;
   return AF_OK;
 }
 
@@ -28,6 +28,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 #define FR 0
 #define TO 1
@@ -39,84 +40,6 @@ typedef struct af_channels_s{
   char *routes;
 }af_channels_t;
 
-// Local function for copying data
-static void copy(struct af_instance *af, void* in, void* out,
-                 int ins, int inos,int outs, int outos, int len, int bps)
-{
-  switch(bps){
-  case 1:{
-    int8_t* tin  = (int8_t*)in;
-    int8_t* tout = (int8_t*)out;
-    tin  += inos;
-    tout += outos;
-    len = len/ins;
-    while(len--){
-      *tout=*tin;
-      tin +=ins;
-      tout+=outs;
-    }
-    break;
-  }
-  case 2:{
-    int16_t* tin  = (int16_t*)in;
-    int16_t* tout = (int16_t*)out;
-    tin  += inos;
-    tout += outos;
-    len = len/(2*ins);
-    while(len--){
-      *tout=*tin;
-      tin +=ins;
-      tout+=outs;
-    }
-    break;
-  }
-  case 3:{
-    int8_t* tin  = (int8_t*)in;
-    int8_t* tout = (int8_t*)out;
-    tin  += 3 * inos;
-    tout += 3 * outos;
-    len = len / ( 3 * ins);
-    while (len--) {
-      tout[0] = tin[0];
-      tout[1] = tin[1];
-      tout[2] = tin[2];
-      tin += 3 * ins;
-      tout += 3 * outs;
-    }
-    break;
-  }
-  case 4:{
-    int32_t* tin  = (int32_t*)in;
-    int32_t* tout = (int32_t*)out;
-    tin  += inos;
-    tout += outos;
-    len = len/(4*ins);
-    while(len--){
-      *tout=*tin;
-      tin +=ins;
-      tout+=outs;
-    }
-    break;
-  }
-  case 8:{
-    int64_t* tin  = (int64_t*)in;
-    int64_t* tout = (int64_t*)out;
-    tin  += inos;
-    tout += outos;
-    len = len/(8*ins);
-    while(len--){
-      *tout=*tin;
-      tin +=ins;
-      tout+=outs;
-    }
-    break;
-  }
-  default:
-    MP_ERR(af, "Unsupported number of bytes/sample: %i"
-           " please report this error on the MPlayer mailing list. \n",bps);
-  }
-}
-
 // Make sure the routes are sane
 static int check_routes(struct af_instance *af, int nin, int nout)
 {
@@ -200,10 +123,11 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
 
   if(AF_OK == check_routes(af,c->nch,l->nch))
     for(i=0;i<s->nr;i++)
-      copy(af, c->planes[0],l->planes[0],c->nch,s->route[i][FR],
-           l->nch,s->route[i][TO],mp_audio_psize(c),c->bps);
+      af_dsp_copy_channel(l->planes[0],l->nch,s->route[i][TO],
+                          c->planes[0],c->nch,s->route[i][FR],
+                          c->bps,c->samples);
 
-  talloc_free(c);
+  mp_audio_pool_release(af->out_pool, c);
   af_add_output_frame(af, l);
   return 0;
 }
@@ -0,0 +1,218 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libavutil/intfloat.h>
+#include <libavutil/intreadwrite.h>
+
+#include "common/common.h"
+#include "af.h"
+#include "fftconv.h"
+
+// Block size of the convolution, which is also the added latency.
+#define BLOCK 256
+
+// Limit for the impulse response file.
+#define MAX_FILE_SIZE (256 * 1024 * 1024)
+
+struct priv {
+    float *ir[MP_NUM_CHANNELS];     // impulse response, one per channel
+    int ir_nch, ir_len, ir_rate;
+    struct mp_fftconv *conv;
+    // command line options
+    char *file;
+};
+
+// Convert the samples of a WAV data chunk to float. Returns false if the
+// sample format is not supported.
+static bool convert_pcm(struct priv *p, int tag, int bits, const uint8_t *pcm)
+{
+    int bps = bits / 8;
+    for (int n = 0; n < p->ir_len; n++) {
+        for (int c = 0; c < p->ir_nch; c++) {
+            const uint8_t *s = pcm + (n * p->ir_nch + c) * bps;
+            float v;
+            if (tag == 3 && bits == 32) {
+                v = av_int2float(AV_RL32(s));
+            } else if (tag == 1 && bits == 16) {
+                v = (int16_t)AV_RL16(s) / 32768.0f;
+            } else if (tag == 1 && bits == 24) {
+                v = (int32_t)(AV_RL24(s) << 8) / 2147483648.0f;
+            } else if (tag == 1 && bits == 32) {
+                v = (int32_t)AV_RL32(s) / 2147483648.0f;
+            } else {
+                return false;
+            }
+            p->ir[c][n] = v;
+        }
+    }
+    return true;
+}
+
+static bool parse_wav(struct af_instance *af, const uint8_t *buf, size_t size)
+{
+    struct priv *p = af->priv;
+    if (size < 12 || memcmp(buf, "RIFF", 4) || memcmp(buf + 8, "WAVE", 4))
+        return false;
+    const uint8_t *fmt = NULL, *pcm = NULL;
+    size_t fmt_size = 0, pcm_size = 0;
+    size_t pos = 12;
+    while (size - pos >= 8) {
+        size_t len = MPMIN(AV_RL32(buf + pos + 4), size - pos - 8);
+        if (memcmp(buf + pos, "fmt ", 4) == 0) {
+            fmt = buf + pos + 8;
+            fmt_size = len;
+        } else if (memcmp(buf + pos, "data", 4) == 0) {
+            pcm = buf + pos + 8;
+            pcm_size = len;
+        }
+        pos += 8 + len + (len & 1);
+        pos = MPMIN(pos, size);
+    }
+    if (!fmt || fmt_size < 16 || !pcm)
+        return false;
+    int tag = AV_RL16(fmt);
+    // WAVE_FORMAT_EXTENSIBLE: the real tag starts the sub-format GUID.
+    if (tag == 0xFFFE && fmt_size >= 26)
+        tag = AV_RL16(fmt + 24);
+    p->ir_nch = AV_RL16(fmt + 2);
+    p->ir_rate = AV_RL32(fmt + 4);
+    int bits = AV_RL16(fmt + 14);
+    if (p->ir_nch < 1 || p->ir_nch > MP_NUM_CHANNELS || p->ir_rate < 1 ||
+        p->ir_rate > 1000000 || (bits != 16 && bits != 24 && bits != 32))
+        return false;
+    p->ir_len = pcm_size / (bits / 8 * p->ir_nch);
+    if (p->ir_len < 1)
+        return false;
+    for (int c = 0; c < p->ir_nch; c++)
+        p->ir[c] = talloc_array(p, float, p->ir_len);
+    return convert_pcm(p, tag, bits, pcm);
+}
+
+static bool load_ir(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+    bool ok = false;
+    uint8_t *buf = NULL;
+    FILE *f = fopen(p->file, "rb");
+    if (!f) {
+        MP_ERR(af, "Can't open '%s'.\n", p->file);
+        return false;
+    }
+    if (fseek(f, 0, SEEK_END))
+        goto done;
+    long size = ftell(f);
+    if (size < 0 || size > MAX_FILE_SIZE || fseek(f, 0, SEEK_SET))
+        goto done;
+    buf = talloc_size(NULL, size);
+    if (fread(buf, size, 1, f) != 1)
+        goto done;
+    ok = parse_wav(af, buf, size);
+done:
+    if (!ok)
+        MP_ERR(af, "'%s' is not a supported WAV file.\n", p->file);
+    talloc_free(buf);
+    fclose(f);
+    return ok;
+}
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+        struct mp_audio orig_in = *in;
+
+        // The impulse response is used as is, so resample to its rate. An
+        // impulse response with 1 channel is applied to every channel.
+        mp_audio_set_format(in, AF_FORMAT_FLOATP);
+        in->rate = p->ir_rate;
+        if (p->ir_nch > 1 && in->nch != p->ir_nch)
+            mp_audio_set_num_channels(in, p->ir_nch);
+        mp_audio_copy_config(af->data, in);
+
+        talloc_free(p->conv);
+        p->conv = mp_fftconv_create(p, BLOCK, in->nch, in->nch, p->ir_len);
+        if (!p->conv) {
+            MP_ERR(af, "Impulse response is too long.\n");
+            return AF_ERROR;
+        }
+        for (int c = 0; c < in->nch; c++) {
+            float *ir = p->ir[p->ir_nch > 1 ? c : 0];
+            mp_fftconv_add_ir(p->conv, c, c, ir, p->ir_len, 0, 1);
+        }
+        af->delay = BLOCK / (double)in->rate;
+
+        return mp_audio_config_equals(in, &orig_in) ? AF_OK : AF_FALSE;
+    }
+    case AF_CONTROL_RESET:
+        if (p->conv)
+            mp_fftconv_reset(p->conv);
+        return AF_OK;
+    }
+    return AF_UNKNOWN;
+}
+
+static int filter_frame(struct af_instance *af, struct mp_audio *data)
+{
+    struct priv *p = af->priv;
+
+    if (!data)
+        return 0;
+    float **planes = (float **)data->planes;
+    mp_fftconv_process(p->conv, planes, planes, data->samples);
+
+    af_add_output_frame(af, data);
+    return 0;
+}
+
+static int af_open(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    af->control = control;
+    af->filter_frame = filter_frame;
+    af->in_place = true;
+
+    if (!p->file || !p->file[0]) {
+        MP_ERR(af, "No impulse response file given.\n");
+        return AF_ERROR;
+    }
+    if (!load_ir(af))
+        return AF_ERROR;
+    MP_VERBOSE(af, "Impulse response: %d channels, %d samples at %d Hz.\n",
+               p->ir_nch, p->ir_len, p->ir_rate);
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+const struct af_info af_info_convolver = {
+    .info = "Convolution with an impulse response",
+    .name = "convolver",
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .options = (const struct m_option[]) {
+        OPT_STRING("file", file, 0),
+        {0}
+    },
+};
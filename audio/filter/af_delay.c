@@ -28,17 +28,12 @@
 
 #include "common/common.h"
 #include "af.h"
-
-#define L 65536
-
-#define UPDATEQI(qi) qi=(qi+1)&(L-1)
+#include "dsp.h"
 
 // Data for specific instances of this filter
 typedef struct af_delay_s
 {
-  void* q[AF_NCH];      // Circular queues used for delaying audio signal
-  int   wi[AF_NCH];     // Write index
-  int   ri;             // Read index
+  struct af_delay_line *dl;
   float d[AF_NCH];      // Delay [ms]
   char *delaystr;
 }af_delay_t;
@@ -50,36 +45,24 @@ static int control(struct af_instance* af, int cmd, void* arg)
   switch(cmd){
   case AF_CONTROL_REINIT:{
     int i;
+    int delays[AF_NCH];
     struct mp_audio *in = arg;
 
-    if (in->bps != 1 && in->bps != 2 && in->bps != 4) {
-      MP_FATAL(af, "Sample format not supported\n");
-      return AF_ERROR;
-    }
-
-    // Free prevous delay queues
-    for(i=0;i<af->data->nch;i++)
-      free(s->q[i]);
-
     mp_audio_force_interleaved_format(in);
     mp_audio_copy_config(af->data, in);
 
-    // Allocate new delay queues
-    for(i=0;i<af->data->nch;i++){
-      s->q[i] = calloc(L,af->data->bps);
-      if(NULL == s->q[i])
-        MP_FATAL(af, "Out of memory\n");
-    }
-
-    if(AF_OK != af_from_ms(AF_NCH, s->d, s->wi, af->data->rate, 0.0, 1000.0))
+    if(AF_OK != af_from_ms(AF_NCH, s->d, delays, af->data->rate, 0.0, 1000.0))
       return AF_ERROR;
-    s->ri = 0;
     for(i=0;i<AF_NCH;i++){
       MP_DBG(af, "Channel %i delayed by %0.3fms\n",
              i,MPCLAMP(s->d[i],0.0,1000.0));
       MP_TRACE(af, "Channel %i delayed by %i samples\n",
-             i,s->wi[i]);
+             i,delays[i]);
     }
+
+    // Replace the delay line, which also discards the buffered audio
+    talloc_free(s->dl);
+    s->dl = af_delay_line_alloc(NULL, af->data->nch, af->data->bps, delays);
     return AF_OK;
   }
   }
@@ -89,10 +72,7 @@ static int control(struct af_instance* af, int cmd, void* arg)
 // Deallocate memory
 static void uninit(struct af_instance* af)
 {
-  int i;
-
-  for(i=0;i<AF_NCH;i++)
-      free(((af_delay_t*)(af->priv))->q[i]);
+  talloc_free(((af_delay_t*)(af->priv))->dl);
 }
 
 static int filter_frame(struct af_instance *af, struct mp_audio *c)
@@ -100,61 +80,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
   if (!c)
     return 0;
   af_delay_t*   s   = af->priv; // Setup for this instance
-  int           nch = c->nch;    // Number of channels
-  int           len = mp_audio_psize(c)/c->bps; // Number of sample in data chunk
-  int           ri  = 0;
-  int           ch,i;
-  if (af_make_writeable(af, c) < 0) {
-    talloc_free(c);
-    return -1;
-  }
-  for(ch=0;ch<nch;ch++){
-    switch(c->bps){
-    case 1:{
-      int8_t* a = c->planes[0];
-      int8_t* q = s->q[ch];
-      int wi = s->wi[ch];
-      ri = s->ri;
-      for(i=ch;i<len;i+=nch){
-        q[wi] = a[i];
-        a[i]  = q[ri];
-        UPDATEQI(wi);
-        UPDATEQI(ri);
-      }
-      s->wi[ch] = wi;
-      break;
-    }
-    case 2:{
-      int16_t* a = c->planes[0];
-      int16_t* q = s->q[ch];
-      int wi = s->wi[ch];
-      ri = s->ri;
-      for(i=ch;i<len;i+=nch){
-        q[wi] = a[i];
-        a[i]  = q[ri];
-        UPDATEQI(wi);
-        UPDATEQI(ri);
-      }
-      s->wi[ch] = wi;
-      break;
-    }
-    case 4:{
-      int32_t* a = c->planes[0];
-      int32_t* q = s->q[ch];
-      int wi = s->wi[ch];
-      ri = s->ri;
-      for(i=ch;i<len;i+=nch){
-        q[wi] = a[i];
-        a[i]  = q[ri];
-        UPDATEQI(wi);
-        UPDATEQI(ri);
-      }
-      s->wi[ch] = wi;
-      break;
-    }
-    }
-  }
-  s->ri = ri;
+  af_delay_line_process(s->dl, c->planes[0], c->samples);
   af_add_output_frame(af, c);
   return 0;
 }
@@ -164,6 +90,7 @@ static int af_open(struct af_instance* af){
     af->control=control;
     af->uninit=uninit;
     af->filter_frame = filter_frame;
+    af->in_place = true;
     af_delay_t *s = af->priv;
     int n = 1;
     int i = 0;
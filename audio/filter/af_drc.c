@@ -278,11 +278,6 @@ static int filter(struct af_instance *af, struct mp_audio *data)
   if (!data)
     return 0;
 
-  if (af_make_writeable(af, data) < 0) {
-    talloc_free(data);
-    return -1;
-  }
-
   if(af->data->format == (AF_FORMAT_S16))
   {
     if (s->method == 2)
@@ -306,6 +301,7 @@ static int af_open(struct af_instance* af){
   int i = 0;
   af->control=control;
   af->filter_frame = filter;
+  af->in_place = true;
   af_drc_t *priv = af->priv;
 
   priv->mul = MUL_INIT;
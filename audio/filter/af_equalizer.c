@@ -24,12 +24,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <inttypes.h>
 #include <math.h>
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 #define L       2      // Storage for filter taps
 #define KM      10     // Max number of bands
@@ -57,17 +59,19 @@
 #define G_MAX   +12.0
 #define G_MIN   -12.0
 
+// Duration of gain changes at runtime, to avoid clicks [ms]
+#define RAMP_MS 20
+
 // Data for specific instances of this filter
 typedef struct af_equalizer_s
 {
   float   a[KM][L];             // A weights
   float   b[KM][L];             // B weights
-  float   wq[AF_NCH][KM][L];    // Circular buffer for W data
   float   g[AF_NCH][KM];        // Gain factor for each channel and band
   int     K;                    // Number of used eq bands
-  int     channels;             // Number of channels
   float   gain_factor;     // applied at output to avoid clipping
   double  p[KM];
+  struct af_biquad_cascade *bq; // One section per band
 } af_equalizer_t;
 
 // 2nd order Band-pass Filter design
@@ -82,6 +86,58 @@ static void bp2(float* a, float* b, float fc, float q){
   b[1] = -1.0050;
 }
 
+static void set_gain(af_equalizer_t *s, int band)
+{
+  for(int i=0;i<AF_NCH;i++)
+    s->g[i][band] = pow(10.0,MPCLAMP(s->p[band],G_MIN,G_MAX)/20.0)-1.0;
+}
+
+// Calculate gain factor to prevent clipping at output
+static void update_gain_factor(af_equalizer_t *s)
+{
+  s->gain_factor=0.0;
+  for(int k=0;k<AF_NCH;k++)
+  {
+      for(int i=0;i<KM;i++)
+      {
+          if(s->gain_factor < s->g[k][i]) s->gain_factor=s->g[k][i];
+      }
+  }
+
+  s->gain_factor=log10(s->gain_factor + 1.0) * 20.0;
+
+  if(s->gain_factor > 0.0)
+  {
+      s->gain_factor=0.1+(s->gain_factor/12.0);
+  }else{
+      s->gain_factor=1;
+  }
+}
+
+// Load the filters into the cascade, fading from the previous ones over
+// ramp frames. Each band adds its band-pass output to the signal:
+//   w = b0 * x + a0 * w[n-1] + a1 * w[n-2]
+//   y = x + g * (w + b1 * w[n-2])
+// The gain factor is folded into the last section.
+static void update_filters(af_equalizer_t *s, int nch, int ramp)
+{
+  for(int k=0;k<MPMAX(s->K,1);k++){
+    float out = k == MPMAX(s->K,1) - 1 ? s->gain_factor : 1;
+    for(int ch=0;ch<nch;ch++){
+      struct af_biquad bq = {.d = out};
+      if(k < s->K){
+        float g = s->g[ch][k] * out;
+        bq = (struct af_biquad){
+          .b0 = s->b[k][0], .a1 = s->a[k][0], .a2 = s->a[k][1],
+          .d = out, .c0 = g, .c2 = g * s->b[k][1],
+        };
+      }
+      af_biquad_cascade_set(s->bq, k, ch, &bq);
+    }
+  }
+  af_biquad_cascade_update(s->bq, ramp);
+}
+
 // Initialization and runtime control
 static int control(struct af_instance* af, int cmd, void* arg)
 {
@@ -89,11 +145,9 @@ static int control(struct af_instance* af, int cmd, void* arg)
 
   switch(cmd){
   case AF_CONTROL_REINIT:{
-    int k =0, i =0;
+    int k =0;
     float F[KM] = CF;
 
-    s->gain_factor=0.0;
-
     // Sanity check
     if(!arg) return AF_ERROR;
 
@@ -116,72 +170,55 @@ static int control(struct af_instance* af, int cmd, void* arg)
     // Calculate how much this plugin adds to the overall time delay
     af->delay = 2.0 / (double)af->data->rate;
 
-    // Calculate gain factor to prevent clipping at output
-    for(k=0;k<AF_NCH;k++)
-    {
-        for(i=0;i<KM;i++)
-        {
-            if(s->gain_factor < s->g[k][i]) s->gain_factor=s->g[k][i];
-        }
-    }
-
-    s->gain_factor=log10(s->gain_factor + 1.0) * 20.0;
+    update_gain_factor(s);
 
-    if(s->gain_factor > 0.0)
-    {
-        s->gain_factor=0.1+(s->gain_factor/12.0);
-    }else{
-        s->gain_factor=1;
-    }
+    talloc_free(s->bq);
+    s->bq = af_biquad_cascade_alloc(NULL, af->data->nch, MPMAX(s->K,1));
+    update_filters(s, af->data->nch, 0);
 
     return af_test_output(af,arg);
   }
+  case AF_CONTROL_COMMAND:{
+    // "eN" sets the gain of band N in dB, like the sub-option
+    char **args = arg;
+    if(strlen(args[0]) != 2 || args[0][0] != 'e' || args[0][1] < '0' ||
+       args[0][1] >= '0' + KM)
+      return AF_UNKNOWN;
+    int band = args[0][1] - '0';
+    char *end;
+    double gain = strtod(args[1], &end);
+    if(end == args[1] || *end)
+      return AF_ERROR;
+    s->p[band] = gain;
+    set_gain(s, band);
+    update_gain_factor(s);
+    if(s->bq)
+      update_filters(s, af->data->nch, af->data->rate * RAMP_MS / 1000);
+    return AF_OK;
+  }
+  case AF_CONTROL_RESET:
+    if(s->bq)
+      af_biquad_cascade_reset(s->bq);
+    return AF_OK;
   }
   return AF_UNKNOWN;
 }
 
+static void uninit(struct af_instance* af)
+{
+  af_equalizer_t* s = af->priv;
+  talloc_free(s->bq);
+}
+
 static int filter(struct af_instance* af, struct mp_audio* data)
 {
   struct mp_audio*       c      = data;                         // Current working data
   if (!c)
     return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
 
-  if (af_make_writeable(af, data) < 0) {
-    talloc_free(data);
-    return -1;
-  }
+  af_biquad_cascade_process(s->bq, c->planes[0], c->samples);
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
-  }
   af_add_output_frame(af, data);
   return 0;
 }
@@ -189,13 +226,12 @@ static int filter(struct af_instance* af, struct mp_audio* data)
 // Allocate memory and set function pointers
 static int af_open(struct af_instance* af){
   af->control=control;
+  af->uninit=uninit;
   af->filter_frame = filter;
+  af->in_place = true;
   af_equalizer_t *priv = af->priv;
-  for(int i=0;i<AF_NCH;i++){
-      for(int j=0;j<KM;j++){
-        priv->g[i][j] = pow(10.0,MPCLAMP(priv->p[j],G_MIN,G_MAX)/20.0)-1.0;
-      }
-    }
+  for(int j=0;j<KM;j++)
+    set_gain(priv, j);
   return AF_OK;
 }
 
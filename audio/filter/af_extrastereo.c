@@ -27,6 +27,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 // Data for specific instances of this filter
 typedef struct af_extrastereo_s
@@ -79,28 +80,23 @@ static void play_float(af_extrastereo_t *s, struct mp_audio* data)
   register int i = 0;
   float *a = (float*)data->planes[0];   // Audio data
   int len = data->samples * data->nch;  // Number of samples
-  float avg, l, r;
 
-  for (i = 0; i < len; i+=2)
-  {
-    avg = (a[i] + a[i + 1]) / 2;
+  // avg + mul * (l - avg), with avg = (l + r) / 2
+  float same = (1 + s->mul) / 2, other = (1 - s->mul) / 2;
+  const float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS] = {
+    {same, other},
+    {other, same},
+  };
+  af_dsp_mix_float(a, 2, a, 2, matrix, data->samples);
 
-    l = avg + (s->mul * (a[i] - avg));
-    r = avg + (s->mul * (a[i + 1] - avg));
-
-    a[i] = af_softclip(l);
-    a[i + 1] = af_softclip(r);
-  }
+  for (i = 0; i < len; i++)
+    a[i] = af_softclip(a[i]);
 }
 
 static int filter_frame(struct af_instance *af, struct mp_audio *data)
 {
     if (!data)
         return 0;
-    if (af_make_writeable(af, data) < 0) {
-        talloc_free(data);
-        return -1;
-    }
     if (data->format == AF_FORMAT_FLOAT) {
         play_float(af->priv, data);
     } else {
@@ -114,6 +110,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
 static int af_open(struct af_instance* af){
   af->control=control;
   af->filter_frame = filter_frame;
+  af->in_place = true;
 
   return AF_OK;
 }
@@ -31,10 +31,22 @@
 
 #include "af.h"
 #include "dsp.h"
+#include "fftconv.h"
 
 /* HRTF filter coefficients and adjustable parameters */
 #include "af_hrtf.h"
 
+/* Block size of the FFT convolution, which is also the added latency */
+#define CONVBLOCK 64
+
+/* Inputs of the convolution: the decoded channels, the bass compensation
+   signals, and the LFE channel */
+enum {
+    CONV_LF, CONV_RF, CONV_LR, CONV_RR, CONV_CF, CONV_CR,
+    CONV_BA_L, CONV_BA_R, CONV_LFE,
+    CONV_NUM_IN,
+};
+
 typedef struct af_hrtf_s {
     /* Lengths */
     int dlbuflen, hrflen, basslen;
@@ -69,30 +81,13 @@ typedef struct af_hrtf_s {
     float adapt_lrprr_gain, adapt_lrmrr_gain;
     /* Cyclic position on the ring buffer */
     int cyc_pos;
+    /* All FIR filters, mixed into the L, R output */
+    struct mp_fftconv *conv;
+    float *conv_in[CONV_NUM_IN], *conv_out[2];
     int print_flag;
     int mode;
 } af_hrtf_t;
 
-/* Convolution on a ring buffer
- *    nx:       length of the ring buffer
- *    nk:       length of the convolution kernel
- *    sx:       ring buffer
- *    sk:       convolution kernel
- *    offset:   offset on the ring buffer, can be
- */
-static float conv(const int nx, const int nk, const float *sx, const float *sk,
-                  const int offset)
-{
-    /* k = reminder of offset / nx */
-    int k = offset >= 0 ? offset % nx : nx + (offset % nx);
-
-    if(nk + k <= nx)
-        return af_filter_fir(nk, sx + k, sk);
-    else
-        return af_filter_fir(nk + k - nx, sx, sk + nx - k) +
-            af_filter_fir(nx - k, sx + k, sk);
-}
-
 /* Detect when the impulse response starts (significantly) */
 static int pulse_detect(const float *sx)
 {
@@ -288,6 +283,66 @@ static inline void update_ch(af_hrtf_t *s, short *in, const int k)
     }
 }
 
+/* Add a HRTF to the left ear, and the mirrored one to the right ear */
+static void add_hrtf(af_hrtf_t *s, int in_l, int in_r, const float *ir,
+                     int offset, float gain)
+{
+    mp_fftconv_add_ir(s->conv, in_l, 0, ir, s->hrflen, offset, gain);
+    mp_fftconv_add_ir(s->conv, in_r, 1, ir, s->hrflen, offset, gain);
+}
+
+/* Set up the convolution for the current mode (see the filter notation in
+   filter()) */
+static int setup_conv(af_hrtf_t *s, int nch)
+{
+    talloc_free(s->conv);
+    s->conv = mp_fftconv_create(s, CONVBLOCK, CONV_NUM_IN, 2,
+                                MPMAX(128, s->basslen));
+    if (!s->conv)
+        return -1;
+
+    add_hrtf(s, CONV_LF, CONV_RF, s->af_ir, s->af_o, 1);
+    add_hrtf(s, CONV_RF, CONV_LF, s->of_ir, s->of_o, 1);
+    if (s->decode_mode != HRTF_MIX_STEREO) {
+        /* In matrix decoding mode, the rear channel gain must be
+           renormalized, as there is an additional channel. */
+        float rear = s->matrix_mode ? M1_76DB : 1;
+        add_hrtf(s, CONV_LR, CONV_RR, s->ar_ir, s->ar_o, rear);
+        add_hrtf(s, CONV_RR, CONV_LR, s->or_ir, s->or_o, rear);
+        add_hrtf(s, CONV_CF, CONV_CF, s->cf_ir, s->cf_o, 1);
+        if (s->matrix_mode)
+            add_hrtf(s, CONV_CR, CONV_CR, s->cr_ir, s->cr_o, M1_76DB);
+    }
+
+    /* Bass compensation for the lower frequency cut of the HRTF.  A
+       cross talk of the left and right channel is introduced to
+       match the directional characteristics of higher frequencies.
+       The bass will not have any real 3D perception, but that is
+       OK (note at 180 Hz, the wavelength is about 2 m, and any
+       spatial perception is impossible). */
+    mp_fftconv_add_ir(s->conv, CONV_BA_L, 0, s->ba_ir, s->basslen, 0,
+                      1 - BASSCROSS);
+    mp_fftconv_add_ir(s->conv, CONV_BA_R, 0, s->ba_ir, s->basslen, 0,
+                      BASSCROSS);
+    mp_fftconv_add_ir(s->conv, CONV_BA_R, 1, s->ba_ir, s->basslen, 0,
+                      1 - BASSCROSS);
+    mp_fftconv_add_ir(s->conv, CONV_BA_L, 1, s->ba_ir, s->basslen, 0,
+                      BASSCROSS);
+
+    /* Also mix the LFE channel (if available) */
+    if (nch >= 6) {
+        const float lfe = M3_01DB;
+        mp_fftconv_add_ir(s->conv, CONV_LFE, 0, &lfe, 1, 0, 1);
+        mp_fftconv_add_ir(s->conv, CONV_LFE, 1, &lfe, 1, 0, 1);
+    }
+
+    for (int n = 0; n < CONV_NUM_IN; n++)
+        s->conv_in[n] = talloc_zero_array(s->conv, float, CONVBLOCK);
+    for (int n = 0; n < 2; n++)
+        s->conv_out[n] = talloc_zero_array(s->conv, float, CONVBLOCK);
+    return 0;
+}
+
 static void clear_coeff(af_hrtf_t *s, float *c)
 {
     memset(c, 0, s->dlbuflen * sizeof(float));
@@ -307,6 +362,8 @@ static void reset(af_hrtf_t *s)
     clear_coeff(s, s->fwrbuf_r);
     clear_coeff(s, s->fwrbuf_lr);
     clear_coeff(s, s->fwrbuf_rr);
+    if (s->conv)
+        mp_fftconv_reset(s->conv);
 }
 
 /* Initialization and runtime control */
@@ -331,6 +388,11 @@ static int control(struct af_instance *af, int cmd, void* arg)
         }
         mp_audio_set_format(af->data, AF_FORMAT_S16);
         test_output_res = af_test_output(af, (struct mp_audio*)arg);
+        if (setup_conv(s, af->data->nch) < 0) {
+            MP_ERR(af, "Unable to set up the convolution.\n");
+            return AF_ERROR;
+        }
+        af->delay = CONVBLOCK / (double)af->data->rate;
         // after testing input set the real output format
         mp_audio_set_num_channels(af->data, 2);
         s->print_flag = 1;
@@ -391,8 +453,8 @@ static int filter(struct af_instance *af, struct mp_audio *data)
     short *in = data->planes[0]; // Input audio data
     short *out = outframe->planes[0]; // Output audio data
     short *end = in + data->samples * data->nch; // Loop end
-    float common, left, right, diff, left_b, right_b;
-    const int dblen = s->dlbuflen, hlen = s->hrflen, blen = s->basslen;
+    float left, right, diff;
+    const int dblen = s->dlbuflen;
 
     if(s->print_flag) {
         s->print_flag = 0;
@@ -439,125 +501,79 @@ static int filter(struct af_instance *af, struct mp_audio *data)
      */
 
     while(in < end) {
-        const int k = s->cyc_pos;
-
-        update_ch(s, in, k);
-
-        /* Simulate a 7.5 ms -20 dB echo of the center channel in the
-           front channels (like reflection from a room wall) - a kind of
-           psycho-acoustically "cheating" to focus the center front
-           channel, which is normally hard to be perceived as front */
-        s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
-        s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
-
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_MATRIX2CH:
-           /* Mixer filter matrix */
-           common = conv(dblen, hlen, s->cf, s->cf_ir, k + s->cf_o);
-           if(s->matrix_mode) {
-              /* In matrix decoding mode, the rear channel gain must be
-                 renormalized, as there is an additional channel. */
-              matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
-                            s->lr_fwr, s->rr_fwr,
-                            s->lrprr_fwr, s->lrmrr_fwr,
-                            &(s->adapt_lr_gain), &(s->adapt_rr_gain),
-                            &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
-                            s->lr, s->rr, NULL, NULL, s->cr);
-              common +=
-                 conv(dblen, hlen, s->cr, s->cr_ir, k + s->cr_o) *
-                 M1_76DB;
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-           } else {
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o) +
-                   common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o) +
-                   common);
-           }
-           break;
-        case HRTF_MIX_STEREO:
-           left    =
-              ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o));
-           right   =
-              ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o));
-           break;
-        default:
-            /* make gcc happy */
-            left = 0.0;
-            right = 0.0;
-            break;
-        }
+        /* Decode a block of samples, and collect the channels to be
+           filtered */
+        int num = MPMIN((end - in) / data->nch, CONVBLOCK);
+        for(int n = 0; n < num; n++) {
+            const int k = s->cyc_pos;
+
+            update_ch(s, in, k);
+
+            /* Simulate a 7.5 ms -20 dB echo of the center channel in the
+               front channels (like reflection from a room wall) - a kind of
+               psycho-acoustically "cheating" to focus the center front
+               channel, which is normally hard to be perceived as front */
+            s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
+            s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
+
+            if(s->decode_mode != HRTF_MIX_STEREO && s->matrix_mode) {
+                matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
+                              s->lr_fwr, s->rr_fwr,
+                              s->lrprr_fwr, s->lrmrr_fwr,
+                              &(s->adapt_lr_gain), &(s->adapt_rr_gain),
+                              &(s->adapt_lrprr_gain),
+                              &(s->adapt_lrmrr_gain),
+                              s->lr, s->rr, NULL, NULL, s->cr);
+            }
 
-        /* Bass compensation for the lower frequency cut of the HRTF.  A
-           cross talk of the left and right channel is introduced to
-           match the directional characteristics of higher frequencies.
-           The bass will not have any real 3D perception, but that is
-           OK (note at 180 Hz, the wavelength is about 2 m, and any
-           spatial perception is impossible). */
-        left_b  = conv(dblen, blen, s->ba_l, s->ba_ir, k);
-        right_b = conv(dblen, blen, s->ba_r, s->ba_ir, k);
-        left  += (1 - BASSCROSS) * left_b  + BASSCROSS * right_b;
-        right += (1 - BASSCROSS) * right_b + BASSCROSS * left_b;
-        /* Also mix the LFE channel (if available) */
-        if(data->nch >= 6) {
-            left  += in[5] * M3_01DB;
-            right += in[5] * M3_01DB;
+            s->conv_in[CONV_LF][n] = s->lf[k];
+            s->conv_in[CONV_RF][n] = s->rf[k];
+            s->conv_in[CONV_LR][n] = s->lr[k];
+            s->conv_in[CONV_RR][n] = s->rr[k];
+            s->conv_in[CONV_CF][n] = s->cf[k];
+            s->conv_in[CONV_CR][n] = s->cr[k];
+            s->conv_in[CONV_BA_L][n] = s->ba_l[k];
+            s->conv_in[CONV_BA_R][n] = s->ba_r[k];
+            s->conv_in[CONV_LFE][n] = data->nch >= 6 ? in[5] : 0;
+
+            /* Next sample... */
+            in = &in[data->nch];
+            (s->cyc_pos)--;
+            if(s->cyc_pos < 0)
+                s->cyc_pos += dblen;
         }
 
-        /* Amplitude renormalization. */
-        left  *= AMPLNORM;
-        right *= AMPLNORM;
-
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_STEREO:
-           /* "Cheating": linear stereo expansion to amplify the 3D
-              perception.  Note: Too much will destroy the acoustic space
-              and may even result in headaches. */
-           diff = STEXPAND2 * (left - right);
-           out[0] = av_clip_int16(left  + diff);
-           out[1] = av_clip_int16(right - diff);
-           break;
-        case HRTF_MIX_MATRIX2CH:
-           /* Do attempt any stereo expansion with matrix encoded
-              sources.  The L, R channels are already stereo expanded
-              by the steering, any further stereo expansion will sound
-              very unnatural. */
-           out[0] = av_clip_int16(left);
-           out[1] = av_clip_int16(right);
-           break;
+        mp_fftconv_process(s->conv, s->conv_in, s->conv_out, num);
+
+        for(int n = 0; n < num; n++) {
+            /* Amplitude renormalization. */
+            left  = s->conv_out[0][n] * AMPLNORM;
+            right = s->conv_out[1][n] * AMPLNORM;
+
+            switch (s->decode_mode) {
+            case HRTF_MIX_51:
+            case HRTF_MIX_STEREO:
+               /* "Cheating": linear stereo expansion to amplify the 3D
+                  perception.  Note: Too much will destroy the acoustic
+                  space and may even result in headaches. */
+               diff = STEXPAND2 * (left - right);
+               out[0] = av_clip_int16(left  + diff);
+               out[1] = av_clip_int16(right - diff);
+               break;
+            case HRTF_MIX_MATRIX2CH:
+               /* Do attempt any stereo expansion with matrix encoded
+                  sources.  The L, R channels are already stereo expanded
+                  by the steering, any further stereo expansion will sound
+                  very unnatural. */
+               out[0] = av_clip_int16(left);
+               out[1] = av_clip_int16(right);
+               break;
+            }
+            out = &out[af->data->nch];
         }
-
-        /* Next sample... */
-        in = &in[data->nch];
-        out = &out[af->data->nch];
-        (s->cyc_pos)--;
-        if(s->cyc_pos < 0)
-            s->cyc_pos += dblen;
     }
 
-    talloc_free(data);
+    mp_audio_pool_release(af->out_pool, data);
     af_add_output_frame(af, outframe);
     return 0;
 }
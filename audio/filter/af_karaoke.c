@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include "af.h"
+#include "dsp.h"
 
 // Data for specific instances of this filter
 
@@ -44,15 +45,8 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
 {
         if (!c)
                 return 0;
-        if (af_make_writeable(af, c) < 0) {
-                talloc_free(c);
-                return 0;
-        }
-
         float*          a       = c->planes[0];  // Audio data
         int                     nch     = c->nch;        // Number of channels
-        int                     len     = c->samples*nch;        // Number of samples in current audio block
-        register int  i;
 
         /*
                 FIXME1 add a low band pass filter to avoid suppressing
@@ -60,11 +54,12 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
                 FIXME2 better calculated* attenuation factor
         */
 
-        for(i=0;i<len;i+=nch)
-        {
-                a[i] = (a[i] - a[i+1]) * 0.7;
-                a[i+1]=a[i];
-        }
+        float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS] = {{0}};
+        for(int i=2;i<nch;i++)
+                matrix[i][i] = 1;
+        matrix[0][0] = matrix[1][0] = 0.7;
+        matrix[0][1] = matrix[1][1] = -0.7;
+        af_dsp_mix_float(a, nch, a, nch, matrix, c->samples);
 
         af_add_output_frame(af, c);
         return 0;
@@ -74,6 +69,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
 static int af_open(struct af_instance* af){
         af->control     = control;
         af->filter_frame = filter_frame;
+        af->in_place = true;
         return AF_OK;
 }
 
@@ -580,11 +580,6 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
         talloc_free(data);
         return -1;
     }
-    if (af_make_writeable(af, data) < 0) {
-        talloc_free(data);
-        return -1;
-    }
-
     /* See if it's the first call. If so, setup inbufs/outbufs, instantiate
      * plugin, connect ports and activate plugin
      */
@@ -747,6 +742,7 @@ static int af_open(struct af_instance *af) {
     af->control=control;
     af->uninit=uninit;
     af->filter_frame = filter_frame;
+    af->in_place = true;
 
     af_ladspa_t *setup = af->priv;
 
@@ -263,7 +263,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
         goto error;
 
     av_frame_free(&frame);
-    talloc_free(data);
+    mp_audio_pool_release(af->out_pool, data);
     return 0;
 error:
     av_frame_free(&frame);
@@ -216,6 +216,7 @@ static int configure_lavrr(struct af_instance *af, struct mp_audio *in,
     s->ctx.out_rate    = out->rate;
     s->ctx.in_rate_af  = in->rate;
     s->ctx.in_rate     = rate_from_speed(in->rate, s->playback_speed);
+    af->max_out_ratio  = s->ctx.out_rate / (double)s->ctx.in_rate;
     s->ctx.out_format  = out->format;
     s->ctx.in_format   = in->format;
     s->ctx.out_channels= out->channels;
@@ -496,7 +497,7 @@ static int filter(struct af_instance *af, struct mp_audio *in)
 
     extra_output_conversion(af, out);
 
-    talloc_free(in);
+    mp_audio_pool_release(af->out_pool, in);
     if (out->samples) {
         af_add_output_frame(af, out);
     } else {
@@ -26,6 +26,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 // Data for specific instances of this filter
 typedef struct af_pan_s
@@ -118,29 +119,12 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
   mp_audio_copy_attributes(l, c);
 
   af_pan_t*     s    = af->priv;        // Setup for this instance
-  float*        in   = c->planes[0];    // Input audio data
-  float*        out  = NULL;            // Output audio data
-  float*        end  = in+c->samples*c->nch;    // End of loop
-  int           nchi = c->nch;          // Number of input channels
-  int           ncho = l->nch;          // Number of output channels
-  register int  j,k;
-
-  out = l->planes[0];
+
   // Execute panning
-  // FIXME: Too slow
-  while(in < end){
-    for(j=0;j<ncho;j++){
-      register float  x   = 0.0;
-      register float* tin = in;
-      for(k=0;k<nchi;k++)
-        x += tin[k] * s->level[j][k];
-      out[j] = x;
-    }
-    out+= ncho;
-    in+= nchi;
-  }
+  af_dsp_mix_float(l->planes[0], l->nch, c->planes[0], c->nch, s->level,
+                   c->samples);
 
-  talloc_free(c);
+  mp_audio_pool_release(af->out_pool, c);
   af_add_output_frame(af, l);
   return 0;
 }
@@ -42,6 +42,7 @@ static void update_speed(struct af_instance *af, double new_speed)
 
     p->speed = new_speed;
     rubberband_set_time_ratio(p->rubber, 1.0 / p->speed);
+    af->max_out_ratio = 1.0 / p->speed;
 }
 
 static int control(struct af_instance *af, int cmd, void *arg)
@@ -33,12 +33,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <float.h>
 #include <assert.h>
 
 #include "common/common.h"
 
 #include "af.h"
 #include "options/m_option.h"
+#include "xcorr.h"
 
 // Data for specific instances of this filter
 typedef struct af_scaletempo_s
@@ -70,6 +72,7 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    struct mp_xcorr *xcorr;
     // command line
     float scale_nominal;
     float ms_stride;
@@ -78,6 +81,10 @@ typedef struct af_scaletempo_s
 #define SCALE_TEMPO 1
 #define SCALE_PITCH 2
     int speed_opt;
+#define SEARCH_AUTO 0
+#define SEARCH_DIRECT 1
+#define SEARCH_FFT 2
+    int search_method;
 } af_scaletempo_t;
 
 static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
@@ -183,6 +190,54 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
     return best_off * 2 * s->num_channels;
 }
 
+// Same as above, but compute the correlation for all offsets at once with
+// FFTs. Much faster with long overlaps and search windows.
+static int best_overlap_fft(af_scaletempo_t *s)
+{
+    const float *corr = mp_xcorr_run(s->xcorr);
+    float best_corr = -FLT_MAX;
+    int best_off = 0;
+    for (int off = 0; off < s->frames_search; off++) {
+        if (corr[off * s->num_channels] > best_corr) {
+            best_corr = corr[off * s->num_channels];
+            best_off  = off;
+        }
+    }
+    return best_off;
+}
+
+static int best_overlap_offset_float_fft(af_scaletempo_t *s)
+{
+    int len = s->samples_overlap - s->num_channels;
+    float *pw  = s->table_window;
+    float *po  = (float *)s->buf_overlap + s->num_channels;
+    float *ppc = mp_xcorr_get_a(s->xcorr);
+    for (int i = 0; i < len; i++)
+        ppc[i] = pw[i] * po[i];
+
+    memcpy(mp_xcorr_get_b(s->xcorr), (float *)s->buf_queue + s->num_channels,
+           (len + (s->frames_search - 1) * s->num_channels) * sizeof(float));
+
+    return best_overlap_fft(s) * 4 * s->num_channels;
+}
+
+static int best_overlap_offset_s16_fft(af_scaletempo_t *s)
+{
+    int len = s->samples_overlap - s->num_channels;
+    int32_t *pw = s->table_window;
+    int16_t *po = (int16_t *)s->buf_overlap + s->num_channels;
+    float *ppc  = mp_xcorr_get_a(s->xcorr);
+    for (int i = 0; i < len; i++)
+        ppc[i] = (pw[i] * po[i]) >> 15;
+
+    int16_t *ps = (int16_t *)s->buf_queue + s->num_channels;
+    float *pb   = mp_xcorr_get_b(s->xcorr);
+    for (int i = 0; i < len + (s->frames_search - 1) * s->num_channels; i++)
+        pb[i] = ps[i];
+
+    return best_overlap_fft(s) * 2 * s->num_channels;
+}
+
 static void output_overlap_float(af_scaletempo_t *s, void *buf_out,
                                  int bytes_off)
 {
@@ -266,7 +321,7 @@ static int filter(struct af_instance *af, struct mp_audio *data)
                 / out->sstride / out->rate;
 
     out->samples = (pout - (int8_t *)out->planes[0]) / out->sstride;
-    talloc_free(data);
+    mp_audio_pool_release(af->out_pool, data);
     if (out->samples) {
         af_add_output_frame(af, out);
     } else {
@@ -283,6 +338,7 @@ static void update_speed(struct af_instance *af, float speed)
 
     double factor = (s->speed_opt & SCALE_PITCH) ? 1.0 / s->speed : s->speed;
     s->scale = factor * s->scale_nominal;
+    af->max_out_ratio = 1.0 / s->scale;
 
     s->frames_stride_scaled = s->scale * s->frames_stride;
     s->frames_stride_error = MPMIN(s->frames_stride_error, s->frames_stride_scaled);
@@ -357,6 +413,8 @@ static int control(struct af_instance *af, int cmd, void *arg)
             }
         }
 
+        talloc_free(s->xcorr);
+        s->xcorr = NULL;
         s->frames_search = (frames_overlap > 1) ? srate * s->ms_search : 0;
         if (s->frames_search <= 0)
             s->best_overlap_offset = NULL;
@@ -397,6 +455,22 @@ static int control(struct af_instance *af, int cmd, void *arg)
                 }
                 s->best_overlap_offset = best_overlap_offset_float;
             }
+
+            // The direct search needs frames_search * len multiply-adds.
+            int len = s->samples_overlap - nch;
+            int len_b = len + (s->frames_search - 1) * nch;
+            bool use_fft = s->search_method == SEARCH_FFT ||
+                (s->search_method == SEARCH_AUTO &&
+                 mp_xcorr_cost(len, len_b) < (int64_t)s->frames_search * len);
+            if (use_fft)
+                s->xcorr = mp_xcorr_create(NULL, len, len_b);
+            if (s->xcorr) {
+                s->best_overlap_offset = use_int ? best_overlap_offset_s16_fft
+                                                 : best_overlap_offset_float_fft;
+            } else if (s->search_method == SEARCH_FFT) {
+                MP_WARN(af, "Search window too large for FFT, using direct "
+                        "search.\n");
+            }
         }
 
         s->bytes_per_frame = bps * nch;
@@ -415,14 +489,14 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         MP_DBG(af, ""
                "%.2f stride_in, %i stride_out, %i standing, "
-               "%i overlap, %i search, %i queue, %s mode\n",
+               "%i overlap, %i search, %i queue, %s mode, %s search\n",
                s->frames_stride_scaled,
                (int)(s->bytes_stride / nch / bps),
                (int)(s->bytes_standing / nch / bps),
                (int)(s->bytes_overlap / nch / bps),
                s->frames_search,
                (int)(s->bytes_queue / nch / bps),
-               (use_int ? "s16" : "float"));
+               (use_int ? "s16" : "float"), (s->xcorr ? "fft" : "direct"));
 
         return af_test_output(af, (struct mp_audio *)arg);
     }
@@ -456,6 +530,7 @@ static void uninit(struct af_instance *af)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    talloc_free(s->xcorr);
 }
 
 // Allocate memory and set function pointers
@@ -492,6 +567,10 @@ const struct af_info af_info_scaletempo = {
                     {"tempo", SCALE_TEMPO},
                     {"none", 0},
                     {"both", SCALE_TEMPO | SCALE_PITCH})),
+        OPT_CHOICE("search-method", search_method, 0,
+                   ({"auto", SEARCH_AUTO},
+                    {"direct", SEARCH_DIRECT},
+                    {"fft", SEARCH_FFT})),
         {0}
     },
 };
@@ -62,21 +62,19 @@ static int play_s16(struct af_instance *af, struct mp_audio *data)
 {
   if (!data)
     return 0;
-  if (af_make_writeable(af, data) < 0) {
-    talloc_free(data);
-    return -1;
-  }
-
   af_sinesuppress_t *s = af->priv;
   register int i = 0;
   int16_t *a = (int16_t*)data->planes[0];       // Audio data
   int len = data->samples*data->nch;            // Number of samples
 
+  // Advance the oscillator by rotating it, instead of calling cos() and sin()
+  // for every sample. It's resynchronized with s->pos on every call.
+  double step = 2 * M_PI * s->freq / data->rate;
+  double rot_co = cos(step), rot_si = sin(step);
+  double co = cos(s->pos), si = sin(s->pos);
+
   for (i = 0; i < len; i++)
   {
-    double co= cos(s->pos);
-    double si= sin(s->pos);
-
     s->real += co * a[i];
     s->imag += si * a[i];
     s->ref  += co * co;
@@ -87,8 +85,11 @@ static int play_s16(struct af_instance *af, struct mp_audio *data)
     s->imag -= s->imag * s->decay;
     s->ref  -= s->ref  * s->decay;
 
-    s->pos += 2 * M_PI * s->freq / data->rate;
+    double next_co = co * rot_co - si * rot_si;
+    si = si * rot_co + co * rot_si;
+    co = next_co;
   }
+  s->pos = fmod(s->pos + len * step, 2 * M_PI);
 
    MP_VERBOSE(af, "f:%8.2f: amp:%8.2f\n", s->freq, sqrt(s->real*s->real + s->imag*s->imag) / s->ref);
 
@@ -100,6 +101,7 @@ static int play_s16(struct af_instance *af, struct mp_audio *data)
 static int af_open(struct af_instance* af){
   af->control=control;
   af->filter_frame = play_s16;
+  af->in_place = true;
   return AF_OK;
 }
 
@@ -101,11 +101,6 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
 {
   if (!data)
     return 0;
-  if (af_make_writeable(af, data) < 0) {
-    talloc_free(data);
-    return -1;
-  }
-
   struct mp_audio*    c   = data;        // Current working data
   af_sub_t*     s   = af->priv; // Setup for this instance
   float*        a   = c->planes[0];      // Audio data
@@ -130,6 +125,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
 static int af_open(struct af_instance* af){
   af->control=control;
   af->filter_frame = filter_frame;
+  af->in_place = true;
   return AF_OK;
 }
 
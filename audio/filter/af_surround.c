@@ -40,48 +40,30 @@
 
 #include "af.h"
 #include "dsp.h"
+#include "fftconv.h"
 
 #define L  32    // Length of fir filter
-#define LD 65536 // Length of delay buffer
-
-// 32 Tap fir filter loop unrolled
-#define FIR(x,w,y) \
-  y = ( w[0] *x[0] +w[1] *x[1] +w[2] *x[2] +w[3] *x[3]  \
-      + w[4] *x[4] +w[5] *x[5] +w[6] *x[6] +w[7] *x[7]  \
-      + w[8] *x[8] +w[9] *x[9] +w[10]*x[10]+w[11]*x[11] \
-      + w[12]*x[12]+w[13]*x[13]+w[14]*x[14]+w[15]*x[15] \
-      + w[16]*x[16]+w[17]*x[17]+w[18]*x[18]+w[19]*x[19] \
-      + w[20]*x[20]+w[21]*x[21]+w[22]*x[22]+w[23]*x[23] \
-      + w[24]*x[24]+w[25]*x[25]+w[26]*x[26]+w[27]*x[27] \
-      + w[28]*x[28]+w[29]*x[29]+w[30]*x[30]+w[31]*x[31])
-
-// Add to circular queue macro + update index
+
+// The low-pass filter and the delay of the rear channels are done with one
+// FFT convolution. It adds a delay of one block, which is subtracted from the
+// wanted delay. Delays shorter than the minimum block size are rounded up.
+#define MIN_BLOCK 8
+#define MAX_BLOCK 256
+
 #ifdef SPLITREAR
-#define ADDQUE(qi,rq,lq,r,l)\
-  lq[qi]=lq[qi+L]=(l);\
-  rq[qi]=rq[qi+L]=(r);\
-  qi=(qi-1)&(L-1);
+#define NREAR 2
 #else
-#define ADDQUE(qi,lq,l)\
-  lq[qi]=lq[qi+L]=(l);\
-  qi=(qi-1)&(L-1);
+#define NREAR 1
 #endif
 
-// Macro for updating queue index in delay queues
-#define UPDATEQI(qi) qi=(qi+1)&(LD-1)
-
 // instance data
 typedef struct af_surround_s
 {
-  float lq[2*L]; // Circular queue for filtering left rear channel
-  float rq[2*L]; // Circular queue for filtering right rear channel
   float w[L];    // FIR filter coefficients for surround sound 7kHz low-pass
-  float* dr;     // Delay queue right rear channel
-  float* dl;     // Delay queue left rear channel
   float  d;      // Delay time
-  int i;         // Position in circular buffer
-  int wi;        // Write index for delay queue
-  int ri;        // Read index for delay queue
+  struct mp_fftconv *conv;  // Low-pass filter and delay for the rear channels
+  float *rear_in[NREAR], *rear_out[NREAR];
+  int block;     // Block size of conv
 }af_surround_t;
 
 // Initialization and runtime control
@@ -92,6 +74,7 @@ static int control(struct af_instance* af, int cmd, void* arg)
   case AF_CONTROL_REINIT:{
     struct mp_audio *in = arg;
     float fc;
+    int delay;
     if (!mp_chmap_is_stereo(&in->channels)) {
         MP_ERR(af, "Only stereo input is supported.\n");
         return AF_DETACH;
@@ -108,23 +91,33 @@ static int control(struct af_instance* af, int cmd, void* arg)
       return AF_ERROR;
     }
 
-    // Free previous delay queues
-    free(s->dl);
-    free(s->dr);
-    // Allocate new delay queues
-    s->dl = calloc(LD,af->data->bps);
-    s->dr = calloc(LD,af->data->bps);
-    if((NULL == s->dl) || (NULL == s->dr))
-      MP_FATAL(af, "Out of memory\n");
-
-    // Initialize delay queue index
-    if(AF_OK != af_from_ms(1, &s->d, &s->wi, af->data->rate, 0.0, 1000.0))
+    // Delay in samples
+    if(AF_OK != af_from_ms(1, &s->d, &delay, af->data->rate, 0.0, 1000.0))
+      return AF_ERROR;
+
+    s->block = MAX_BLOCK;
+    while (s->block > MIN_BLOCK && s->block > delay)
+      s->block /= 2;
+    delay = MPMAX(delay - s->block, 0);
+
+    talloc_free(s->conv);
+    s->conv = mp_fftconv_create(s, s->block, NREAR, NREAR, delay + L);
+    if (!s->conv) {
+      MP_ERR(af, "Unable to set up the rear channel filter.\n");
       return AF_ERROR;
-//    printf("%i\n",s->wi);
-    s->ri = 0;
+    }
+    for (int n = 0; n < NREAR; n++) {
+      mp_fftconv_add_ir(s->conv, n, n, s->w, L, delay, 1);
+      s->rear_in[n] = talloc_zero_array(s->conv, float, s->block);
+      s->rear_out[n] = talloc_zero_array(s->conv, float, s->block);
+    }
 
     return AF_OK;
   }
+  case AF_CONTROL_RESET:
+    if (s->conv)
+      mp_fftconv_reset(s->conv);
+    return AF_OK;
   }
   return AF_UNKNOWN;
 }
@@ -157,70 +150,62 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
   float*         in  = data->planes[0];         // Input audio data
   float*         out = outframe->planes[0];     // Output audio data
   float*         end = in + data->samples * data->nch;
-  int            i   = s->i;    // Filter queue index
-  int            ri  = s->ri;   // Read index for delay queue
-  int            wi  = s->wi;   // Write index for delay queue
+  int            onch = af->data->nch;
 
   while(in < end){
-    /* Dominance:
-       abs(in[0])  abs(in[1]);
-       abs(in[0]+in[1])  abs(in[0]-in[1]);
-       10 * log( abs(in[0]) / (abs(in[1])|1) );
-       10 * log( abs(in[0]+in[1]) / (abs(in[0]-in[1])|1) ); */
-
-    /* About volume balancing...
-       Surround encoding does the following:
-           Lt=L+.707*C+.707*S, Rt=R+.707*C-.707*S
-       So S should be extracted as:
-           (Lt-Rt)
-       But we are splitting the S to two output channels, so we
-       must take 3dB off as we split it:
-           Ls=Rs=.707*(Lt-Rt)
-       Trouble is, Lt could be +1, Rt -1, so possibility that S will
-       overflow. So to avoid that, we cut L/R by 3dB (*.707), and S by
-       6dB (/2). This keeps the overall balance, but guarantees no
-       overflow. */
-
-    // Output front left and right
-    out[0] = m[0]*in[0] + m[1]*in[1];
-    out[1] = m[2]*in[0] + m[3]*in[1];
-
-    // Low-pass output @ 7kHz
-    FIR((&s->lq[i]), s->w, s->dl[wi]);
-
-    // Delay output by d ms
-    out[2] = s->dl[ri];
-
+    int num = MPMIN((end - in) / data->nch, s->block);
+    float *rear = out + 2;
+
+    for(int n = 0; n < num; n++){
+      /* Dominance:
+         abs(in[0])  abs(in[1]);
+         abs(in[0]+in[1])  abs(in[0]-in[1]);
+         10 * log( abs(in[0]) / (abs(in[1])|1) );
+         10 * log( abs(in[0]+in[1]) / (abs(in[0]-in[1])|1) ); */
+
+      /* About volume balancing...
+         Surround encoding does the following:
+             Lt=L+.707*C+.707*S, Rt=R+.707*C-.707*S
+         So S should be extracted as:
+             (Lt-Rt)
+         But we are splitting the S to two output channels, so we
+         must take 3dB off as we split it:
+             Ls=Rs=.707*(Lt-Rt)
+         Trouble is, Lt could be +1, Rt -1, so possibility that S will
+         overflow. So to avoid that, we cut L/R by 3dB (*.707), and S by
+         6dB (/2). This keeps the overall balance, but guarantees no
+         overflow. */
+
+      // Output front left and right
+      out[0] = m[0]*in[0] + m[1]*in[1];
+      out[1] = m[2]*in[0] + m[3]*in[1];
+
+      // Calculate surround, which is low-passed @ 7kHz and delayed by d ms
 #ifdef SPLITREAR
-    // Low-pass output @ 7kHz
-    FIR((&s->rq[i]), s->w, s->dr[wi]);
-
-    // Delay output by d ms
-    out[3] = s->dr[ri];
+      s->rear_in[0][n] = m[8]*in[0] + m[9]*in[1];
+      s->rear_in[1][n] = m[6]*in[0] + m[7]*in[1];
 #else
-    out[3] = -out[2];
+      s->rear_in[0][n] = m[4]*in[0] + m[5]*in[1];
 #endif
 
-    // Update delay queues indexes
-    UPDATEQI(ri);
-    UPDATEQI(wi);
+      // Next sample...
+      in = &in[data->nch];
+      out = &out[onch];
+    }
+
+    mp_fftconv_process(s->conv, s->rear_in, s->rear_out, num);
 
-    // Calculate and save surround in circular queue
+    for(int n = 0; n < num; n++){
+      rear[n * onch + 0] = s->rear_out[0][n];
 #ifdef SPLITREAR
-    ADDQUE(i, s->rq, s->lq, m[6]*in[0]+m[7]*in[1], m[8]*in[0]+m[9]*in[1]);
+      rear[n * onch + 1] = s->rear_out[1][n];
 #else
-    ADDQUE(i, s->lq, m[4]*in[0]+m[5]*in[1]);
+      rear[n * onch + 1] = -s->rear_out[0][n];
 #endif
-
-    // Next sample...
-    in = &in[data->nch];
-    out = &out[af->data->nch];
+    }
   }
 
-  // Save indexes
-  s->i  = i; s->ri = ri; s->wi = wi;
-
-  talloc_free(data);
+  mp_audio_pool_release(af->out_pool, data);
   af_add_output_frame(af, outframe);
   return 0;
 }
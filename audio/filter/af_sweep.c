@@ -51,11 +51,6 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
 {
   if (!data)
     return 0;
-  if (af_make_writeable(af, data) < 0) {
-      talloc_free(data);
-    return 0;
-  }
-
   af_sweept *s = af->priv;
   int i, j;
   int16_t *in = (int16_t*)data->planes[0];
@@ -76,6 +71,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
 static int af_open(struct af_instance* af){
   af->control=control;
   af->filter_frame = filter_frame;
+  af->in_place = true;
   return AF_OK;
 }
 
@@ -27,6 +27,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 #include "demux/demux.h"
 
 struct priv {
@@ -43,6 +44,14 @@ struct priv {
     float cfg_volume;
 };
 
+// Frames are only written to if the gain is not neutral, so pass them
+// through without making them writeable otherwise.
+static void update_in_place(struct af_instance *af)
+{
+    struct priv *s = af->priv;
+    af->in_place = s->level * s->rgain != 1.0;
+}
+
 static int control(struct af_instance *af, int cmd, void *arg)
 {
     struct priv *s = af->priv;
@@ -83,6 +92,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
                 MP_VERBOSE(af, "...with clipping prevention: %f\n", s->rgain);
             }
         }
+        update_in_place(af);
         if (s->detach && fabs(s->level * s->rgain - 1.0) < 0.00001)
             return AF_DETACH;
         return af_test_output(af, in);
@@ -91,6 +101,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
         s->vol = *(float *)arg;
         s->level = pow(s->vol, 3);
         MP_VERBOSE(af, "volume gain: %f\n", s->level);
+        update_in_place(af);
         return AF_OK;
     case AF_CONTROL_GET_VOLUME:
         *(float *)arg = s->vol;
@@ -109,23 +120,17 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
     if (af_fmt_from_planar(af->data->format) == AF_FORMAT_S16) {
         int vol = 256.0 * level;
         if (vol != 256) {
-            if (af_make_writeable(af, data) < 0)
-                return; // oom
-            int16_t *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
-            }
+            af_dsp_get()->scale_s16(data->planes[p], num_samples, vol);
         }
     } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
         float vol = level;
         if (vol != 1.0) {
-            if (af_make_writeable(af, data) < 0)
-                return; // oom
             float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            if (s->soft) {
+                for (int i = 0; i < num_samples; i++)
+                    a[i] = af_softclip(a[i] * vol);
+            } else {
+                af_dsp_get()->scale_float(a, num_samples, vol);
             }
         }
     }
@@ -0,0 +1,931 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "dsp.h"
+
+// Vector versions are compiled with function level target attributes, so
+// that they don't depend on the compiler flags, and are only used if the CPU
+// supports them.
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define DSP_X86 1
+#include <immintrin.h>
+#else
+#define DSP_X86 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_NEON 1
+#include <arm_neon.h>
+#else
+#define DSP_NEON 0
+#endif
+
+static void scale_float_c(float *a, int num, float gain)
+{
+    for (int i = 0; i < num; i++)
+        a[i] = MPCLAMP(a[i] * gain, -1.0f, 1.0f);
+}
+
+static void scale_s16_c(int16_t *a, int num, int vol)
+{
+    for (int i = 0; i < num; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+    }
+}
+
+static void mul_float_c(float *dst, const float *src, float gain, int num)
+{
+    for (int i = 0; i < num; i++)
+        dst[i] = src[i] * gain;
+}
+
+static void mul_add_float_c(float *dst, const float *src, float gain, int num)
+{
+    for (int i = 0; i < num; i++)
+        dst[i] += src[i] * gain;
+}
+
+static void deinterleave_float_c(float **dst, const float *src, int nch,
+                                 int num)
+{
+    for (int c = 0; c < nch; c++) {
+        float *d = dst[c];
+        for (int i = 0; i < num; i++)
+            d[i] = src[i * nch + c];
+    }
+}
+
+static void interleave_float_c(float *dst, float *const *src, int nch, int num)
+{
+    for (int c = 0; c < nch; c++) {
+        const float *s = src[c];
+        for (int i = 0; i < num; i++)
+            dst[i * nch + c] = s[i];
+    }
+}
+
+static void biquad_cascade_c(float *data, int nch, int num,
+                             struct af_biquad_lanes *sections,
+                             int num_sections)
+{
+    for (int ch = 0; ch < nch; ch++) {
+        for (int n = 0; n < num; n++) {
+            float x = data[n * nch + ch];
+            for (int k = 0; k < num_sections; k++) {
+                float (*c)[MP_NUM_CHANNELS] = sections[k].coef;
+                float *w = &sections[k].w[0][ch], *w2 = &sections[k].w[1][ch];
+                float w1 = *w, wn;
+                wn = c[AF_BQ_B0][ch] * x + c[AF_BQ_A1][ch] * w1 +
+                     c[AF_BQ_A2][ch] * *w2;
+                x = c[AF_BQ_D][ch] * x + c[AF_BQ_C0][ch] * wn +
+                    c[AF_BQ_C1][ch] * w1 + c[AF_BQ_C2][ch] * *w2;
+                *w2 = w1;
+                *w = wn;
+            }
+            data[n * nch + ch] = x;
+        }
+    }
+}
+
+static void cmul_add_c(float *acc, const float *a, const float *b, int num)
+{
+    for (int i = 0; i < num * 2; i += 2) {
+        acc[i]     += a[i] * b[i]     - a[i + 1] * b[i + 1];
+        acc[i + 1] += a[i] * b[i + 1] + a[i + 1] * b[i];
+    }
+}
+
+#if DSP_X86 || DSP_NEON
+
+// The SIMD biquad kernels run each section over a block of frames, so that
+// coefficients and state stay in registers. The block holds channels
+// [first, first + lanes) of each frame, padded with zeros to width lanes.
+#define BQ_BLOCK 64
+
+static void bq_gather(float *block, const float *data, int nch, int first,
+                      int lanes, int width, int num)
+{
+    for (int n = 0; n < num; n++) {
+        for (int l = 0; l < width; l++)
+            block[n * width + l] = l < lanes ? data[n * nch + first + l] : 0;
+    }
+}
+
+static void bq_scatter(float *data, const float *block, int nch, int first,
+                       int lanes, int width, int num)
+{
+    for (int n = 0; n < num; n++) {
+        for (int l = 0; l < lanes; l++)
+            data[n * nch + first + l] = block[n * width + l];
+    }
+}
+
+#endif
+
+#if DSP_X86
+
+__attribute__((target("sse2")))
+static void scale_float_sse2(float *a, int num, float gain)
+{
+    __m128 g = _mm_set1_ps(gain), lo = _mm_set1_ps(-1.0f),
+           hi = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), g);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+    scale_float_c(a + i, num - i, gain);
+}
+
+// Computes the full 32 bit products from the low and high halves, so the
+// result is exactly the same as with scale_s16_c(). Requires vol <= INT16_MAX.
+__attribute__((target("sse2")))
+static void scale_s16_sse2(int16_t *a, int num, int vol)
+{
+    if (vol > INT16_MAX) {
+        scale_s16_c(a, num, vol);
+        return;
+    }
+    __m128i v = _mm_set1_epi16(vol);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m128i x = _mm_loadu_si128((__m128i *)(a + i));
+        __m128i pl = _mm_mullo_epi16(x, v), ph = _mm_mulhi_epi16(x, v);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(pl, ph), 8);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(pl, ph), 8);
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+    }
+    scale_s16_c(a + i, num - i, vol);
+}
+
+__attribute__((target("avx")))
+static void scale_float_avx(float *a, int num, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain), lo = _mm256_set1_ps(-1.0f),
+           hi = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), g);
+        _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(x, lo), hi));
+    }
+    scale_float_c(a + i, num - i, gain);
+}
+
+// Same as the SSE2 version; unpack and pack work per 128 bit lane, so the
+// sample order is preserved.
+__attribute__((target("avx2")))
+static void scale_s16_avx2(int16_t *a, int num, int vol)
+{
+    if (vol > INT16_MAX) {
+        scale_s16_c(a, num, vol);
+        return;
+    }
+    __m256i v = _mm256_set1_epi16(vol);
+    int i = 0;
+    for (; i + 16 <= num; i += 16) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(a + i));
+        __m256i pl = _mm256_mullo_epi16(x, v), ph = _mm256_mulhi_epi16(x, v);
+        __m256i p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(pl, ph), 8);
+        __m256i p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(pl, ph), 8);
+        _mm256_storeu_si256((__m256i *)(a + i), _mm256_packs_epi32(p0, p1));
+    }
+    scale_s16_c(a + i, num - i, vol);
+}
+
+__attribute__((target("sse2")))
+static void mul_float_sse2(float *dst, const float *src, float gain, int num)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= num; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+    mul_float_c(dst + i, src + i, gain, num - i);
+}
+
+__attribute__((target("sse2")))
+static void mul_add_float_sse2(float *dst, const float *src, float gain,
+                               int num)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), x));
+    }
+    mul_add_float_c(dst + i, src + i, gain, num - i);
+}
+
+// Stereo uses shuffles; a multiple of 4 channels uses 4x4 transposes of 4
+// frames. Other layouts use the C version.
+__attribute__((target("sse2")))
+static void deinterleave_float_sse2(float **dst, const float *src, int nch,
+                                    int num)
+{
+    int i = 0;
+    if (nch == 2) {
+        for (; i + 4 <= num; i += 4) {
+            __m128 a = _mm_loadu_ps(src + i * 2);
+            __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+            __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(dst[0] + i, l);
+            _mm_storeu_ps(dst[1] + i, r);
+        }
+    } else if (nch % 4 == 0) {
+        for (; i + 4 <= num; i += 4) {
+            for (int c = 0; c < nch; c += 4) {
+                const float *s = src + i * nch + c;
+                __m128 r0 = _mm_loadu_ps(s), r1 = _mm_loadu_ps(s + nch),
+                       r2 = _mm_loadu_ps(s + nch * 2),
+                       r3 = _mm_loadu_ps(s + nch * 3);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(dst[c + 0] + i, r0);
+                _mm_storeu_ps(dst[c + 1] + i, r1);
+                _mm_storeu_ps(dst[c + 2] + i, r2);
+                _mm_storeu_ps(dst[c + 3] + i, r3);
+            }
+        }
+    }
+    float *rest[MP_NUM_CHANNELS];
+    for (int c = 0; c < nch; c++)
+        rest[c] = dst[c] + i;
+    deinterleave_float_c(rest, src + i * nch, nch, num - i);
+}
+
+__attribute__((target("sse2")))
+static void interleave_float_sse2(float *dst, float *const *src, int nch,
+                                  int num)
+{
+    int i = 0;
+    if (nch == 2) {
+        for (; i + 4 <= num; i += 4) {
+            __m128 l = _mm_loadu_ps(src[0] + i), r = _mm_loadu_ps(src[1] + i);
+            _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+    } else if (nch % 4 == 0) {
+        for (; i + 4 <= num; i += 4) {
+            for (int c = 0; c < nch; c += 4) {
+                float *d = dst + i * nch + c;
+                __m128 r0 = _mm_loadu_ps(src[c + 0] + i),
+                       r1 = _mm_loadu_ps(src[c + 1] + i),
+                       r2 = _mm_loadu_ps(src[c + 2] + i),
+                       r3 = _mm_loadu_ps(src[c + 3] + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(d, r0);
+                _mm_storeu_ps(d + nch, r1);
+                _mm_storeu_ps(d + nch * 2, r2);
+                _mm_storeu_ps(d + nch * 3, r3);
+            }
+        }
+    }
+    float *rest[MP_NUM_CHANNELS];
+    for (int c = 0; c < nch; c++)
+        rest[c] = src[c] + i;
+    interleave_float_c(dst + i * nch, rest, nch, num - i);
+}
+
+__attribute__((target("avx")))
+static void mul_float_avx(float *dst, const float *src, float gain, int num)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= num; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+    mul_float_c(dst + i, src + i, gain, num - i);
+}
+
+__attribute__((target("avx")))
+static void mul_add_float_avx(float *dst, const float *src, float gain,
+                              int num)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), x));
+    }
+    mul_add_float_c(dst + i, src + i, gain, num - i);
+}
+
+#define COEF(name) _mm_loadu_ps(c[AF_BQ_##name] + v)
+
+// Channels are processed in groups of 4 lanes. Lanes past nch run on zeros,
+// and are never stored.
+__attribute__((target("sse2")))
+static void biquad_cascade_sse2(float *data, int nch, int num,
+                                struct af_biquad_lanes *sections,
+                                int num_sections)
+{
+    __m128 block[BQ_BLOCK];
+    for (int v = 0; v < nch; v += 4) {
+        int lanes = MPMIN(nch - v, 4);
+        for (int n0 = 0; n0 < num; n0 += BQ_BLOCK) {
+            int bn = MPMIN(num - n0, BQ_BLOCK);
+            float *p = data + n0 * nch;
+            bq_gather((float *)block, p, nch, v, lanes, 4, bn);
+            for (int k = 0; k < num_sections; k++) {
+                float (*c)[MP_NUM_CHANNELS] = sections[k].coef;
+                float *w = sections[k].w[0] + v, *w2 = sections[k].w[1] + v;
+                __m128 b0 = COEF(B0), a1 = COEF(A1), a2 = COEF(A2),
+                       d = COEF(D), c0 = COEF(C0), c1 = COEF(C1),
+                       c2 = COEF(C2);
+                __m128 w1v = _mm_loadu_ps(w), w2v = _mm_loadu_ps(w2);
+                for (int n = 0; n < bn; n++) {
+                    __m128 x = block[n];
+                    __m128 wn = _mm_mul_ps(b0, x);
+                    wn = _mm_add_ps(wn, _mm_mul_ps(a1, w1v));
+                    wn = _mm_add_ps(wn, _mm_mul_ps(a2, w2v));
+                    x = _mm_mul_ps(d, x);
+                    x = _mm_add_ps(x, _mm_mul_ps(c0, wn));
+                    x = _mm_add_ps(x, _mm_mul_ps(c1, w1v));
+                    x = _mm_add_ps(x, _mm_mul_ps(c2, w2v));
+                    block[n] = x;
+                    w2v = w1v;
+                    w1v = wn;
+                }
+                _mm_storeu_ps(w, w1v);
+                _mm_storeu_ps(w2, w2v);
+            }
+            bq_scatter(p, (float *)block, nch, v, lanes, 4, bn);
+        }
+    }
+}
+
+#undef COEF
+
+// SSE2 has no addsub, so the im * im products are negated with a sign mask.
+__attribute__((target("sse2")))
+static void cmul_add_sse2(float *acc, const float *a, const float *b, int num)
+{
+    const __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, INT_MIN, 0, INT_MIN));
+    int i = 0;
+    for (; i + 2 <= num; i += 2) {
+        __m128 va = _mm_loadu_ps(a + i * 2), vb = _mm_loadu_ps(b + i * 2);
+        __m128 re = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 im = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 sw = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 r = _mm_add_ps(_mm_mul_ps(re, vb),
+                              _mm_xor_ps(_mm_mul_ps(im, sw), sign));
+        _mm_storeu_ps(acc + i * 2, _mm_add_ps(_mm_loadu_ps(acc + i * 2), r));
+    }
+    cmul_add_c(acc + i * 2, a + i * 2, b + i * 2, num - i);
+}
+
+#define COEF(name) _mm256_loadu_ps(c[AF_BQ_##name])
+
+// All channels fit into one vector. With 4 channels or less, half of it
+// would be wasted, so use SSE2 then.
+__attribute__((target("avx")))
+static void biquad_cascade_avx(float *data, int nch, int num,
+                               struct af_biquad_lanes *sections,
+                               int num_sections)
+{
+    if (nch <= 4) {
+        biquad_cascade_sse2(data, nch, num, sections, num_sections);
+        return;
+    }
+    __m256 block[BQ_BLOCK];
+    for (int n0 = 0; n0 < num; n0 += BQ_BLOCK) {
+        int bn = MPMIN(num - n0, BQ_BLOCK);
+        float *p = data + n0 * nch;
+        bq_gather((float *)block, p, nch, 0, nch, 8, bn);
+        for (int k = 0; k < num_sections; k++) {
+            float (*c)[MP_NUM_CHANNELS] = sections[k].coef;
+            float *w = sections[k].w[0], *w2 = sections[k].w[1];
+            __m256 b0 = COEF(B0), a1 = COEF(A1), a2 = COEF(A2), d = COEF(D),
+                   c0 = COEF(C0), c1 = COEF(C1), c2 = COEF(C2);
+            __m256 w1v = _mm256_loadu_ps(w), w2v = _mm256_loadu_ps(w2);
+            for (int n = 0; n < bn; n++) {
+                __m256 x = block[n];
+                __m256 wn = _mm256_mul_ps(b0, x);
+                wn = _mm256_add_ps(wn, _mm256_mul_ps(a1, w1v));
+                wn = _mm256_add_ps(wn, _mm256_mul_ps(a2, w2v));
+                x = _mm256_mul_ps(d, x);
+                x = _mm256_add_ps(x, _mm256_mul_ps(c0, wn));
+                x = _mm256_add_ps(x, _mm256_mul_ps(c1, w1v));
+                x = _mm256_add_ps(x, _mm256_mul_ps(c2, w2v));
+                block[n] = x;
+                w2v = w1v;
+                w1v = wn;
+            }
+            _mm256_storeu_ps(w, w1v);
+            _mm256_storeu_ps(w2, w2v);
+        }
+        bq_scatter(p, (float *)block, nch, 0, nch, 8, bn);
+    }
+}
+
+#undef COEF
+
+__attribute__((target("avx")))
+static void cmul_add_avx(float *acc, const float *a, const float *b, int num)
+{
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m256 va = _mm256_loadu_ps(a + i * 2), vb = _mm256_loadu_ps(b + i * 2);
+        __m256 re = _mm256_moveldup_ps(va), im = _mm256_movehdup_ps(va);
+        __m256 sw = _mm256_permute_ps(vb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m256 r = _mm256_addsub_ps(_mm256_mul_ps(re, vb),
+                                    _mm256_mul_ps(im, sw));
+        _mm256_storeu_ps(acc + i * 2,
+                         _mm256_add_ps(_mm256_loadu_ps(acc + i * 2), r));
+    }
+    cmul_add_c(acc + i * 2, a + i * 2, b + i * 2, num - i);
+}
+
+#endif /* DSP_X86 */
+
+#if DSP_NEON
+
+static void scale_float_neon(float *a, int num, float gain)
+{
+    float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(a + i), gain);
+        vst1q_f32(a + i, vminq_f32(vmaxq_f32(x, lo), hi));
+    }
+    scale_float_c(a + i, num - i, gain);
+}
+
+// vqshrn shifts right and saturates, like scale_s16_c().
+static void scale_s16_neon(int16_t *a, int num, int vol)
+{
+    if (vol > INT16_MAX) {
+        scale_s16_c(a, num, vol);
+        return;
+    }
+    int16x4_t v = vdup_n_s16(vol);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        int16x8_t x = vld1q_s16(a + i);
+        int16x4_t r0 = vqshrn_n_s32(vmull_s16(vget_low_s16(x), v), 8);
+        int16x4_t r1 = vqshrn_n_s32(vmull_s16(vget_high_s16(x), v), 8);
+        vst1q_s16(a + i, vcombine_s16(r0, r1));
+    }
+    scale_s16_c(a + i, num - i, vol);
+}
+
+static void mul_float_neon(float *dst, const float *src, float gain, int num)
+{
+    int i = 0;
+    for (; i + 4 <= num; i += 4)
+        vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(src + i), gain));
+    mul_float_c(dst + i, src + i, gain, num - i);
+}
+
+// Separate multiply and add, so that the result is the same as with C.
+static void mul_add_float_neon(float *dst, const float *src, float gain,
+                               int num)
+{
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(src + i), gain);
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), x));
+    }
+    mul_add_float_c(dst + i, src + i, gain, num - i);
+}
+
+static void deinterleave_float_neon(float **dst, const float *src, int nch,
+                                    int num)
+{
+    int i = 0;
+    if (nch == 2) {
+        for (; i + 4 <= num; i += 4) {
+            float32x4x2_t v = vld2q_f32(src + i * 2);
+            vst1q_f32(dst[0] + i, v.val[0]);
+            vst1q_f32(dst[1] + i, v.val[1]);
+        }
+    } else if (nch == 4) {
+        for (; i + 4 <= num; i += 4) {
+            float32x4x4_t v = vld4q_f32(src + i * 4);
+            for (int c = 0; c < 4; c++)
+                vst1q_f32(dst[c] + i, v.val[c]);
+        }
+    }
+    float *rest[MP_NUM_CHANNELS];
+    for (int c = 0; c < nch; c++)
+        rest[c] = dst[c] + i;
+    deinterleave_float_c(rest, src + i * nch, nch, num - i);
+}
+
+static void interleave_float_neon(float *dst, float *const *src, int nch,
+                                  int num)
+{
+    int i = 0;
+    if (nch == 2) {
+        for (; i + 4 <= num; i += 4) {
+            float32x4x2_t v = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i)}};
+            vst2q_f32(dst + i * 2, v);
+        }
+    } else if (nch == 4) {
+        for (; i + 4 <= num; i += 4) {
+            float32x4x4_t v;
+            for (int c = 0; c < 4; c++)
+                v.val[c] = vld1q_f32(src[c] + i);
+            vst4q_f32(dst + i * 4, v);
+        }
+    }
+    float *rest[MP_NUM_CHANNELS];
+    for (int c = 0; c < nch; c++)
+        rest[c] = src[c] + i;
+    interleave_float_c(dst + i * nch, rest, nch, num - i);
+}
+
+#define COEF(name) vld1q_f32(c[AF_BQ_##name] + v)
+
+static void biquad_cascade_neon(float *data, int nch, int num,
+                                struct af_biquad_lanes *sections,
+                                int num_sections)
+{
+    float32x4_t block[BQ_BLOCK];
+    for (int v = 0; v < nch; v += 4) {
+        int lanes = MPMIN(nch - v, 4);
+        for (int n0 = 0; n0 < num; n0 += BQ_BLOCK) {
+            int bn = MPMIN(num - n0, BQ_BLOCK);
+            float *p = data + n0 * nch;
+            bq_gather((float *)block, p, nch, v, lanes, 4, bn);
+            for (int k = 0; k < num_sections; k++) {
+                float (*c)[MP_NUM_CHANNELS] = sections[k].coef;
+                float *w = sections[k].w[0] + v, *w2 = sections[k].w[1] + v;
+                float32x4_t b0 = COEF(B0), a1 = COEF(A1), a2 = COEF(A2),
+                            d = COEF(D), c0 = COEF(C0), c1 = COEF(C1),
+                            c2 = COEF(C2);
+                float32x4_t w1v = vld1q_f32(w), w2v = vld1q_f32(w2);
+                for (int n = 0; n < bn; n++) {
+                    float32x4_t x = block[n];
+                    float32x4_t wn = vmulq_f32(b0, x);
+                    wn = vaddq_f32(wn, vmulq_f32(a1, w1v));
+                    wn = vaddq_f32(wn, vmulq_f32(a2, w2v));
+                    x = vmulq_f32(d, x);
+                    x = vaddq_f32(x, vmulq_f32(c0, wn));
+                    x = vaddq_f32(x, vmulq_f32(c1, w1v));
+                    x = vaddq_f32(x, vmulq_f32(c2, w2v));
+                    block[n] = x;
+                    w2v = w1v;
+                    w1v = wn;
+                }
+                vst1q_f32(w, w1v);
+                vst1q_f32(w2, w2v);
+            }
+            bq_scatter(p, (float *)block, nch, v, lanes, 4, bn);
+        }
+    }
+}
+
+#undef COEF
+
+static void cmul_add_neon(float *acc, const float *a, const float *b, int num)
+{
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        float32x4x2_t va = vld2q_f32(a + i * 2), vb = vld2q_f32(b + i * 2);
+        float32x4x2_t r = vld2q_f32(acc + i * 2);
+        r.val[0] = vmlaq_f32(r.val[0], va.val[0], vb.val[0]);
+        r.val[0] = vmlsq_f32(r.val[0], va.val[1], vb.val[1]);
+        r.val[1] = vmlaq_f32(r.val[1], va.val[0], vb.val[1]);
+        r.val[1] = vmlaq_f32(r.val[1], va.val[1], vb.val[0]);
+        vst2q_f32(acc + i * 2, r);
+    }
+    cmul_add_c(acc + i * 2, a + i * 2, b + i * 2, num - i);
+}
+
+#endif /* DSP_NEON */
+
+// Fill f with the best functions for the given AV_CPU_FLAG_* flags. Passing 0
+// selects the plain C versions.
+void af_dsp_init_funcs(struct af_dsp_funcs *f, int cpu_flags)
+{
+    *f = (struct af_dsp_funcs){
+        .name = "c",
+        .scale_float = scale_float_c,
+        .scale_s16 = scale_s16_c,
+        .mul_float = mul_float_c,
+        .mul_add_float = mul_add_float_c,
+        .deinterleave_float = deinterleave_float_c,
+        .interleave_float = interleave_float_c,
+        .biquad_cascade = biquad_cascade_c,
+        .cmul_add = cmul_add_c,
+    };
+#if DSP_X86
+    if (cpu_flags & AV_CPU_FLAG_SSE2) {
+        f->name = "sse2";
+        f->scale_float = scale_float_sse2;
+        f->scale_s16 = scale_s16_sse2;
+        f->mul_float = mul_float_sse2;
+        f->mul_add_float = mul_add_float_sse2;
+        f->deinterleave_float = deinterleave_float_sse2;
+        f->interleave_float = interleave_float_sse2;
+        f->biquad_cascade = biquad_cascade_sse2;
+        f->cmul_add = cmul_add_sse2;
+    }
+    if (cpu_flags & AV_CPU_FLAG_AVX) {
+        f->name = "avx";
+        f->scale_float = scale_float_avx;
+        f->mul_float = mul_float_avx;
+        f->mul_add_float = mul_add_float_avx;
+        f->biquad_cascade = biquad_cascade_avx;
+        f->cmul_add = cmul_add_avx;
+    }
+    if (cpu_flags & AV_CPU_FLAG_AVX2) {
+        f->name = "avx2";
+        f->scale_s16 = scale_s16_avx2;
+    }
+#endif
+#if DSP_NEON
+    if (cpu_flags & AV_CPU_FLAG_NEON) {
+        f->name = "neon";
+        f->scale_float = scale_float_neon;
+        f->scale_s16 = scale_s16_neon;
+        f->mul_float = mul_float_neon;
+        f->mul_add_float = mul_add_float_neon;
+        f->deinterleave_float = deinterleave_float_neon;
+        f->interleave_float = interleave_float_neon;
+        f->biquad_cascade = biquad_cascade_neon;
+        f->cmul_add = cmul_add_neon;
+    }
+#endif
+}
+
+static pthread_once_t dsp_init_once = PTHREAD_ONCE_INIT;
+static struct af_dsp_funcs dsp_funcs;
+
+static void dsp_init(void)
+{
+    af_dsp_init_funcs(&dsp_funcs, av_get_cpu_flags());
+}
+
+// Return the functions for the CPU we're running on.
+const struct af_dsp_funcs *af_dsp_get(void)
+{
+    pthread_once(&dsp_init_once, dsp_init);
+    return &dsp_funcs;
+}
+
+// Number of frames mixed at once; the planar copies are on the stack.
+#define MIX_BLOCK 128
+
+void af_dsp_mix_float(float *out, int out_nch, const float *in, int in_nch,
+                      float matrix[][MP_NUM_CHANNELS], int num)
+{
+    assert(out != in || out_nch == in_nch);
+    const struct af_dsp_funcs *f = af_dsp_get();
+    float pin[MP_NUM_CHANNELS][MIX_BLOCK], pout[MP_NUM_CHANNELS][MIX_BLOCK];
+    float *in_ptrs[MP_NUM_CHANNELS], *out_ptrs[MP_NUM_CHANNELS];
+    for (int i = 0; i < in_nch; i++)
+        in_ptrs[i] = pin[i];
+    // Output channels that are a plain copy of an input channel are
+    // interleaved directly from the input.
+    bool mixed[MP_NUM_CHANNELS];
+    for (int o = 0; o < out_nch; o++) {
+        out_ptrs[o] = pout[o];
+        mixed[o] = true;
+        int nonzero = 0, src = 0;
+        for (int i = 0; i < in_nch; i++) {
+            if (matrix[o][i] != 0) {
+                nonzero++;
+                src = i;
+            }
+        }
+        if (nonzero == 1 && matrix[o][src] == 1) {
+            out_ptrs[o] = pin[src];
+            mixed[o] = false;
+        }
+    }
+
+    for (int pos = 0; pos < num; pos += MIX_BLOCK) {
+        int n = MPMIN(num - pos, MIX_BLOCK);
+        f->deinterleave_float(in_ptrs, in + pos * in_nch, in_nch, n);
+        for (int o = 0; o < out_nch; o++) {
+            if (!mixed[o])
+                continue;
+            bool first = true;
+            for (int i = 0; i < in_nch; i++) {
+                float gain = matrix[o][i];
+                if (gain == 0)
+                    continue;
+                if (first) {
+                    f->mul_float(pout[o], pin[i], gain, n);
+                } else {
+                    f->mul_add_float(pout[o], pin[i], gain, n);
+                }
+                first = false;
+            }
+            if (first)
+                memset(pout[o], 0, n * sizeof(float));
+        }
+        f->interleave_float(out + pos * out_nch, out_ptrs, out_nch, n);
+    }
+}
+
+#define COPY_CHANNEL(type)                                                  \
+    for (int i = 0; i < num; i++)                                           \
+        ((type *)d)[i * dst_nch] = ((const type *)s)[i * src_nch];
+
+void af_dsp_copy_channel(void *dst, int dst_nch, int dst_ch,
+                         const void *src, int src_nch, int src_ch,
+                         int bps, int num)
+{
+    uint8_t *d = (uint8_t *)dst + dst_ch * bps;
+    const uint8_t *s = (const uint8_t *)src + src_ch * bps;
+    switch (bps) {
+    case 1: COPY_CHANNEL(uint8_t); break;
+    case 2: COPY_CHANNEL(uint16_t); break;
+    case 4: COPY_CHANNEL(uint32_t); break;
+    case 8: COPY_CHANNEL(uint64_t); break;
+    default:
+        for (int i = 0; i < num; i++)
+            memcpy(d + i * dst_nch * bps, s + i * src_nch * bps, bps);
+    }
+}
+
+// Max. number of frames processed at once by af_delay_line_process().
+#define DELAY_CHUNK 4096
+
+struct af_delay_line {
+    int nch, bps;
+    int delays[MP_NUM_CHANNELS];
+    bool same_delay;
+    int size;           // ring buffer size in frames
+    int pos;            // write position in frames
+    uint8_t *buf;       // ring buffer with interleaved frames
+};
+
+// delays[] contains the delay of each channel in frames.
+struct af_delay_line *af_delay_line_alloc(void *ta_parent, int nch, int bps,
+                                          const int *delays)
+{
+    assert(nch >= 1 && nch <= MP_NUM_CHANNELS);
+    struct af_delay_line *d = talloc_zero(ta_parent, struct af_delay_line);
+    d->nch = nch;
+    d->bps = bps;
+    d->same_delay = true;
+    int max_delay = 0;
+    for (int c = 0; c < nch; c++) {
+        d->delays[c] = MPMAX(delays[c], 0);
+        d->same_delay &= d->delays[c] == d->delays[0];
+        max_delay = MPMAX(max_delay, d->delays[c]);
+    }
+    // The oldest frame needed must not be overwritten by the current chunk.
+    d->size = max_delay + DELAY_CHUNK;
+    d->buf = talloc_zero_size(d, (size_t)d->size * nch * bps);
+    return d;
+}
+
+void af_delay_line_process(struct af_delay_line *d, void *data, int num)
+{
+    if (d->same_delay && d->delays[0] == 0)
+        return;
+    int fsize = d->nch * d->bps;
+    uint8_t *p = data;
+    while (num > 0) {
+        int n = MPMIN(num, DELAY_CHUNK);
+
+        // Append the input to the ring buffer.
+        int n1 = MPMIN(n, d->size - d->pos);
+        memcpy(d->buf + d->pos * fsize, p, n1 * fsize);
+        memcpy(d->buf, p + n1 * fsize, (n - n1) * fsize);
+
+        // Read it back, each channel delayed by its own amount. The read
+        // wraps around at most once.
+        for (int c = 0; c < d->nch; c++) {
+            int rpos = d->pos - d->delays[c];
+            if (rpos < 0)
+                rpos += d->size;
+            int r1 = MPMIN(n, d->size - rpos);
+            if (d->same_delay) {
+                memcpy(p, d->buf + rpos * fsize, r1 * fsize);
+                memcpy(p + r1 * fsize, d->buf, (n - r1) * fsize);
+                break;
+            }
+            af_dsp_copy_channel(p, d->nch, c, d->buf + rpos * fsize, d->nch,
+                                c, d->bps, r1);
+            af_dsp_copy_channel(p + r1 * fsize, d->nch, c, d->buf, d->nch, c,
+                                d->bps, n - r1);
+        }
+
+        d->pos = (d->pos + n) % d->size;
+        p += n * fsize;
+        num -= n;
+    }
+}
+
+// Coefficients are interpolated in steps of this many frames while ramping.
+#define RAMP_BLOCK 32
+
+typedef float biquad_coeffs[AF_BQ_NUM_COEFFS][MP_NUM_CHANNELS];
+
+struct af_biquad_cascade {
+    int nch, num_sections;
+    struct af_biquad_lanes *sections;   // current coefficients and state
+    biquad_coeffs *start;               // coefficients when the ramp started
+    biquad_coeffs *target;              // coefficients set by the user
+    int ramp_pos, ramp_len;             // ramp_len == 0 if not ramping
+};
+
+struct af_biquad_cascade *af_biquad_cascade_alloc(void *ta_parent, int nch,
+                                                  int num_sections)
+{
+    assert(nch >= 1 && nch <= MP_NUM_CHANNELS);
+    struct af_biquad_cascade *c = talloc_zero(ta_parent,
+                                              struct af_biquad_cascade);
+    c->nch = nch;
+    c->num_sections = num_sections;
+    c->sections = talloc_zero_array(c, struct af_biquad_lanes, num_sections);
+    c->start = talloc_zero_array(c, biquad_coeffs, num_sections);
+    c->target = talloc_zero_array(c, biquad_coeffs, num_sections);
+    for (int k = 0; k < num_sections; k++) {
+        for (int ch = 0; ch < nch; ch++)
+            af_biquad_cascade_set(c, k, ch, &(struct af_biquad){.d = 1});
+    }
+    af_biquad_cascade_update(c, 0);
+    return c;
+}
+
+void af_biquad_cascade_set(struct af_biquad_cascade *c, int section, int ch,
+                           const struct af_biquad *bq)
+{
+    assert(section >= 0 && section < c->num_sections);
+    assert(ch >= 0 && ch < c->nch);
+    float *t[AF_BQ_NUM_COEFFS];
+    for (int i = 0; i < AF_BQ_NUM_COEFFS; i++)
+        t[i] = &c->target[section][i][ch];
+    *t[AF_BQ_B0] = bq->b0;
+    *t[AF_BQ_A1] = bq->a1;
+    *t[AF_BQ_A2] = bq->a2;
+    *t[AF_BQ_D] = bq->d;
+    *t[AF_BQ_C0] = bq->c0;
+    *t[AF_BQ_C1] = bq->c1;
+    *t[AF_BQ_C2] = bq->c2;
+}
+
+// See dsp.h for the limits of ramping the poles.
+void af_biquad_cascade_update(struct af_biquad_cascade *c, int ramp_frames)
+{
+    for (int k = 0; k < c->num_sections; k++)
+        memcpy(c->start[k], c->sections[k].coef, sizeof(biquad_coeffs));
+    c->ramp_pos = 0;
+    c->ramp_len = MPMAX(ramp_frames, 1);
+}
+
+static void interpolate_coeffs(struct af_biquad_cascade *c)
+{
+    float t = MPMIN(c->ramp_pos / (float)c->ramp_len, 1.0f);
+    for (int k = 0; k < c->num_sections; k++) {
+        float *cur = c->sections[k].coef[0];
+        float *s = c->start[k][0], *e = c->target[k][0];
+        for (int i = 0; i < AF_BQ_NUM_COEFFS * MP_NUM_CHANNELS; i++)
+            cur[i] = t < 1 ? s[i] + (e[i] - s[i]) * t : e[i];
+    }
+    if (t >= 1)
+        c->ramp_len = 0;
+}
+
+void af_biquad_cascade_process(struct af_biquad_cascade *c, float *data,
+                               int num)
+{
+    const struct af_dsp_funcs *f = af_dsp_get();
+    while (num > 0) {
+        int n = num;
+        if (c->ramp_len) {
+            n = MPMIN(n, RAMP_BLOCK);
+            c->ramp_pos += n;
+            interpolate_coeffs(c);
+        }
+        f->biquad_cascade(data, c->nch, n, c->sections, c->num_sections);
+        data += n * c->nch;
+        num -= n;
+    }
+}
+
+// Clear the filter state, e.g. on seeking.
+void af_biquad_cascade_reset(struct af_biquad_cascade *c)
+{
+    for (int k = 0; k < c->num_sections; k++)
+        memset(c->sections[k].w, 0, sizeof(c->sections[k].w));
+}
@@ -25,7 +25,112 @@
 /* Size of floating point type used in routines */
 #define FLOAT_TYPE float
 
+#include <stdint.h>
+
+#include "audio/chmap.h"
+
 #include "window.h"
 #include "filter.h"
 
+/* Sample processing kernels, with vectorized versions chosen at runtime
+   (dsp.c). All functions work on any alignment and number of samples. */
+
+// Coefficients of a 2nd order IIR section. This is direct form II with an
+// input scale and a direct path, so that sections of the form
+// y = x + g * bandpass(x) don't lose precision:
+//   w[n] = b0 * x[n] + a1 * w[n-1] + a2 * w[n-2]
+//   y[n] = d * x[n] + c0 * w[n] + c1 * w[n-1] + c2 * w[n-2]
+struct af_biquad {
+    float b0, a1, a2, d, c0, c1, c2;
+};
+
+enum {
+    AF_BQ_B0, AF_BQ_A1, AF_BQ_A2, AF_BQ_D, AF_BQ_C0, AF_BQ_C1, AF_BQ_C2,
+    AF_BQ_NUM_COEFFS,
+};
+
+// Coefficients and state of a section for all channels. The arrays are
+// indexed by channel, so that each channel is a SIMD lane.
+struct af_biquad_lanes {
+    float coef[AF_BQ_NUM_COEFFS][MP_NUM_CHANNELS];
+    float w[2][MP_NUM_CHANNELS];    // w[n-1], w[n-2]
+};
+
+struct af_dsp_funcs {
+    const char *name;   // instruction set used, for debugging
+
+    // a[i] = clamp(a[i] * gain, -1, 1)
+    void (*scale_float)(float *a, int num, float gain);
+    // a[i] = saturate_s16((a[i] * vol) >> 8)
+    void (*scale_s16)(int16_t *a, int num, int vol);
+
+    // dst[i] = src[i] * gain
+    void (*mul_float)(float *dst, const float *src, float gain, int num);
+    // dst[i] += src[i] * gain
+    void (*mul_add_float)(float *dst, const float *src, float gain, int num);
+
+    // dst[c][i] = src[i * nch + c]
+    void (*deinterleave_float)(float **dst, const float *src, int nch, int num);
+    // dst[i * nch + c] = src[c][i]
+    void (*interleave_float)(float *dst, float *const *src, int nch, int num);
+
+    // Run num interleaved frames through a cascade of sections, in place.
+    void (*biquad_cascade)(float *data, int nch, int num,
+                           struct af_biquad_lanes *sections, int num_sections);
+
+    // acc[i] += a[i] * b[i] for num complex numbers, stored as interleaved
+    // real and imaginary parts.
+    void (*cmul_add)(float *acc, const float *a, const float *b, int num);
+};
+
+void af_dsp_init_funcs(struct af_dsp_funcs *f, int cpu_flags);
+const struct af_dsp_funcs *af_dsp_get(void);
+
+/* Operations on interleaved frames, built on the kernels above. */
+
+// out[f * out_nch + o] = sum(matrix[o][i] * in[f * in_nch + i]) for all
+// num frames. out can be the same as in if out_nch == in_nch; then rows that
+// only have a 1 on the diagonal leave the channel untouched.
+// matrix is not const, because C doesn't convert float (*)[N] to
+// const float (*)[N] implicitly.
+void af_dsp_mix_float(float *out, int out_nch, const float *in, int in_nch,
+                      float matrix[][MP_NUM_CHANNELS], int num);
+
+// Copy channel src_ch of src to channel dst_ch of dst, for num frames of
+// samples with bps bytes.
+void af_dsp_copy_channel(void *dst, int dst_nch, int dst_ch,
+                         const void *src, int src_nch, int src_ch,
+                         int bps, int num);
+
+// Delays each channel of interleaved frames by a number of frames. Samples of
+// any format with bps bytes are supported.
+struct af_delay_line;
+
+struct af_delay_line *af_delay_line_alloc(void *ta_parent, int nch, int bps,
+                                          const int *delays);
+void af_delay_line_process(struct af_delay_line *d, void *data, int num);
+
+// Cascade of 2nd order sections, with coefficients that can be changed
+// without clicks. All sections start out as pass-through.
+struct af_biquad_cascade;
+
+struct af_biquad_cascade *af_biquad_cascade_alloc(void *ta_parent, int nch,
+                                                  int num_sections);
+// Set the coefficients of a section for one channel. They are used after the
+// next af_biquad_cascade_update() call.
+void af_biquad_cascade_set(struct af_biquad_cascade *c, int section, int ch,
+                           const struct af_biquad *bq);
+// Start using the coefficients set with af_biquad_cascade_set(). They are
+// interpolated linearly from the current ones over ramp_frames frames.
+// Ramping d and c* is always click-free, because the filter state doesn't
+// depend on them. Ramping the poles (a1, a2) is only safe for small changes:
+// every interpolated section is stable if the old and new ones are (the
+// stability region of a1/a2 is convex), but a direct form section whose poles
+// move can still ring or grow while the ramp lasts. For larger pole changes,
+// switch without ramp (ramp_frames = 0) and af_biquad_cascade_reset().
+void af_biquad_cascade_update(struct af_biquad_cascade *c, int ramp_frames);
+void af_biquad_cascade_process(struct af_biquad_cascade *c, float *data,
+                               int num);
+void af_biquad_cascade_reset(struct af_biquad_cascade *c);
+
 #endif /* MPLAYER_DSP_H */
@@ -0,0 +1,215 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libavcodec/avfft.h>
+#include <libavutil/mem.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "dsp.h"
+#include "fftconv.h"
+
+// Limits of the libavcodec RDFT.
+#define MIN_BITS 4
+#define MAX_BITS 16
+
+// Upper bound for impulse responses (about 23 minutes at 48 kHz), so that the
+// buffer sizes can't overflow.
+#define MAX_LEN (1 << 26)
+
+struct mp_fftconv {
+    int block;          // samples per partition
+    int size;           // transform size, 2 * block
+    int num_in, num_out;
+    int num_parts;      // partitions of the longest impulse response
+    RDFTContext *fwd, *inv;
+    const struct af_dsp_funcs *dsp;
+    float **hist;       // per input: the last 2 blocks of samples
+    float **fdl;        // per input: spectra of the last num_parts blocks
+    int fdl_pos;        // index of the newest spectrum in fdl[]
+    float **ir;         // per input/output pair: num_parts spectra, or NULL
+    bool **ir_used;     // per input/output pair: partition is not 0
+    float **out;        // per output: the last computed block
+    float *tmp;         // transform buffer (av_malloc'd, like fdl[])
+    int pos;            // samples of the current block received so far
+};
+
+static void destroy(void *ptr)
+{
+    struct mp_fftconv *c = ptr;
+    if (c->fwd)
+        av_rdft_end(c->fwd);
+    if (c->inv)
+        av_rdft_end(c->inv);
+    for (int i = 0; i < c->num_in; i++)
+        av_free(c->fdl[i]);
+    av_free(c->tmp);
+}
+
+struct mp_fftconv *mp_fftconv_create(void *ta_parent, int block, int num_in,
+                                     int num_out, int max_len)
+{
+    if (block < (1 << (MIN_BITS - 1)) || block > (1 << (MAX_BITS - 1)) ||
+        (block & (block - 1)) || num_in < 1 || num_out < 1 || max_len < 1 ||
+        max_len > MAX_LEN)
+        return NULL;
+    int bits = MIN_BITS;
+    while ((1 << bits) < block * 2)
+        bits++;
+    struct mp_fftconv *c = talloc_zero(ta_parent, struct mp_fftconv);
+    c->block = block;
+    c->size = block * 2;
+    c->num_parts = (max_len + block - 1) / block;
+    c->fdl = talloc_zero_array(c, float *, num_in);
+    c->num_in = num_in;
+    c->num_out = num_out;
+    talloc_set_destructor(c, destroy);
+    c->fwd = av_rdft_init(bits, DFT_R2C);
+    c->inv = av_rdft_init(bits, IDFT_C2R);
+    c->dsp = af_dsp_get();
+    c->tmp = av_malloc(sizeof(float) * c->size);
+    bool ok = c->fwd && c->inv && c->tmp;
+    c->hist = talloc_zero_array(c, float *, num_in);
+    for (int i = 0; i < num_in; i++) {
+        c->hist[i] = talloc_zero_array(c, float, c->size);
+        c->fdl[i] = av_mallocz(sizeof(float) * c->size * c->num_parts);
+        ok &= !!c->fdl[i];
+    }
+    c->ir = talloc_zero_array(c, float *, num_in * num_out);
+    c->ir_used = talloc_zero_array(c, bool *, num_in * num_out);
+    c->out = talloc_zero_array(c, float *, num_out);
+    for (int o = 0; o < num_out; o++)
+        c->out[o] = talloc_zero_array(c, float, block);
+    if (!ok) {
+        talloc_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void mp_fftconv_add_ir(struct mp_fftconv *c, int in, int out, const float *ir,
+                       int len, int delay, float gain)
+{
+    assert(in >= 0 && in < c->num_in && out >= 0 && out < c->num_out);
+    assert(len >= 0 && delay >= 0 && len + delay <= c->num_parts * c->block);
+    int pair = in * c->num_out + out;
+    if (!c->ir[pair]) {
+        c->ir[pair] = talloc_zero_array(c, float, c->size * c->num_parts);
+        c->ir_used[pair] = talloc_zero_array(c, bool, c->num_parts);
+    }
+    // The inverse transform scales by size / 2, which is undone here.
+    float scale = gain * 2.0f / c->size;
+    for (int p = 0; p < c->num_parts; p++) {
+        int start = p * c->block - delay;
+        int a = MPMAX(start, 0), b = MPMIN(start + c->block, len);
+        bool nonzero = false;
+        for (int n = a; n < b; n++)
+            nonzero |= ir[n] != 0;
+        if (!nonzero)
+            continue;
+        float *tmp = c->tmp;
+        memset(tmp, 0, sizeof(float) * c->size);
+        for (int n = a; n < b; n++)
+            tmp[n - start] = ir[n] * scale;
+        av_rdft_calc(c->fwd, tmp);
+        float *h = c->ir[pair] + p * c->size;
+        for (int n = 0; n < c->size; n++)
+            h[n] += tmp[n];
+        c->ir_used[pair][p] = true;
+    }
+}
+
+// Overlap-save: transform the last 2 blocks of each input, multiply with the
+// partitions of the impulse responses (partition p with the spectrum of p
+// blocks ago), and keep the second half of the inverse transform, which is
+// free of wrap-around.
+static void run_block(struct mp_fftconv *c)
+{
+    int block = c->block, size = c->size;
+    c->fdl_pos = (c->fdl_pos + 1) % c->num_parts;
+    for (int i = 0; i < c->num_in; i++) {
+        float *x = c->fdl[i] + c->fdl_pos * size;
+        memcpy(x, c->hist[i], sizeof(float) * size);
+        av_rdft_calc(c->fwd, x);
+        memmove(c->hist[i], c->hist[i] + block, sizeof(float) * block);
+    }
+    for (int o = 0; o < c->num_out; o++) {
+        float *acc = c->tmp;
+        bool any = false;
+        memset(acc, 0, sizeof(float) * size);
+        for (int i = 0; i < c->num_in; i++) {
+            const float *h = c->ir[i * c->num_out + o];
+            const bool *used = c->ir_used[i * c->num_out + o];
+            if (!h)
+                continue;
+            for (int p = 0; p < c->num_parts; p++) {
+                if (!used[p])
+                    continue;
+                int slot = (c->fdl_pos - p + c->num_parts) % c->num_parts;
+                const float *x = c->fdl[i] + slot * size, *hp = h + p * size;
+                // The DC and Nyquist bins are real, and packed into the first
+                // two elements.
+                acc[0] += x[0] * hp[0];
+                acc[1] += x[1] * hp[1];
+                c->dsp->cmul_add(acc + 2, x + 2, hp + 2, block - 1);
+                any = true;
+            }
+        }
+        if (any) {
+            av_rdft_calc(c->inv, acc);
+            memcpy(c->out[o], acc + block, sizeof(float) * block);
+        } else {
+            memset(c->out[o], 0, sizeof(float) * block);
+        }
+    }
+}
+
+void mp_fftconv_process(struct mp_fftconv *c, float **in, float **out, int num)
+{
+    int done = 0;
+    while (done < num) {
+        int n = MPMIN(num - done, c->block - c->pos);
+        for (int i = 0; i < c->num_in; i++) {
+            memcpy(c->hist[i] + c->block + c->pos, in[i] + done,
+                   sizeof(float) * n);
+        }
+        for (int o = 0; o < c->num_out; o++)
+            memcpy(out[o] + done, c->out[o] + c->pos, sizeof(float) * n);
+        c->pos += n;
+        done += n;
+        if (c->pos == c->block) {
+            run_block(c);
+            c->pos = 0;
+        }
+    }
+}
+
+void mp_fftconv_reset(struct mp_fftconv *c)
+{
+    for (int i = 0; i < c->num_in; i++) {
+        memset(c->hist[i], 0, sizeof(float) * c->size);
+        memset(c->fdl[i], 0, sizeof(float) * c->size * c->num_parts);
+    }
+    for (int o = 0; o < c->num_out; o++)
+        memset(c->out[o], 0, sizeof(float) * c->block);
+    c->fdl_pos = 0;
+    c->pos = 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_FFTCONV_H
+#define MP_AF_FFTCONV_H
+
+// Convolution of num_in input signals with impulse responses, summed into
+// num_out output signals, using uniformly partitioned FFT convolution. Each
+// impulse response is cut into pieces of block samples, and the pieces are
+// applied to the spectra of past input blocks. The cost per sample grows with
+// the number of non-zero pieces, so leading silence (e.g. a delay) is free.
+//
+// The output lags the input by block samples.
+struct mp_fftconv;
+
+// block must be a power of 2. max_len is the maximum length of an impulse
+// response, including its delay. Returns NULL if the sizes are not supported.
+struct mp_fftconv *mp_fftconv_create(void *ta_parent, int block, int num_in,
+                                     int num_out, int max_len);
+
+// Add gain * ir, delayed by delay samples, to the impulse response from input
+// in to output out. All responses start out as 0.
+void mp_fftconv_add_ir(struct mp_fftconv *c, int in, int out, const float *ir,
+                       int len, int delay, float gain);
+
+// Feed num samples of each input, and write num samples of each output.
+void mp_fftconv_process(struct mp_fftconv *c, float **in, float **out, int num);
+
+// Clear the signal history (but not the impulse responses).
+void mp_fftconv_reset(struct mp_fftconv *c);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <libavcodec/avfft.h>
+#include <libavutil/mem.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "xcorr.h"
+
+// Limits of the libavcodec RDFT.
+#define MIN_BITS 4
+#define MAX_BITS 16
+
+struct mp_xcorr {
+    int len_a, len_b;
+    int bits;
+    RDFTContext *fwd, *inv;
+    float *a, *b;   // av_malloc'd, 1 << bits samples each
+};
+
+static int fft_bits(int len_a, int len_b)
+{
+    // Circular correlation doesn't wrap around for the wanted lags if the
+    // transform covers all of b.
+    int bits = MIN_BITS;
+    while ((1 << bits) < MPMAX(len_a, len_b))
+        bits++;
+    return bits;
+}
+
+static void destroy(void *ptr)
+{
+    struct mp_xcorr *x = ptr;
+    if (x->fwd)
+        av_rdft_end(x->fwd);
+    if (x->inv)
+        av_rdft_end(x->inv);
+    av_free(x->a);
+    av_free(x->b);
+}
+
+// Return NULL if the lengths are not supported.
+struct mp_xcorr *mp_xcorr_create(void *ta_parent, int len_a, int len_b)
+{
+    if (len_a < 1 || len_b < len_a || fft_bits(len_a, len_b) > MAX_BITS)
+        return NULL;
+    struct mp_xcorr *x = talloc_zero(ta_parent, struct mp_xcorr);
+    talloc_set_destructor(x, destroy);
+    x->len_a = len_a;
+    x->len_b = len_b;
+    x->bits = fft_bits(len_a, len_b);
+    x->fwd = av_rdft_init(x->bits, DFT_R2C);
+    x->inv = av_rdft_init(x->bits, IDFT_C2R);
+    x->a = av_malloc(sizeof(float) << x->bits);
+    x->b = av_malloc(sizeof(float) << x->bits);
+    if (!x->fwd || !x->inv || !x->a || !x->b) {
+        talloc_free(x);
+        return NULL;
+    }
+    return x;
+}
+
+float *mp_xcorr_get_a(struct mp_xcorr *x)
+{
+    return x->a;
+}
+
+float *mp_xcorr_get_b(struct mp_xcorr *x)
+{
+    return x->b;
+}
+
+const float *mp_xcorr_run(struct mp_xcorr *x)
+{
+    int n = 1 << x->bits;
+    float *a = x->a, *b = x->b;
+    memset(a + x->len_a, 0, (n - x->len_a) * sizeof(float));
+    memset(b + x->len_b, 0, (n - x->len_b) * sizeof(float));
+    av_rdft_calc(x->fwd, a);
+    av_rdft_calc(x->fwd, b);
+    // b = conj(a) * b. The DC and Nyquist bins are real, and packed into the
+    // first two elements. (The result doesn't depend on the sign convention of
+    // the transform, as long as the inverse matches.)
+    b[0] *= a[0];
+    b[1] *= a[1];
+    for (int i = 2; i < n; i += 2) {
+        float re = a[i] * b[i] + a[i + 1] * b[i + 1];
+        float im = a[i] * b[i + 1] - a[i + 1] * b[i];
+        b[i] = re;
+        b[i + 1] = im;
+    }
+    av_rdft_calc(x->inv, b);
+    return b;
+}
+
+int64_t mp_xcorr_cost(int len_a, int len_b)
+{
+    // 3 transforms of n*log2(n)/2 butterflies each, plus some overhead.
+    int bits = fft_bits(len_a, len_b);
+    return bits > MAX_BITS ? INT64_MAX : 2 * 3 * ((int64_t)bits << bits);
+}
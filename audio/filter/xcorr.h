@@ -0,0 +1,44 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MP_AF_XCORR_H
+#define MP_AF_XCORR_H
+
+#include <stdint.h>
+
+// Cross correlation of a short signal a against a longer signal b, computed
+// with FFTs: corr[k] = sum(a[i] * b[i + k]) for 0 <= i < len_a, for every
+// 0 <= k <= len_b - len_a at once.
+struct mp_xcorr;
+
+struct mp_xcorr *mp_xcorr_create(void *ta_parent, int len_a, int len_b);
+
+// Input buffers. The caller fills len_a resp. len_b samples before each
+// mp_xcorr_run() call. The contents are destroyed by mp_xcorr_run().
+float *mp_xcorr_get_a(struct mp_xcorr *x);
+float *mp_xcorr_get_b(struct mp_xcorr *x);
+
+// Return the correlation values, scaled by an unspecified positive constant.
+// The returned array is valid until the next call.
+const float *mp_xcorr_run(struct mp_xcorr *x);
+
+// Rough number of multiply-adds per mp_xcorr_run() call, to decide whether
+// it's faster than computing the correlation directly.
+int64_t mp_xcorr_cost(int len_a, int len_b);
+
+#endif
@@ -247,32 +247,61 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     return write_samples;
 }
 
+// Write up to samples from the given spans (as returned by
+// mp_audio_buffer_peek()) to the driver. Returns the number of samples written.
+static int write_spans(struct ao *ao, struct mp_audio *data, int samples,
+                       int flags)
+{
+    int written = 0;
+    for (int n = 0; n < 2 && written < samples; n++) {
+        data[n].samples = MPMIN(data[n].samples, samples - written);
+        int f = flags;
+        if (written + data[n].samples < samples)
+            f &= ~AOPLAY_FINAL_CHUNK;
+        int r = ao->driver->play(ao, data[n].planes, data[n].samples, f);
+        if (r > data[n].samples) {
+            MP_WARN(ao, "Audio device returned non-sense value.\n");
+            r = data[n].samples;
+        }
+        r = MPMAX(r, 0);
+        written += r;
+        if (r < data[n].samples)
+            break;
+    }
+    return written;
+}
+
 // called locked
 static void ao_play_data(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    struct mp_audio data;
-    mp_audio_buffer_peek(p->buffer, &data);
-    int max = data.samples;
+    int max = mp_audio_buffer_samples(p->buffer);
     int space = ao->driver->get_space(ao);
     space = MPMAX(space, 0);
-    if (data.samples > space)
-        data.samples = space;
+    int samples = MPMIN(max, space);
     int flags = 0;
-    if (p->final_chunk && data.samples == max)
+    if (p->final_chunk && samples == max)
         flags |= AOPLAY_FINAL_CHUNK;
     MP_STATS(ao, "start ao fill");
     int r = 0;
-    if (data.samples)
-        r = ao->driver->play(ao, data.planes, data.samples, flags);
-    MP_STATS(ao, "end ao fill");
-    if (r > data.samples) {
-        MP_WARN(ao, "Audio device returned non-sense value.\n");
-        r = data.samples;
+    if (samples) {
+        struct mp_audio data[2];
+        mp_audio_buffer_peek(p->buffer, &data[0], &data[1]);
+        int first = MPMIN(data[0].samples, samples);
+        r = write_spans(ao, data, samples, flags);
+        // Drivers which write whole periods only can refuse the partial period
+        // before the buffer wraps around. Retry with contiguous data. This
+        // copies the data at most once per pass through the buffer.
+        if (r < first && first < samples) {
+            mp_audio_buffer_make_contiguous(p->buffer);
+            mp_audio_buffer_peek(p->buffer, &data[0], &data[1]);
+            mp_audio_skip_samples(&data[0], r);
+            r += write_spans(ao, data, samples - r, flags);
+        }
     }
-    r = MPMAX(r, 0);
+    MP_STATS(ao, "end ao fill");
     // Probably can't copy the rest of the buffer due to period alignment.
-    bool stuck_eof = r <= 0 && space >= max && data.samples > 0;
+    bool stuck_eof = r <= 0 && space >= max && samples > 0;
     if ((flags & AOPLAY_FINAL_CHUNK) && stuck_eof) {
         MP_ERR(ao, "Audio output driver seems to ignore AOPLAY_FINAL_CHUNK.\n");
         r = max;
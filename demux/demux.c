@@ -33,6 +33,7 @@
 #include "common/msg.h"
 #include "common/global.h"
 #include "osdep/threads.h"
+#include "osdep/atomics.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -91,12 +92,17 @@ struct demux_internal {
     struct demuxer *d_user;     // accessed by player (consumer)
     struct demuxer *d_buffer;   // protected by lock; used to sync d_user/thread
 
-    // The lock protects the packet queues (struct demux_stream), d_buffer,
-    // and some minor fields like thread_paused.
+    // The lock protects d_buffer, the packet queue state (struct
+    // demux_stream) except for the queue contents, and some minor fields like
+    // thread_paused. See struct demux_stream for the queues.
     pthread_mutex_t lock;
     pthread_cond_t wakeup;
     pthread_t thread;
 
+    // Set by the demuxer thread before it waits on the wakeup condition, so
+    // that the user thread knows it has to wake it after removing packets.
+    atomic_bool thread_waiting;
+
     // -- All the following fields are protected by lock.
 
     bool thread_paused;
@@ -114,6 +120,7 @@ struct demux_internal {
     double min_secs;
     int min_packs;
     int min_bytes;
+    size_t max_back_bytes;      // per-stream limit of the back buffer
 
     bool tracks_switched;       // thread needs to inform demuxer of this
 
@@ -127,6 +134,7 @@ struct demux_internal {
     // Cached state.
     bool force_cache_update;
     double time_length;
+    double index_progress;
     struct mp_nav_event *nav_event;
     struct mp_tags *stream_metadata;
     int64_t stream_size;
@@ -137,26 +145,61 @@ struct demux_internal {
     char *stream_base_filename;
 };
 
+// Maximum number of packets in a stream's queue. Must be larger than
+// MAX_PACKS, which limits the total number of queued packets.
+#define QUEUE_SIZE 16384
+
+struct demux_queue_entry {
+    struct demux_packet *pkt;
+    double ts;              // stream position after this packet (for readahead)
+};
+
 struct demux_stream {
     struct demux_internal *in;
     enum stream_type type;
-    // all fields are protected by in->lock
+    // The following fields are protected by in->lock.
     bool selected;          // user wants packets from this stream
     bool active;            // try to keep at least 1 packet queued
                             // if false, this stream is disabled, or passively
                             // read (like subtitles)
     bool eof;               // end of demuxed stream? (true if all buffer empty)
     bool refreshing;
-    size_t packs;           // number of packets in buffer
-    size_t bytes;           // total bytes of packets in buffer
-    double base_ts;         // timestamp of the last packet returned to decoder
     double last_ts;         // timestamp of the last packet added to queue
+    int64_t last_pos;
+
+    // Packet queue between the demuxer thread (producer) and the user thread
+    // (consumer). This is a single-producer/single-consumer ring: packets are
+    // added with in->lock held, but removed without taking the lock.
+    // Flushing (which resets both sides) requires in->lock, and must be done
+    // from the user thread.
+    struct demux_queue_entry *queue;    // QUEUE_SIZE entries, lazily allocated
+    atomic_ullong queue_in;     // number of packets ever added
+    atomic_ullong queue_out;    // number of packets ever removed
+    atomic_ullong bytes_in;     // total bytes of packets added
+    atomic_ullong bytes_out;    // total bytes of packets removed
+    uint64_t queue_start;       // queue_in at the last flush
+    // Packets which didn't fit into the queue, because the user thread fell
+    // far behind. Protected by in->lock; moved to the queue as it drains.
+    struct demux_queue_entry *overflow;
+    int num_overflow, overflow_pos;
+    size_t overflow_bytes;
+
+    // The following fields are accessed by the user thread only.
+    double base_ts;         // timestamp of the last packet returned to decoder
     double last_br_ts;      // timestamp of last packet bitrate was calculated
     size_t last_br_bytes;   // summed packet sizes since last bitrate calculation
     double bitrate;
-    int64_t last_pos;
-    struct demux_packet *head;
-    struct demux_packet *tail;
+    // Back buffer: packets removed from the queue, and kept for seeking.
+    // back_head..reader (exclusive) were returned to the decoder. reader..
+    // back_tail are returned again (before reading from the queue), and exist
+    // only after a cached seek.
+    struct demux_packet *back_head;
+    struct demux_packet *back_tail;
+    struct demux_packet *reader;
+    size_t back_packs;      // number of packets before reader
+    size_t back_bytes;      // total bytes of packets before reader
+    size_t replay_packs;    // number of packets starting at reader
+    size_t replay_bytes;    // total bytes of packets starting at reader
 };
 
 // Return "a", or if that is NOPTS, return "def".
@@ -169,18 +212,72 @@ static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
 
-// called locked
+// Number of packets in the queue. Can be called from both threads without
+// locking, but the result is just a snapshot.
+static size_t ds_queued_packs(struct demux_stream *ds)
+{
+    return atomic_load(&ds->queue_in) - atomic_load(&ds->queue_out);
+}
+
+static size_t ds_queued_bytes(struct demux_stream *ds)
+{
+    return atomic_load(&ds->bytes_in) - atomic_load(&ds->bytes_out);
+}
+
+// Whether dequeue_packet() would return a packet. User thread only.
+static bool ds_has_packet(struct demux_stream *ds)
+{
+    return ds->reader || ds_queued_packs(ds) > 0;
+}
+
+// Return the next packet dequeue_packet() would return, without removing it.
+// User thread only.
+static struct demux_packet *ds_peek_packet(struct demux_stream *ds)
+{
+    if (ds->reader)
+        return ds->reader;
+    uint64_t out = atomic_load(&ds->queue_out);
+    if (out == atomic_load(&ds->queue_in))
+        return NULL;
+    return ds->queue[out % QUEUE_SIZE].pkt;
+}
+
+// Timestamp of the last packet the user thread removed from the queue (or of
+// the first queued packet if none was removed yet). Demuxer thread only.
+static double ds_reader_ts(struct demux_stream *ds)
+{
+    uint64_t out = atomic_load(&ds->queue_out);
+    if (out > ds->queue_start)
+        return ds->queue[(out - 1) % QUEUE_SIZE].ts;
+    if (atomic_load(&ds->queue_in) > out)
+        return ds->queue[out % QUEUE_SIZE].ts;
+    return MP_NOPTS_VALUE;
+}
+
+// called locked, from the user thread
 static void ds_flush(struct demux_stream *ds)
 {
-    demux_packet_t *dp = ds->head;
+    demux_packet_t *dp = ds->back_head;
     while (dp) {
         demux_packet_t *dn = dp->next;
         free_demux_packet(dp);
         dp = dn;
     }
-    ds->head = ds->tail = NULL;
-    ds->packs = 0;
-    ds->bytes = 0;
+    ds->back_head = ds->back_tail = ds->reader = NULL;
+    ds->back_packs = 0;
+    ds->back_bytes = 0;
+    ds->replay_packs = 0;
+    ds->replay_bytes = 0;
+    uint64_t in = atomic_load(&ds->queue_in);
+    for (uint64_t n = atomic_load(&ds->queue_out); n < in; n++)
+        free_demux_packet(ds->queue[n % QUEUE_SIZE].pkt);
+    for (int n = ds->overflow_pos; n < ds->num_overflow; n++)
+        free_demux_packet(ds->overflow[n].pkt);
+    ds->num_overflow = ds->overflow_pos = 0;
+    ds->overflow_bytes = 0;
+    atomic_store(&ds->queue_out, in);
+    atomic_store(&ds->bytes_out, atomic_load(&ds->bytes_in));
+    ds->queue_start = in;
     ds->last_ts = ds->base_ts = ds->last_br_ts = MP_NOPTS_VALUE;
     ds->last_br_bytes = 0;
     ds->bitrate = -1;
@@ -190,6 +287,42 @@ static void ds_flush(struct demux_stream *ds)
     ds->last_pos = -1;
 }
 
+// Number of packets in the overflow list. Must be called locked.
+static size_t ds_overflow_packs(struct demux_stream *ds)
+{
+    return ds->num_overflow - ds->overflow_pos;
+}
+
+// Move packets from the overflow list to the queue, as far as there is space.
+// Must be called locked.
+static void ds_drain_overflow(struct demux_stream *ds)
+{
+    if (!ds_overflow_packs(ds))
+        return;
+    uint64_t queue_in = atomic_load(&ds->queue_in);
+    size_t packs = queue_in - atomic_load(&ds->queue_out);
+    bool was_empty = !packs;
+    while (ds_overflow_packs(ds) && packs < QUEUE_SIZE - 1) {
+        struct demux_queue_entry e = ds->overflow[ds->overflow_pos++];
+        ds->overflow_bytes -= e.pkt->len;
+        ds->queue[queue_in % QUEUE_SIZE] = e;
+        atomic_fetch_add(&ds->bytes_in, e.pkt->len);
+        atomic_store(&ds->queue_in, ++queue_in);
+        packs++;
+    }
+    if (!ds_overflow_packs(ds))
+        ds->num_overflow = ds->overflow_pos = 0;
+    if (was_empty && ds->in->wakeup_cb)
+        ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
+    pthread_cond_signal(&ds->in->wakeup);
+}
+
+static void drain_overflow(struct demux_internal *in)
+{
+    for (int n = 0; n < in->d_buffer->num_streams; n++)
+        ds_drain_overflow(in->d_buffer->streams[n]->ds);
+}
+
 struct sh_stream *new_sh_stream(demuxer_t *demuxer, enum stream_type type)
 {
     assert(demuxer == demuxer->in->d_thread);
@@ -241,6 +374,14 @@ void free_demuxer(demuxer_t *demuxer)
         demuxer->desc->close(in->d_thread);
     for (int n = 0; n < demuxer->num_streams; n++)
         ds_flush(demuxer->streams[n]->ds);
+    if (demuxer->packet_pool) {
+        struct demux_packet_pool_stats st;
+        demux_packet_pool_get_stats(demuxer->packet_pool, &st);
+        MP_VERBOSE(demuxer, "Packet pool: %"PRId64"/%"PRId64" packets and "
+                   "%"PRId64"/%"PRId64" payloads reused.\n", st.packet_hits,
+                   st.packets, st.payload_hits, st.payloads);
+    }
+    demux_packet_pool_release(demuxer->packet_pool);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(in->nav_event);
@@ -310,7 +451,7 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 {
     struct demux_stream *ds = stream ? stream->ds : NULL;
     if (!dp || !ds) {
-        talloc_free(dp);
+        free_demux_packet(dp);
         return 0;
     }
     struct demux_internal *in = ds->in;
@@ -327,24 +468,27 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 
     if (!ds->selected || in->seeking || drop) {
         pthread_mutex_unlock(&in->lock);
-        talloc_free(dp);
+        free_demux_packet(dp);
         return 0;
     }
 
+    // Note that ds->active is not set here: it's the reader's request for
+    // readahead, and is set by the reading functions, seeks and track
+    // switches.
+
+    ds_drain_overflow(ds);
+    uint64_t queue_in = atomic_load(&ds->queue_in);
+    size_t packs = queue_in - atomic_load(&ds->queue_out);
+    // Keep the reader's last entry intact (see ds_reader_ts()), and keep the
+    // packet order if older packets are still waiting in the overflow list.
+    bool overflow = packs >= QUEUE_SIZE - 1 || ds_overflow_packs(ds);
+    if (!ds->queue)
+        ds->queue = talloc_array(ds, struct demux_queue_entry, QUEUE_SIZE);
+
     dp->stream = stream->index;
     dp->next = NULL;
 
     ds->last_pos = dp->pos;
-    ds->packs++;
-    ds->bytes += dp->len;
-    if (ds->tail) {
-        // next packet in stream
-        ds->tail->next = dp;
-        ds->tail = dp;
-    } else {
-        // first packet in stream
-        ds->head = ds->tail = dp;
-    }
 
     // obviously not true anymore
     ds->eof = false;
@@ -358,14 +502,28 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
     if (ts != MP_NOPTS_VALUE && (ts > ds->last_ts || ts + 10 < ds->last_ts))
         ds->last_ts = ts;
-    if (ds->base_ts == MP_NOPTS_VALUE)
-        ds->base_ts = ds->last_ts;
 
     MP_DBG(in, "append packet to %s: size=%d pts=%f dts=%f pos=%"PRIi64" "
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
-           dp->len, dp->pts, dp->dts, dp->pos, ds->packs, ds->bytes);
+           dp->len, dp->pts, dp->dts, dp->pos, packs + 1,
+           ds_queued_bytes(ds) + dp->len);
+
+    struct demux_queue_entry entry = {
+        .pkt = dp,
+        .ts = ds->last_ts,
+    };
+    if (overflow) {
+        MP_TARRAY_APPEND(ds, ds->overflow, ds->num_overflow, entry);
+        ds->overflow_bytes += dp->len;
+    } else {
+        // Publish the packet to the user thread. The entry must be complete
+        // before queue_in is incremented.
+        ds->queue[queue_in % QUEUE_SIZE] = entry;
+        atomic_fetch_add(&ds->bytes_in, dp->len);
+        atomic_store(&ds->queue_in, queue_in + 1);
+    }
 
-    if (ds->in->wakeup_cb && !ds->head->next)
+    if (ds->in->wakeup_cb && !packs)
         ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
     pthread_cond_signal(&in->wakeup);
     pthread_mutex_unlock(&in->lock);
@@ -378,6 +536,8 @@ static bool read_packet(struct demux_internal *in)
     in->eof = false;
     in->idle = true;
 
+    drain_overflow(in);
+
     // Check if we need to read a new packet. We do this if all queues are below
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
@@ -385,13 +545,15 @@ static bool read_packet(struct demux_internal *in)
     size_t packs = 0, bytes = 0;
     for (int n = 0; n < in->d_buffer->num_streams; n++) {
         struct demux_stream *ds = in->d_buffer->streams[n]->ds;
+        size_t ds_packs = ds_queued_packs(ds);
+        double base_ts = ds_reader_ts(ds);
         active |= ds->active;
-        read_more |= ds->active && !ds->head;
-        packs += ds->packs;
-        bytes += ds->bytes;
+        read_more |= ds->active && !ds_packs;
+        packs += ds_packs + ds_overflow_packs(ds);
+        bytes += ds_queued_bytes(ds) + ds->overflow_bytes;
         if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
-            ds->last_ts >= ds->base_ts)
-            read_more |= ds->last_ts - ds->base_ts < in->min_secs;
+            ds->last_ts >= base_ts)
+            read_more |= ds->last_ts - base_ts < in->min_secs;
     }
     MP_DBG(in, "packets=%zd, bytes=%zd, active=%d, more=%d\n",
            packs, bytes, active, read_more);
@@ -403,13 +565,14 @@ static bool read_packet(struct demux_internal *in)
                 struct demux_stream *ds = in->d_buffer->streams[n]->ds;
                 if (ds->selected) {
                     MP_ERR(in, "  %s/%d: %zd packets, %zd bytes\n",
-                           stream_type_name(ds->type), n, ds->packs, ds->bytes);
+                           stream_type_name(ds->type), n,
+                           ds_queued_packs(ds), ds_queued_bytes(ds));
                 }
             }
         }
         for (int n = 0; n < in->d_buffer->num_streams; n++) {
             struct demux_stream *ds = in->d_buffer->streams[n]->ds;
-            ds->eof |= !ds->head;
+            ds->eof |= !ds_queued_packs(ds);
         }
         pthread_cond_signal(&in->wakeup);
         return false;
@@ -454,7 +617,8 @@ static void ds_get_packets(struct demux_stream *ds)
     MP_DBG(in, "reading packet for %s\n", t);
     in->eof = false; // force retry
     ds->eof = false;
-    while (ds->selected && !ds->head && !ds->eof) {
+    ds_drain_overflow(ds);
+    while (ds->selected && !ds_has_packet(ds) && !ds->eof) {
         ds->active = true;
         // Note: the following code marks EOF if it can't continue
         if (in->threading) {
@@ -480,7 +644,7 @@ static void start_refreshing(struct demux_internal *in)
     for (int n = 0; n < demux->num_streams; n++) {
         struct demux_stream *ds = demux->streams[n]->ds;
         if (ds->type == STREAM_VIDEO || ds->type == STREAM_AUDIO)
-            start_ts = MP_PTS_MIN(start_ts, ds->base_ts);
+            start_ts = MP_PTS_MIN(start_ts, ds_reader_ts(ds));
     }
 
     if (start_ts == MP_NOPTS_VALUE || !demux->desc->seek || !demux->seekable ||
@@ -553,9 +717,12 @@ static void *demux_thread(void *pctx)
             execute_seek(in);
             continue;
         }
+        drain_overflow(in);
         if (!in->eof) {
-            if (read_packet(in))
+            if (read_packet(in)) {
+                atomic_store(&in->thread_waiting, false);
                 continue; // read_packet unlocked, so recheck conditions
+            }
         }
         if (in->force_cache_update) {
             pthread_mutex_unlock(&in->lock);
@@ -564,24 +731,95 @@ static void *demux_thread(void *pctx)
             in->force_cache_update = false;
             continue;
         }
+        // The user thread removes packets without locking. Announce that
+        // we're going to wait before checking the queues a last time, so
+        // that it either sees the flag, or we see the removed packets.
+        if (!atomic_load(&in->thread_waiting)) {
+            atomic_store(&in->thread_waiting, true);
+            continue;
+        }
         pthread_cond_signal(&in->wakeup);
         pthread_cond_wait(&in->wakeup, &in->lock);
+        atomic_store(&in->thread_waiting, false);
     }
     pthread_mutex_unlock(&in->lock);
     return NULL;
 }
 
-static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+// Whether a cached seek can resume decoding at this packet.
+static bool is_seek_point(struct demux_stream *ds, struct demux_packet *dp)
+{
+    return dp->keyframe || ds->type != STREAM_VIDEO;
+}
+
+// Free the oldest packets in the back buffer until it fits into the limit.
+// Whole keyframe ranges are dropped at once, so that the back buffer always
+// starts with a seek point.
+static void prune_back_buffer(struct demux_stream *ds)
+{
+    while (ds->back_bytes > ds->in->max_back_bytes) {
+        do {
+            struct demux_packet *dp = ds->back_head;
+            ds->back_head = dp->next;
+            ds->back_bytes -= dp->len;
+            ds->back_packs--;
+            free_demux_packet(dp);
+        } while (ds->back_head != ds->reader && !is_seek_point(ds, ds->back_head));
+    }
+    if (!ds->back_head)
+        ds->back_tail = NULL;
+}
+
+// Remove the oldest packet from the queue, and append it to the back buffer
+// (after reader). User thread only.
+static struct demux_packet *queue_to_back_buffer(struct demux_stream *ds)
 {
-    if (!ds->head)
+    uint64_t out = atomic_load(&ds->queue_out);
+    if (out == atomic_load(&ds->queue_in))
         return NULL;
-    struct demux_packet *pkt = ds->head;
-    ds->head = pkt->next;
+    struct demux_packet *pkt = ds->queue[out % QUEUE_SIZE].pkt;
+    atomic_fetch_add(&ds->bytes_out, pkt->len);
+    atomic_store(&ds->queue_out, out + 1);
+    if (ds->back_tail) {
+        ds->back_tail->next = pkt;
+    } else {
+        ds->back_head = pkt;
+    }
+    ds->back_tail = pkt;
+    if (!ds->reader)
+        ds->reader = pkt;
+    ds->replay_packs++;
+    ds->replay_bytes += pkt->len;
+    return pkt;
+}
+
+// Doesn't need the lock if called from the user thread.
+static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+{
+    struct demux_packet *pkt = NULL;
+    if (ds->in->max_back_bytes) {
+        if (!ds->reader && !queue_to_back_buffer(ds))
+            return NULL;
+        // Keep the packet in the back buffer, and return a new reference.
+        pkt = ds->reader;
+        ds->reader = pkt->next;
+        ds->replay_packs--;
+        ds->replay_bytes -= pkt->len;
+        ds->back_packs++;
+        ds->back_bytes += pkt->len;
+        pkt = demux_copy_packet(pkt);
+        prune_back_buffer(ds);
+        if (!pkt)
+            return NULL;
+    } else {
+        uint64_t out = atomic_load(&ds->queue_out);
+        if (out == atomic_load(&ds->queue_in))
+            return NULL;
+        pkt = ds->queue[out % QUEUE_SIZE].pkt;
+        atomic_fetch_add(&ds->bytes_out, pkt->len);
+        atomic_store(&ds->queue_out, out + 1);
+    }
     pkt->next = NULL;
-    if (!ds->head)
-        ds->tail = NULL;
-    ds->bytes -= pkt->len;
-    ds->packs--;
 
     double ts = pkt->dts == MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
     if (ts != MP_NOPTS_VALUE)
@@ -610,9 +848,20 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
     return pkt;
 }
 
+// Wake up the demuxer thread if it's waiting, after packets were removed
+// from a queue without holding the lock.
+static void wakeup_thread(struct demux_internal *in)
+{
+    if (atomic_load(&in->thread_waiting)) {
+        pthread_mutex_lock(&in->lock);
+        pthread_cond_signal(&in->wakeup);
+        pthread_mutex_unlock(&in->lock);
+    }
+}
+
 // Read a packet from the given stream. The returned packet belongs to the
-// caller, who has to free it with talloc_free(). Might block. Returns NULL
-// on EOF.
+// caller, who has to free it with free_demux_packet(). Might block. Returns
+// NULL on EOF.
 struct demux_packet *demux_read_packet(struct sh_stream *sh)
 {
     struct demux_stream *ds = sh ? sh->ds : NULL;
@@ -643,8 +892,15 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
     *out_pkt = NULL;
     if (ds) {
         if (ds->in->threading) {
-            pthread_mutex_lock(&ds->in->lock);
+            // Fast path: if a packet is queued, don't touch the lock.
             *out_pkt = dequeue_packet(ds);
+            if (*out_pkt) {
+                wakeup_thread(ds->in);
+                return 1;
+            }
+            pthread_mutex_lock(&ds->in->lock);
+            ds_drain_overflow(ds);
+            *out_pkt = dequeue_packet(ds); // could have been added meanwhile
             r = *out_pkt ? 1 : ((ds->eof || !ds->selected) ? -1 : 0);
             ds->active = ds->selected; // enable readahead
             ds->in->eof = false; // force retry
@@ -667,23 +923,19 @@ double demux_get_next_pts(struct sh_stream *sh)
     if (sh) {
         pthread_mutex_lock(&sh->ds->in->lock);
         ds_get_packets(sh->ds);
-        if (sh->ds->head)
-            res = sh->ds->head->pts;
+        struct demux_packet *pkt = ds_peek_packet(sh->ds);
+        if (pkt)
+            res = pkt->pts;
         pthread_mutex_unlock(&sh->ds->in->lock);
     }
     return res;
 }
 
 // Return whether a packet is queued. Never blocks, never forces any reads.
+// Doesn't lock either.
 bool demux_has_packet(struct sh_stream *sh)
 {
-    bool has_packet = false;
-    if (sh) {
-        pthread_mutex_lock(&sh->ds->in->lock);
-        has_packet = sh->ds->head;
-        pthread_mutex_unlock(&sh->ds->in->lock);
-    }
-    return has_packet;
+    return sh && ds_has_packet(sh->ds);
 }
 
 // Read and return any packet we find.
@@ -936,6 +1188,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .glog = log,
         .filename = talloc_strdup(demuxer, stream->url),
         .events = DEMUX_EVENT_ALL,
+        .packet_pool = demux_packet_pool_create(),
     };
     demuxer->seekable = stream->seekable;
     if (demuxer->stream->uncached_stream &&
@@ -951,6 +1204,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = demuxer->opts->demuxer_min_secs,
         .min_packs = demuxer->opts->demuxer_min_packs,
         .min_bytes = demuxer->opts->demuxer_min_bytes,
+        .max_back_bytes = demuxer->opts->demuxer_max_back_bytes,
     };
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
@@ -1096,6 +1350,125 @@ void demux_flush(demuxer_t *demuxer)
     pthread_mutex_unlock(&demuxer->in->lock);
 }
 
+// Return the n-th packet of the cached packets of the stream (the back buffer,
+// followed by the queue), or NULL if n is out of range. "prev" is the
+// (n-1)-th packet, or NULL if n==0. Must be called locked, from the user thread.
+static struct demux_packet *ds_cached_packet(struct demux_stream *ds,
+                                             struct demux_packet *prev,
+                                             size_t n)
+{
+    if (n < ds->back_packs + ds->replay_packs)
+        return prev ? prev->next : ds->back_head;
+    n -= ds->back_packs + ds->replay_packs;
+    if (n >= ds_queued_packs(ds))
+        return NULL;
+    return ds->queue[(atomic_load(&ds->queue_out) + n) % QUEUE_SIZE].pkt;
+}
+
+// Return the packet a seek to pts would resume reading from, or NULL if the
+// cached packets don't cover pts.
+static struct demux_packet *find_seek_target(struct demux_stream *ds,
+                                             double pts, int flags)
+{
+    struct demux_packet *target = NULL;
+    struct demux_packet *dp = NULL;
+    for (size_t n = 0; (dp = ds_cached_packet(ds, dp, n)); n++) {
+        double ts = PTS_OR_DEF(dp->pts, dp->dts);
+        if (ts == MP_NOPTS_VALUE || !is_seek_point(ds, dp))
+            continue;
+        if (flags & SEEK_FORWARD) {
+            if (ts >= pts)
+                return dp;
+        } else if (ts <= pts) {
+            target = dp;
+        }
+    }
+    // Can't know whether there's a better seek point between the last
+    // demuxed packet and pts.
+    if (target && (ds->last_ts == MP_NOPTS_VALUE || pts > ds->last_ts))
+        target = NULL;
+    return target;
+}
+
+// Make target the next packet returned by dequeue_packet(). If it's still in
+// the queue, move all packets up to it into the back buffer. If target is
+// NULL, the queue is emptied, and only new packets will be returned.
+// Must be called locked, from the user thread.
+static void ds_set_reader(struct demux_stream *ds, struct demux_packet *target)
+{
+    bool in_back_buffer = false;
+    for (struct demux_packet *dp = ds->back_head; dp; dp = dp->next)
+        in_back_buffer |= dp == target;
+    if (!in_back_buffer) {
+        struct demux_packet *dp;
+        while ((dp = queue_to_back_buffer(ds)) && dp != target) {}
+    }
+
+    ds->reader = target;
+    ds->back_packs = ds->back_bytes = ds->replay_packs = ds->replay_bytes = 0;
+    bool ahead = false;
+    for (struct demux_packet *dp = ds->back_head; dp; dp = dp->next) {
+        ahead |= dp == ds->reader;
+        if (ahead) {
+            ds->replay_packs++;
+            ds->replay_bytes += dp->len;
+        } else {
+            ds->back_packs++;
+            ds->back_bytes += dp->len;
+        }
+    }
+}
+
+// Try to serve the seek from the packet queues, without touching the demuxer.
+// Succeeds only if all selected audio/video streams have the target cached.
+// must be called locked
+static bool try_cached_seek(struct demux_internal *in, double pts, int flags)
+{
+    struct demuxer *demux = in->d_buffer;
+
+    if (!in->max_back_bytes || in->seeking || demux->ts_resets_possible ||
+        (flags & SEEK_FACTOR) || !(flags & SEEK_ABSOLUTE))
+        return false;
+
+    bool have_av = false;
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (!ds->selected || (ds->type != STREAM_VIDEO && ds->type != STREAM_AUDIO))
+            continue;
+        if (!find_seek_target(ds, pts, flags))
+            return false;
+        have_av = true;
+    }
+    if (!have_av)
+        return false;
+
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+        struct demux_packet *target = find_seek_target(ds, pts, flags);
+        if (!target && ds->type != STREAM_VIDEO && ds->type != STREAM_AUDIO) {
+            // Sparse streams (subtitles): resume at the first packet after pts.
+            struct demux_packet *dp = NULL;
+            for (size_t i = 0; (dp = ds_cached_packet(ds, dp, i)); i++) {
+                if (PTS_OR_DEF(dp->pts, dp->dts) >= pts) {
+                    target = dp;
+                    break;
+                }
+            }
+        }
+        ds_set_reader(ds, target);
+        ds->base_ts = target ? PTS_OR_DEF(target->dts, target->pts)
+                             : ds->last_ts;
+        ds->last_br_ts = MP_NOPTS_VALUE;
+        ds->last_br_bytes = 0;
+        ds->bitrate = -1;
+    }
+
+    in->d_user->filepos = -1;
+    return true;
+}
+
 int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 {
     struct demux_internal *in = demuxer->in;
@@ -1124,6 +1497,12 @@ int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 
     pthread_mutex_lock(&in->lock);
 
+    if (try_cached_seek(in, rel_seek_secs, flags)) {
+        MP_VERBOSE(in, "Seeking within the packet cache.\n");
+        pthread_mutex_unlock(&in->lock);
+        return 1;
+    }
+
     flush_locked(demuxer);
     in->seeking = true;
     in->seek_flags = flags;
@@ -1173,6 +1552,24 @@ void demuxer_switch_track(struct demuxer *demuxer, enum stream_type type,
     }
 }
 
+// Read ahead packets of all selected streams, as if they were being read by a
+// decoder. With the demuxer thread running, this fills the packet queues in the
+// background, e.g. right after a seek to a position that will be played later.
+void demux_prefetch(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    for (int n = 0; n < in->d_buffer->num_streams; n++) {
+        struct demux_stream *ds = in->d_buffer->streams[n]->ds;
+        ds->active = ds->selected;
+    }
+    in->eof = false;
+    pthread_cond_signal(&in->wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
 void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
                           bool selected)
 {
@@ -1278,6 +1675,7 @@ static void update_cache(struct demux_internal *in)
 
     // Don't lock while querying the stream.
     double time_length = -1;
+    double index_progress = -1;
     struct mp_tags *stream_metadata = NULL;
     int64_t stream_size = -1;
     int64_t stream_cache_size = -1;
@@ -1292,6 +1690,8 @@ static void update_cache(struct demux_internal *in)
     if (demuxer->desc->control) {
         demuxer->desc->control(demuxer, DEMUXER_CTRL_GET_TIME_LENGTH,
                                &time_length);
+        demuxer->desc->control(demuxer, DEMUXER_CTRL_GET_INDEX_PROGRESS,
+                               &index_progress);
         if (need_nav_event)
             demuxer->desc->control(demuxer, DEMUXER_CTRL_GET_NAV_EVENT, &nav_event);
     }
@@ -1304,6 +1704,7 @@ static void update_cache(struct demux_internal *in)
 
     pthread_mutex_lock(&in->lock);
     in->time_length = time_length;
+    in->index_progress = index_progress;
     in->stream_size = stream_size;
     in->stream_cache_size = stream_cache_size;
     in->stream_cache_fill = stream_cache_fill;
@@ -1365,6 +1766,18 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             return DEMUXER_CTRL_NOTIMPL;
         *(double *)arg = in->time_length;
         return DEMUXER_CTRL_OK;
+    case DEMUXER_CTRL_GET_INDEX_PROGRESS:
+        // Indexing runs in the background; while it does, make the thread
+        // query it again. There's nothing to update once it's done, or if
+        // the demuxer doesn't support it.
+        if (in->index_progress >= 0 && in->index_progress < 1) {
+            in->force_cache_update = true;
+            pthread_cond_signal(&in->wakeup);
+        }
+        if (in->index_progress < 0)
+            return DEMUXER_CTRL_NOTIMPL;
+        *(double *)arg = in->index_progress;
+        return DEMUXER_CTRL_OK;
     case DEMUXER_CTRL_STREAM_CTRL: {
         struct demux_ctrl_stream_ctrl *c = arg;
         int r = cached_stream_control(in, c->ctrl, c->arg);
@@ -1398,10 +1811,15 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         for (int n = 0; n < in->d_user->num_streams; n++) {
             struct demux_stream *ds = in->d_user->streams[n]->ds;
             if (ds->active) {
-                r->underrun |= !ds->head && !ds->eof;
-                r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], ds->base_ts);
+                double base_ts = ds->base_ts;
+                struct demux_packet *next = ds_peek_packet(ds);
+                if (base_ts == MP_NOPTS_VALUE && next)
+                    base_ts = PTS_OR_DEF(next->dts, next->pts);
+                r->underrun |= !next && !ds->eof;
+                r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], base_ts);
                 r->ts_range[1] = MP_PTS_MIN(r->ts_range[1], ds->last_ts);
-                num_packets += ds->packs;
+                num_packets += ds_queued_packs(ds) + ds_overflow_packs(ds) +
+                               ds->replay_packs;
             }
         }
         r->idle = (in->idle && !r->underrun) || r->eof;
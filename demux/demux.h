@@ -49,6 +49,7 @@ enum demux_ctrl {
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_NAV_EVENT,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
+    DEMUXER_CTRL_GET_INDEX_PROGRESS, // double* (0-1)
 };
 
 struct demux_ctrl_reader_state {
@@ -169,6 +170,8 @@ struct demuxer_params {
     struct matroska_segment_uid *matroska_wanted_uids;
     int matroska_wanted_segment;
     bool *matroska_was_valid;
+    // If set, only read the segment UID into it (opening the file then fails)
+    struct matroska_segment_uid *matroska_probed_uid;
     bool expect_subtitle;
     bool disable_cache; // demux_open_url() only
 };
@@ -229,6 +232,10 @@ typedef struct demuxer {
 
     struct demux_internal *in; // internal to demux.c
 
+    // Demuxer implementations should allocate packets from this pool (with
+    // demux_packet_pool_new() etc.). Thread-safe.
+    struct demux_packet_pool *packet_pool;
+
     // Since the demuxer can run in its own thread, and the stream is not
     // thread-safe, only the demuxer is allowed to access the stream directly.
     // You can freely use demux_stream_control() to send STREAM_CTRLs, or use
@@ -272,6 +279,7 @@ bool demux_cancel_test(struct demuxer *demuxer);
 
 void demux_flush(struct demuxer *demuxer);
 int demux_seek(struct demuxer *demuxer, double rel_seek_secs, int flags);
+void demux_prefetch(struct demuxer *demuxer);
 void demux_set_enable_refresh_seeks(struct demuxer *demuxer, bool enabled);
 
 int demux_control(struct demuxer *demuxer, int cmd, void *arg);
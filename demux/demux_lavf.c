@@ -43,6 +43,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "index_cache.h"
 #include "stheader.h"
 #include "options/m_option.h"
 #include "options/path.h"
@@ -165,6 +166,8 @@ typedef struct lavf_priv {
     int cur_program;
     char *mime_type;
     bool merge_track_metadata;
+    bool use_index_cache;
+    int index_cache_entries; // number of index entries loaded from the cache
 } lavf_priv_t;
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -692,6 +695,73 @@ static int interrupt_cb(void *ctx)
     return mp_cancel_test(demuxer->stream->cancel);
 }
 
+static int count_index_entries(AVFormatContext *avfc)
+{
+    int num = 0;
+    for (int n = 0; n < avfc->nb_streams; n++)
+        num += avfc->streams[n]->nb_index_entries;
+    return num;
+}
+
+// Formats with AVFMT_GENERIC_INDEX build the index while reading packets, so
+// seeking to positions that weren't read yet requires scanning the file.
+static void load_index_cache(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+
+    priv->use_index_cache = (priv->avif_flags & AVFMT_GENERIC_INDEX) &&
+                            !(avfc->flags & AVFMT_FLAG_IGNIDX);
+    if (!priv->use_index_cache)
+        return;
+
+    char *type = talloc_asprintf(NULL, "lavf/%s", priv->avif->name);
+    struct demux_index_cache *cache = demux_index_cache_load(demuxer, type, 0);
+    talloc_free(type);
+    if (!cache)
+        return;
+    for (size_t n = 0; n < cache->num_entries; n++) {
+        struct demux_index_cache_entry *e = &cache->entries[n];
+        if (e->stream >= 0 && e->stream < avfc->nb_streams) {
+            av_add_index_entry(avfc->streams[e->stream], e->pos, e->ts,
+                               e->size, e->distance, e->flags);
+        }
+    }
+    talloc_free(cache);
+    priv->index_cache_entries = count_index_entries(avfc);
+}
+
+static void store_index_cache(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+
+    int num = count_index_entries(avfc);
+    if (!priv->use_index_cache || num <= priv->index_cache_entries)
+        return;
+
+    struct demux_index_cache_entry *entries =
+        talloc_array(NULL, struct demux_index_cache_entry, num);
+    size_t num_entries = 0;
+    for (int n = 0; n < avfc->nb_streams; n++) {
+        AVStream *st = avfc->streams[n];
+        for (int i = 0; i < st->nb_index_entries; i++) {
+            AVIndexEntry *ie = &st->index_entries[i];
+            entries[num_entries++] = (struct demux_index_cache_entry){
+                .stream = n,
+                .flags = ie->flags,
+                .ts = ie->timestamp,
+                .pos = ie->pos,
+                .size = ie->size,
+                .distance = ie->min_distance,
+            };
+        }
+    }
+    char *type = talloc_asprintf(entries, "lavf/%s", priv->avif->name);
+    demux_index_cache_store(demuxer, type, 0, entries, num_entries);
+    talloc_free(entries);
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     struct MPOpts *opts = demuxer->opts;
@@ -817,6 +887,8 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 
     add_new_streams(demuxer);
 
+    load_index_cache(demuxer);
+
     // Often useful with OGG audio-only files, which have metadata in the audio
     // track metadata instead of the main metadata.
     if (demuxer->num_streams == 1) {
@@ -870,7 +942,8 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
         return 1; // don't signal EOF if skipping a packet
     }
 
-    struct demux_packet *dp = new_demux_packet_from_avpacket(pkt);
+    struct demux_packet *dp =
+        demux_packet_pool_new_from_avpacket(demux->packet_pool, pkt);
     if (!dp) {
         av_free_packet(pkt);
         return 1;
@@ -1068,6 +1141,7 @@ static void demux_close_lavf(demuxer_t *demuxer)
     lavf_priv_t *priv = demuxer->priv;
     if (priv) {
         if (priv->avfc) {
+            store_index_cache(demuxer);
             av_freep(&priv->avfc->key);
             avformat_close_input(&priv->avfc);
         }
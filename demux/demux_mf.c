@@ -29,6 +29,7 @@
 #include "options/options.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/prefetch.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -45,6 +46,7 @@ typedef struct mf {
     char **names;
     // optional
     struct stream **streams;
+    struct mp_prefetch *pf;     // reads the file of frame n with --mf-prefetch
 } mf_t;
 
 
@@ -157,6 +159,41 @@ static mf_t *open_mf_single(void *talloc_ctx, struct mp_log *log, char *filename
     return mf;
 }
 
+static bstr read_file(const char *filename, struct mpv_global *global,
+                      void *talloc_ctx)
+{
+    bstr data = {0};
+    struct stream *stream = stream_open(filename, global);
+    if (stream) {
+        data = stream_read_complete(stream, talloc_ctx, MF_MAX_FILE_SIZE);
+        free_stream(stream);
+    }
+    return data;
+}
+
+static void prefetch_file(void *ctx, struct mp_prefetch_slot *slot)
+{
+    struct demuxer *demuxer = ctx;
+    mf_t *mf = demuxer->priv;
+    talloc_free(slot->data);
+    bstr data = read_file(mf->names[slot->key], demuxer->global, slot);
+    slot->data = data.start;
+    slot->len = data.len;
+}
+
+// Return the contents of the file of the given frame, and queue the next ones.
+static bstr prefetch_read(demuxer_t *demuxer, int frame)
+{
+    mf_t *mf = demuxer->priv;
+    struct mp_prefetch_slot *slot = mp_prefetch_wait(mf->pf, frame);
+    if (!slot)
+        return read_file(mf->names[frame], demuxer->global, NULL);
+    bstr data = {talloc_steal(NULL, slot->data), slot->len};
+    slot->data = NULL;
+    mp_prefetch_release(mf->pf, slot, true);
+    return data;
+}
+
 static void demux_seek_mf(demuxer_t *demuxer, double rel_seek_secs, int flags)
 {
     mf_t *mf = demuxer->priv;
@@ -182,33 +219,29 @@ static int demux_mf_fill_buffer(demuxer_t *demuxer)
     if (mf->curr_frame >= mf->nr_of_files)
         return 0;
 
-    struct stream *entry_stream = NULL;
-    if (mf->streams)
-        entry_stream = mf->streams[mf->curr_frame];
-    struct stream *stream = entry_stream;
-    if (!stream) {
+    bstr data = {0};
+    if (mf->pf) {
+        data = prefetch_read(demuxer, mf->curr_frame);
+    } else if (mf->streams) {
+        struct stream *stream = mf->streams[mf->curr_frame];
+        stream_seek(stream, 0);
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+    } else {
         char *filename = mf->names[mf->curr_frame];
         if (filename)
-            stream = stream_open(filename, demuxer->global);
+            data = read_file(filename, demuxer->global, NULL);
     }
 
-    if (stream) {
-        stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->fps;
-                dp->keyframe = true;
-                demux_add_packet(demuxer->streams[0], dp);
-            }
+    if (data.len) {
+        demux_packet_t *dp = demux_packet_pool_new(demuxer->packet_pool, data.len);
+        if (dp) {
+            memcpy(dp->buffer, data.start, data.len);
+            dp->pts = mf->curr_frame / mf->sh->fps;
+            dp->keyframe = true;
+            demux_add_packet(demuxer->streams[0], dp);
         }
-        talloc_free(data.start);
     }
-
-    if (stream && stream != entry_stream)
-        free_stream(stream);
+    talloc_free(data.start);
 
     mf->curr_frame++;
     return 1;
@@ -328,6 +361,16 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demuxer->priv = (void *)mf;
     demuxer->seekable = true;
 
+    int depth = demuxer->opts->mf_prefetch;
+    if (!mf->streams && mf->nr_of_files > 1 && depth > 0) {
+        mf->pf = mp_prefetch_create(depth, mf->nr_of_files, prefetch_file,
+                                    demuxer, "mf prefetch");
+        if (mf->pf) {
+            MP_VERBOSE(demuxer, "Reading up to %d files ahead.\n",
+                       mp_prefetch_num_threads(mf->pf));
+        }
+    }
+
     return 0;
 
 error:
@@ -336,6 +379,9 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (mf)
+        mp_prefetch_destroy(mf->pf);
 }
 
 static int demux_control_mf(demuxer_t *demuxer, int cmd, void *arg)
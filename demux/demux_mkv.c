@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -52,10 +53,13 @@
 #include "stheader.h"
 #include "ebml.h"
 #include "matroska.h"
+#include "mkv_index.h"
+#include "index_cache.h"
 #include "codec_tags.h"
 #include "video/img_fourcc.h"
 
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 static const unsigned char sipr_swaps[38][2] = {
     {0,63},{1,22},{2,44},{3,90},{5,81},{7,31},{8,86},{9,58},{10,36},{12,68},
@@ -138,17 +142,8 @@ typedef struct mkv_track {
     /* generic content encoding support */
     mkv_content_encoding_t *encodings;
     int num_encodings;
-
-    /* latest added index entry for this track */
-    size_t last_index_entry;
 } mkv_track_t;
 
-typedef struct mkv_index {
-    int tnum;
-    uint64_t timecode, duration;
-    uint64_t filepos; // position of the cluster which contains the packet
-} mkv_index_t;
-
 typedef struct mkv_demuxer {
     int64_t segment_start, segment_end;
 
@@ -164,9 +159,10 @@ typedef struct mkv_demuxer {
     uint64_t cluster_start;
     uint64_t cluster_end;
 
-    mkv_index_t *indexes;
-    size_t num_indexes;
+    struct mkv_index_table *index;
     bool index_complete;
+    bool index_cache_loaded;
+    size_t index_cache_entries; // number of entries in the index cache
 
     struct header_elem {
         int32_t id;
@@ -182,6 +178,8 @@ typedef struct mkv_demuxer {
 
     bool index_has_durations;
 
+    struct mkv_index_scanner *scanner;
+
     bool eof_warning;
 } mkv_demuxer_t;
 
@@ -191,6 +189,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs;
     int probe_duration;
     int fix_timestamps;
+    int background_index;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -200,6 +199,7 @@ const struct m_sub_options demux_mkv_conf = {
                    M_OPT_MIN, .min = 0),
         OPT_FLAG("probe-video-duration", probe_duration, 0),
         OPT_FLAG("fix-timestamps", fix_timestamps, 0),
+        OPT_FLAG("background-index", background_index, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -219,6 +219,7 @@ const struct m_sub_options demux_mkv_conf = {
 #define NUM_SUB_PREROLL_PACKETS 500
 
 static void probe_last_timestamp(struct demuxer *demuxer);
+static void start_index_scanner(struct demuxer *demuxer, int64_t start);
 
 #define AAC_SYNC_EXTENSION_TYPE 0x02b7
 static int aac_get_sample_rate_index(uint32_t sample_rate)
@@ -391,6 +392,11 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
             MP_VERBOSE(demuxer, "\n");
         }
     }
+    if (demuxer->params && demuxer->params->matroska_probed_uid) {
+        *demuxer->params->matroska_probed_uid = demuxer->matroska_data.uid;
+        res = -2;
+        goto out;
+    }
     if (demuxer->params && demuxer->params->matroska_wanted_uids) {
         if (info.n_segment_uid) {
             for (int i = 0; i < demuxer->params->matroska_num_wanted_uids; i++) {
@@ -563,7 +569,6 @@ static void parse_trackentry(struct demuxer *demuxer,
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
     struct mkv_track *track = talloc_zero(NULL, struct mkv_track);
-    track->last_index_entry = (size_t)-1;
     track->parser_tmp = talloc_new(track);
 
     track->tnum = entry->track_number;
@@ -681,23 +686,6 @@ static int demux_mkv_read_tracks(demuxer_t *demuxer)
     return 0;
 }
 
-static void cue_index_add(demuxer_t *demuxer, int track_id, uint64_t filepos,
-                          uint64_t timecode, uint64_t duration)
-{
-    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
-
-    MP_TARRAY_GROW(mkv_d, mkv_d->indexes, mkv_d->num_indexes);
-
-    mkv_d->indexes[mkv_d->num_indexes] = (mkv_index_t) {
-        .tnum = track_id,
-        .filepos = filepos,
-        .timecode = timecode,
-        .duration = duration,
-    };
-
-    mkv_d->num_indexes++;
-}
-
 static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
                                uint64_t filepos,
                                uint64_t timecode, uint64_t duration)
@@ -709,14 +697,11 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
 
     mkv_d->index_has_durations = true;
 
-    if (track->last_index_entry != (size_t)-1) {
-        mkv_index_t *index = &mkv_d->indexes[track->last_index_entry];
-        // Never add blocks which are already covered by the index.
-        if (index->timecode >= timecode)
-            return;
-    }
-    cue_index_add(demuxer, track->tnum, filepos, timecode, duration);
-    track->last_index_entry = mkv_d->num_indexes - 1;
+    mkv_index_t *index = mkv_index_last(mkv_d->index, track->tnum);
+    // Never add blocks which are already covered by the index.
+    if (index && index->timecode >= timecode)
+        return;
+    mkv_index_add(mkv_d->index, track->tnum, filepos, timecode, duration);
 }
 
 static int demux_mkv_read_cues(demuxer_t *demuxer)
@@ -736,7 +721,7 @@ static int demux_mkv_read_cues(demuxer_t *demuxer)
     if (ebml_read_element(s, &parse_ctx, &cues, &ebml_cues_desc) < 0)
         return -1;
 
-    mkv_d->num_indexes = 0;
+    mkv_index_table_reset(mkv_d->index);
     mkv_d->index_has_durations = false;
 
     for (int i = 0; i < cues.n_cue_point; i++) {
@@ -750,7 +735,7 @@ static int demux_mkv_read_cues(demuxer_t *demuxer)
             struct ebml_cue_track_positions *trackpos =
                 &cuepoint->cue_track_positions[c];
             uint64_t pos = mkv_d->segment_start + trackpos->cue_cluster_position;
-            cue_index_add(demuxer, trackpos->cue_track, pos,
+            mkv_index_add(mkv_d->index, trackpos->cue_track, pos,
                           time, trackpos->cue_duration);
             mkv_d->index_has_durations |= trackpos->n_cue_duration > 0;
             MP_DBG(demuxer, "|+ found cue point for track %" PRIu64
@@ -1794,6 +1779,7 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     mkv_d->segment_start = stream_tell(s);
     mkv_d->segment_end = end_pos;
     mkv_d->a_skip_preroll = 1;
+    mkv_d->index = mkv_index_table_create(mkv_d);
 
     if (demuxer->params && demuxer->params->matroska_was_valid)
         *demuxer->params->matroska_was_valid = true;
@@ -1858,6 +1844,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     if (opts->demux_mkv->probe_duration)
         probe_last_timestamp(demuxer);
 
+    start_index_scanner(demuxer, start_pos);
+
     return 0;
 }
 
@@ -2036,8 +2024,9 @@ static bool handle_realaudio(demuxer_t *demuxer, mkv_track_t *track,
             goto error;
         // Release all the audio packets
         for (int x = 0; x < sph * w / apk_usize; x++) {
-            dp = new_demux_packet_from(track->audio_buf + x * apk_usize,
-                                        apk_usize);
+            dp = demux_packet_pool_new_from(demuxer->packet_pool,
+                                            track->audio_buf + x * apk_usize,
+                                            apk_usize);
             if (!dp)
                 goto error;
             /* Put timestamp only on packets that correspond to original
@@ -2051,7 +2040,7 @@ static bool handle_realaudio(demuxer_t *demuxer, mkv_track_t *track,
     }
 
 error:
-    talloc_free(orig);
+    free_demux_packet(orig);
     return true;
 }
 
@@ -2168,10 +2157,11 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         int size = dp->len;
         uint8_t *parsed;
         if (libav_parse_wavpack(track, dp->buffer, &parsed, &size) >= 0) {
-            struct demux_packet *new = new_demux_packet_from(parsed, size);
+            struct demux_packet *new =
+                demux_packet_pool_new_from(demuxer->packet_pool, parsed, size);
             if (new) {
                 demux_packet_copy_attribs(new, dp);
-                talloc_free(dp);
+                free_demux_packet(dp);
                 demux_add_packet(stream, new);
                 return;
             }
@@ -2180,13 +2170,14 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
     if (track->codec_id && strcmp(track->codec_id, MKV_V_PRORES) == 0) {
         size_t newlen = dp->len + 8;
-        struct demux_packet *new = new_demux_packet(newlen);
+        struct demux_packet *new =
+            demux_packet_pool_new(demuxer->packet_pool, newlen);
         if (new) {
             AV_WB32(new->buffer + 0, newlen);
             AV_WB32(new->buffer + 4, MKBETAG('i', 'c', 'p', 'f'));
             memcpy(new->buffer + 8, dp->buffer, dp->len);
             demux_packet_copy_attribs(new, dp);
-            talloc_free(dp);
+            free_demux_packet(dp);
             demux_add_packet(stream, new);
             return;
         }
@@ -2221,7 +2212,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         dp->len -= len;
         dp->pos += len;
         if (size) {
-            struct demux_packet *new = new_demux_packet_from(data, size);
+            struct demux_packet *new =
+                demux_packet_pool_new_from(demuxer->packet_pool, data, size);
             if (!new)
                 break;
             demux_packet_copy_attribs(new, dp);
@@ -2239,7 +2231,7 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
     if (dp->len) {
         demux_add_packet(stream, dp);
     } else {
-        talloc_free(dp);
+        free_demux_packet(dp);
     }
 }
 
@@ -2250,6 +2242,7 @@ struct block_info {
     mkv_track_t *track;
     bstr data;
     void *alloc;
+    AVBufferRef *slice;     // if data points into a memory mapped stream
     int64_t filepos;
 };
 
@@ -2257,6 +2250,7 @@ static void free_block(struct block_info *block)
 {
     free(block->alloc);
     block->alloc = NULL;
+    av_buffer_unref(&block->slice);
     block->data = (bstr){0};
 }
 
@@ -2283,13 +2277,18 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     length = ebml_read_length(s);
     if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
     block->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
-        goto exit;
+    block->slice = stream_read_slice(s, length, AV_LZO_INPUT_PADDING);
+    if (block->slice) {
+        block->data = (bstr){block->slice->data, length};
+    } else {
+        block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
+        if (!block->alloc)
+            goto exit;
+        block->data = (bstr){block->alloc, length};
+        if (stream_read(s, block->data.start, block->data.len) != block->data.len)
+            goto exit;
+    }
 
     // Parse header of the Block element
     /* first byte(s): track num */
@@ -2397,7 +2396,9 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
 
             block = demux_mkv_decode(demuxer->log, track, block, 1);
 
-            demux_packet_t *dp = new_demux_packet_from(block.start, block.len);
+            demux_packet_t *dp = demux_packet_pool_new_from(demuxer->packet_pool,
+                                                            block.start,
+                                                            block.len);
             if (!dp)
                 break;
             dp->keyframe = keyframe;
@@ -2596,6 +2597,400 @@ static int demux_mkv_fill_buffer(demuxer_t *demuxer)
     }
 }
 
+// Whether the file has cues that weren't read yet (see read_deferred_cues()).
+static bool has_unread_cues(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        struct header_elem *elem = &mkv_d->headers[n];
+        if (elem->id == MATROSKA_ID_CUES && !elem->parsed)
+            return true;
+    }
+    return false;
+}
+
+// Load an index created on the fly by a previous instance. It's always a
+// prefix of the full index, just like the one built by create_index_until().
+static void load_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+
+    if (mkv_d->index_cache_loaded)
+        return;
+    mkv_d->index_cache_loaded = true;
+
+    struct demux_index_cache *cache =
+        demux_index_cache_load(demuxer, "mkv", mkv_d->tc_scale);
+    if (!cache)
+        return;
+    if (cache->num_entries > mkv_d->index->num_entries) {
+        mkv_index_table_reset(mkv_d->index);
+        for (size_t n = 0; n < cache->num_entries; n++) {
+            struct demux_index_cache_entry *e = &cache->entries[n];
+            mkv_index_add(mkv_d->index, e->stream, e->pos, e->ts, e->duration);
+        }
+        mkv_d->index_has_durations = true;
+    }
+    mkv_d->index_cache_entries = cache->num_entries;
+    talloc_free(cache);
+}
+
+static void store_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_index_table *t = mkv_d->index;
+
+    if (mkv_d->index_complete || demuxer->opts->index_mode != 1 ||
+        t->num_entries <= mkv_d->index_cache_entries ||
+        has_unread_cues(demuxer))
+        return;
+
+    struct demux_index_cache_entry *entries =
+        talloc_array(NULL, struct demux_index_cache_entry, t->num_entries);
+    size_t num = 0;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        for (size_t i = 0; i < tr->num_entries; i++) {
+            struct mkv_index *e = &tr->entries[i];
+            entries[num++] = (struct demux_index_cache_entry){
+                .stream = e->tnum,
+                .ts = e->timecode,
+                .pos = e->filepos,
+                .duration = e->duration,
+            };
+        }
+    }
+    demux_index_cache_store(demuxer, "mkv", mkv_d->tc_scale, entries, num);
+    talloc_free(entries);
+}
+
+// Background index scanner for files without cues. It reads the cluster and
+// block headers with a separate stream handle, and creates the same index
+// entries as add_block_position() would during playback. The demuxer picks
+// up the result on seeking (merge_scanned_index()).
+struct mkv_index_scanner {
+    struct mp_log *log;
+    struct stream *s;
+    uint64_t tc_scale;
+    int64_t start, end;
+    int *tnums;
+    uint64_t *last_tc;      // per tnums entry; index timecode of last entry
+    bool *have_tc;
+    int num_tnums;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // -- protected by lock
+    struct mkv_index_table *index;
+    int64_t pos;
+    bool done;
+    bool terminate;
+};
+
+// Read the header of a Block or SimpleBlock, and skip the rest.
+static bool scan_block(struct mkv_index_scanner *sc, int64_t end,
+                       uint64_t *tnum, int16_t *time, uint8_t *flags)
+{
+    struct stream *s = sc->s;
+    uint64_t length = ebml_read_length(s);
+    int64_t start = stream_tell(s);
+    if (length > 500000000 || start + length > (uint64_t)end)
+        return false;
+    uint8_t buf[16];
+    bstr data = {buf, stream_read(s, buf, MPMIN(length, sizeof(buf)))};
+    *tnum = ebml_read_vlen_uint(&data);
+    if (*tnum == EBML_UINT_INVALID || data.len < 3)
+        return false;
+    *time = data.start[0] << 8 | data.start[1];
+    *flags = data.start[2];
+    return stream_skip(s, start + length - stream_tell(s));
+}
+
+static void scan_add_block(struct mkv_index_scanner *sc, void *ta_ctx,
+                           struct mkv_index **entries, size_t *num_entries,
+                           uint64_t tnum, int16_t time, uint64_t cluster_tc,
+                           uint64_t duration)
+{
+    for (int n = 0; n < sc->num_tnums; n++) {
+        if (sc->tnums[n] != tnum)
+            continue;
+        // Same computation as read_block() + index_block().
+        uint64_t tc = (time * sc->tc_scale + cluster_tc) / sc->tc_scale;
+        if (sc->have_tc[n] && sc->last_tc[n] >= tc)
+            return;
+        sc->have_tc[n] = true;
+        sc->last_tc[n] = tc;
+        MP_TARRAY_APPEND(ta_ctx, *entries, *num_entries, (struct mkv_index){
+            .tnum = tnum,
+            .timecode = tc,
+            .duration = duration,
+        });
+        return;
+    }
+}
+
+// Index the cluster whose ID was just read. Returns false on errors.
+static bool scan_cluster(struct mkv_index_scanner *sc, int64_t cluster_pos)
+{
+    struct stream *s = sc->s;
+    void *tmp = talloc_new(NULL);
+    struct mkv_index *entries = NULL;
+    size_t num_entries = 0;
+    uint64_t cluster_tc = 0;
+    bool ok = false;
+
+    uint64_t length = ebml_read_length(s);
+    // Clusters of unknown size end with the next cluster.
+    int64_t end = length == EBML_UINT_INVALID ? sc->end : stream_tell(s) + length;
+
+    while (stream_tell(s) < end) {
+        int64_t elem_pos = stream_tell(s);
+        uint64_t tnum;
+        int16_t time;
+        uint8_t flags;
+        switch (ebml_read_id(s)) {
+        case MATROSKA_ID_TIMECODE: {
+            uint64_t num = ebml_read_uint(s);
+            if (num == EBML_UINT_INVALID)
+                goto done;
+            cluster_tc = num * sc->tc_scale;
+            break;
+        }
+
+        case MATROSKA_ID_SIMPLEBLOCK:
+            if (!scan_block(sc, end, &tnum, &time, &flags))
+                goto done;
+            if (flags & 0x80) {
+                scan_add_block(sc, tmp, &entries, &num_entries, tnum, time,
+                               cluster_tc, 0);
+            }
+            break;
+
+        case MATROSKA_ID_BLOCKGROUP: {
+            int64_t group_end = ebml_read_length(s) + stream_tell(s);
+            if (group_end > end)
+                goto done;
+            bool have_block = false, keyframe = true;
+            uint64_t duration = 0;
+            while (stream_tell(s) < group_end) {
+                switch (ebml_read_id(s)) {
+                case MATROSKA_ID_BLOCK:
+                    if (!scan_block(sc, group_end, &tnum, &time, &flags))
+                        goto done;
+                    have_block = true;
+                    break;
+                case MATROSKA_ID_REFERENCEBLOCK: {
+                    int64_t num = ebml_read_int(s);
+                    if (num == EBML_INT_INVALID)
+                        goto done;
+                    if (num)
+                        keyframe = false;
+                    break;
+                }
+                case MATROSKA_ID_BLOCKDURATION:
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        goto done;
+                    break;
+                case MATROSKA_ID_CLUSTER:
+                case EBML_ID_INVALID:
+                    goto done;
+                default:
+                    if (ebml_read_skip(sc->log, group_end, s) != 0)
+                        goto done;
+                }
+            }
+            if (have_block && keyframe) {
+                scan_add_block(sc, tmp, &entries, &num_entries, tnum, time,
+                               cluster_tc, duration);
+            }
+            break;
+        }
+
+        case MATROSKA_ID_CLUSTER:
+            stream_seek(s, elem_pos);
+            ok = true;
+            goto done;
+
+        case EBML_ID_INVALID:
+            goto done;
+
+        default:
+            if (ebml_read_skip(sc->log, end, s) != 0)
+                goto done;
+        }
+    }
+    ok = true;
+
+done:
+    pthread_mutex_lock(&sc->lock);
+    for (size_t n = 0; n < num_entries; n++) {
+        struct mkv_index *e = &entries[n];
+        mkv_index_add(sc->index, e->tnum, cluster_pos, e->timecode, e->duration);
+    }
+    sc->pos = stream_tell(s);
+    pthread_mutex_unlock(&sc->lock);
+    talloc_free(tmp);
+    return ok;
+}
+
+static void *index_scan_thread(void *p)
+{
+    struct mkv_index_scanner *sc = p;
+    struct stream *s = sc->s;
+    mpthread_set_name("mkv index");
+
+    bool ok = stream_seek(s, sc->start);
+    while (ok) {
+        pthread_mutex_lock(&sc->lock);
+        bool terminate = sc->terminate;
+        pthread_mutex_unlock(&sc->lock);
+        if (terminate)
+            return NULL;
+        int64_t pos = stream_tell(s);
+        if (pos >= sc->end)
+            break;
+        uint32_t id = ebml_read_id(s);
+        if (s->eof)
+            break;
+        if (id == MATROSKA_ID_CLUSTER) {
+            ok = scan_cluster(sc, pos);
+        } else {
+            ok = ebml_is_mkv_level1_id(id) &&
+                 ebml_read_skip(sc->log, -1, s) == 0;
+        }
+    }
+    if (!ok)
+        MP_WARN(sc, "Background indexing stopped at broken data.\n");
+
+    pthread_mutex_lock(&sc->lock);
+    sc->done = true;
+    pthread_mutex_unlock(&sc->lock);
+    MP_VERBOSE(sc, "Background indexing done.\n");
+    return NULL;
+}
+
+static void start_index_scanner(struct demuxer *demuxer, int64_t start)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+
+    if (!demuxer->opts->demux_mkv->background_index || mkv_d->index_complete ||
+        demuxer->opts->index_mode != 1 || !demuxer->seekable ||
+        demuxer->stream->uncached_type != STREAMTYPE_FILE)
+        return;
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return;
+    }
+
+    load_index_cache(demuxer);
+
+    int64_t size = 0;
+    stream_control(demuxer->stream, STREAM_CTRL_GET_SIZE, &size);
+    int64_t end = mkv_d->segment_end > 0 ? MPMIN(mkv_d->segment_end, size) : size;
+    if (end <= start)
+        return;
+
+    struct stream *s = stream_open(demuxer->stream->url, demuxer->global);
+    if (!s)
+        return;
+
+    struct mkv_index_scanner *sc = talloc_zero(NULL, struct mkv_index_scanner);
+    *sc = (struct mkv_index_scanner){
+        .log = demuxer->log,
+        .s = s,
+        .tc_scale = mkv_d->tc_scale,
+        .start = start,
+        .end = end,
+        .index = mkv_index_table_create(sc),
+        .pos = start,
+        .num_tnums = mkv_d->num_tracks,
+    };
+    sc->tnums = talloc_array(sc, int, sc->num_tnums);
+    sc->last_tc = talloc_zero_array(sc, uint64_t, sc->num_tnums);
+    sc->have_tc = talloc_zero_array(sc, bool, sc->num_tnums);
+    for (int n = 0; n < sc->num_tnums; n++)
+        sc->tnums[n] = mkv_d->tracks[n]->tnum;
+
+    // Continue from the existing index (e.g. loaded from the index cache).
+    struct mkv_index_table *t = mkv_d->index;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        for (size_t i = 0; i < tr->num_entries; i++) {
+            struct mkv_index *e = &tr->entries[i];
+            mkv_index_add(sc->index, e->tnum, e->filepos, e->timecode,
+                          e->duration);
+        }
+    }
+    for (int n = 0; n < sc->num_tnums; n++) {
+        struct mkv_index *e = mkv_index_last(t, sc->tnums[n]);
+        if (e) {
+            sc->have_tc[n] = true;
+            sc->last_tc[n] = e->timecode;
+            sc->start = MPMAX(sc->start, e->filepos);
+        }
+    }
+    sc->pos = sc->start;
+    pthread_mutex_init(&sc->lock, NULL);
+
+    if (pthread_create(&sc->thread, NULL, index_scan_thread, sc)) {
+        pthread_mutex_destroy(&sc->lock);
+        free_stream(s);
+        talloc_free(sc);
+        return;
+    }
+    MP_VERBOSE(demuxer, "Started background indexing.\n");
+    mkv_d->scanner = sc;
+}
+
+// Add the entries the scanner found since the last call. Both indexes are
+// built in file order, and never contain older entries than the last one of
+// a track, so only the entries past it are new.
+static void merge_scanned_index(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_index_scanner *sc = mkv_d->scanner;
+    if (!sc)
+        return;
+
+    pthread_mutex_lock(&sc->lock);
+    struct mkv_index_table *t = sc->index;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        struct mkv_index *last = mkv_index_last(mkv_d->index, tr->tnum);
+        size_t i = tr->num_entries;
+        while (i > 0 && (!last || tr->entries[i - 1].timecode > last->timecode))
+            i--;
+        for (; i < tr->num_entries; i++) {
+            struct mkv_index *e = &tr->entries[i];
+            mkv_index_add(mkv_d->index, e->tnum, e->filepos, e->timecode,
+                          e->duration);
+            mkv_d->index_has_durations = true;
+        }
+    }
+    pthread_mutex_unlock(&sc->lock);
+}
+
+static void stop_index_scanner(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_index_scanner *sc = mkv_d->scanner;
+    if (!sc)
+        return;
+
+    pthread_mutex_lock(&sc->lock);
+    sc->terminate = true;
+    pthread_mutex_unlock(&sc->lock);
+    pthread_join(sc->thread, NULL);
+
+    merge_scanned_index(demuxer);
+
+    pthread_mutex_destroy(&sc->lock);
+    free_stream(sc->s);
+    talloc_free(sc);
+    mkv_d->scanner = NULL;
+}
+
 static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
@@ -2603,12 +2998,10 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
 
     mkv_index_t *index = NULL;
     for (int n = 0; n < mkv_d->num_tracks; n++) {
-        int n_index = mkv_d->tracks[n]->last_index_entry;
-        if (n_index >= 0) {
-            mkv_index_t *index2 = &mkv_d->indexes[n_index];
-            if (!index || index2->filepos > index->filepos)
-                index = index2;
-        }
+        mkv_index_t *index2 = mkv_index_last(mkv_d->index,
+                                             mkv_d->tracks[n]->tnum);
+        if (index2 && (!index || index2->filepos > index->filepos))
+            index = index2;
     }
     return index;
 }
@@ -2623,6 +3016,9 @@ static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
     if (mkv_d->index_complete)
         return 0;
 
+    load_index_cache(demuxer);
+    merge_scanned_index(demuxer);
+
     mkv_index_t *index = get_highest_index_entry(demuxer);
 
     if (!index || index->timecode * mkv_d->tc_scale < timecode) {
@@ -2644,7 +3040,7 @@ static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
                 break;
         }
     }
-    if (!mkv_d->indexes) {
+    if (!mkv_d->index->num_entries) {
         MP_WARN(demuxer, "no target for seek found\n");
         return -1;
     }
@@ -2658,27 +3054,9 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
 {
     struct MPOpts *opts = demuxer->opts;
     struct mkv_demuxer *mkv_d = demuxer->priv;
-    struct mkv_index *index = NULL;
-
-    int64_t min_diff = INT64_MIN;
-    for (size_t i = 0; i < mkv_d->num_indexes; i++) {
-        if (seek_id < 0 || mkv_d->indexes[i].tnum == seek_id) {
-            int64_t diff =
-                target_timecode -
-                (int64_t) (mkv_d->indexes[i].timecode * mkv_d->tc_scale);
-            if (flags & FLAG_BACKWARD)
-                diff = -diff;
-            if (min_diff != INT64_MIN) {
-                if (diff <= 0) {
-                    if (min_diff <= 0 && diff <= min_diff)
-                        continue;
-                } else if (diff >= min_diff)
-                    continue;
-            }
-            min_diff = diff;
-            index = mkv_d->indexes + i;
-        }
-    }
+    struct mkv_index *index = mkv_index_seek(mkv_d->index, seek_id,
+                                             target_timecode, mkv_d->tc_scale,
+                                             flags & FLAG_BACKWARD);
 
     if (index) {        /* We've found an entry. */
         uint64_t seek_pos = index->filepos;
@@ -2689,32 +3067,17 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
             uint64_t pre = MPMIN(INT64_MAX, secs * 1e9 / mkv_d->tc_scale);
             uint64_t min_tc = pre < index->timecode ? index->timecode - pre : 0;
             uint64_t prev_target = 0;
-            uint64_t prev_tc = 0;
-            for (size_t i = 0; i < mkv_d->num_indexes; i++) {
-                if (seek_id < 0 || mkv_d->indexes[i].tnum == seek_id) {
-                    struct mkv_index *cur = &mkv_d->indexes[i];
-                    if (cur->timecode <= min_tc && cur->timecode >= prev_tc) {
-                        prev_tc = cur->timecode;
-                        prev_target = cur->filepos;
-                    }
-                }
-            }
+            struct mkv_index *prev =
+                mkv_index_last_until(mkv_d->index, seek_id, min_tc);
+            if (prev)
+                prev_target = prev->filepos;
             if (mkv_d->index_has_durations) {
                 // Find the earliest cluster that is not before prev_target,
                 // but contains subtitle packets overlapping with the cluster
                 // at seek_pos.
-                uint64_t target = seek_pos;
-                for (size_t i = 0; i < mkv_d->num_indexes; i++) {
-                    struct mkv_index *cur = &mkv_d->indexes[i];
-                    if (cur->timecode <= index->timecode &&
-                        cur->timecode + cur->duration > index->timecode &&
-                        cur->filepos >= prev_target &&
-                        cur->filepos < target)
-                    {
-                        target = cur->filepos;
-                    }
-                }
-                prev_target = target;
+                prev_target = mkv_index_overlap_pos(mkv_d->index,
+                                                    index->timecode,
+                                                    prev_target, seek_pos);
             }
             if (prev_target)
                 seek_pos = prev_target;
@@ -2791,17 +3154,8 @@ static void demux_mkv_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
         int64_t target_filepos = size * MPCLAMP(rel_seek_secs, 0, 1);
 
         mkv_index_t *index = NULL;
-        if (mkv_d->index_complete) {
-            for (size_t i = 0; i < mkv_d->num_indexes; i++) {
-                if (mkv_d->indexes[i].tnum == v_tnum) {
-                    if ((index == NULL)
-                        || ((mkv_d->indexes[i].filepos >= target_filepos)
-                            && ((index->filepos < target_filepos)
-                                || (mkv_d->indexes[i].filepos < index->filepos))))
-                        index = &mkv_d->indexes[i];
-                }
-            }
-        }
+        if (mkv_d->index_complete)
+            index = mkv_index_seek_pos(mkv_d->index, v_tnum, target_filepos);
 
         mkv_d->cluster_end = 0;
 
@@ -2849,12 +3203,7 @@ static void probe_last_timestamp(struct demuxer *demuxer)
         return;
 
     // Find last cluster that still has video packets
-    int64_t target = 0;
-    for (size_t i = 0; i < mkv_d->num_indexes; i++) {
-        struct mkv_index *cur = &mkv_d->indexes[i];
-        if (cur->tnum == v_tnum)
-            target = MPMAX(target, cur->filepos);
-    }
+    int64_t target = mkv_index_max_pos(mkv_d->index, v_tnum);
     if (!target)
         return;
 
@@ -2896,6 +3245,16 @@ static int demux_mkv_control(demuxer_t *demuxer, int cmd, void *arg)
 
         *((double *) arg) = (double) mkv_d->duration;
         return DEMUXER_CTRL_OK;
+    case DEMUXER_CTRL_GET_INDEX_PROGRESS: {
+        struct mkv_index_scanner *sc = mkv_d->scanner;
+        if (!sc)
+            return DEMUXER_CTRL_NOTIMPL;
+        pthread_mutex_lock(&sc->lock);
+        double progress = sc->done ? 1.0 : sc->pos / (double)sc->end;
+        pthread_mutex_unlock(&sc->lock);
+        *(double *)arg = MPCLAMP(progress, 0, 1);
+        return DEMUXER_CTRL_OK;
+    }
     default:
         return DEMUXER_CTRL_NOTIMPL;
     }
@@ -2906,6 +3265,8 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    stop_index_scanner(demuxer);
+    store_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
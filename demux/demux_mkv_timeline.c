@@ -25,9 +25,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <libavutil/common.h>
+#include <libavutil/intreadwrite.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #include "talloc.h"
 
@@ -63,6 +66,37 @@ struct tl_ctx {
     int num_chapters; // Total number of expected chapters.
 };
 
+// Max. number of files opened at once when searching for sources.
+#define MAX_PROBE_THREADS 8
+
+// With --demuxer-index-cache, the segment UIDs of probed files are cached in
+// this file. It starts with a header, followed by num_entries entries, each
+// with a header, the path and num_segments segment UIDs.
+#define UID_CACHE_FILE "index_cache/mkv_segment_uids"
+#define UID_CACHE_MAGIC "mpvuid01"
+#define UID_CACHE_HEADER_SIZE (8 + 8)
+#define UID_CACHE_ENTRY_SIZE (8 + 8 + 4 + 4)
+#define UID_CACHE_MAX_ENTRIES 10000
+
+// Segment UIDs of a candidate file.
+struct probe {
+    char *filename;
+    char *path;         // absolute path, NULL if the file can't be cached
+    uint64_t size;
+    int64_t mtime;
+    struct matroska_segment_uid *uids; // per segment (edition unused)
+    int num_segments;
+    bool probed;        // uids are valid
+};
+
+struct prober {
+    struct tl_ctx *ctx;
+    struct probe *probes;
+    int num_probes;
+    pthread_mutex_t lock;
+    int next;
+};
+
 struct find_entry {
     char *name;
     int matchlen;
@@ -236,6 +270,244 @@ static void check_file(struct tl_ctx *ctx, char *filename, int first)
     }
 }
 
+// Read the UIDs of all segments in the file, without opening it completely.
+static void probe_file(struct tl_ctx *ctx, struct probe *p)
+{
+    struct mp_cancel *cancel = ctx->tl->cancel;
+    for (int segment = 0; ; segment++) {
+        if (mp_cancel_test(cancel))
+            return;
+        bool was_valid = false;
+        struct matroska_segment_uid uid = {{0}};
+        struct demuxer_params params = {
+            .force_format = "mkv",
+            .matroska_wanted_segment = segment,
+            .matroska_was_valid = &was_valid,
+            .matroska_probed_uid = &uid,
+            .disable_cache = true,
+        };
+        free_demuxer_and_stream(demux_open_url(p->filename, &params, cancel,
+                                               ctx->global));
+        if (!was_valid)
+            break;
+        // Not using a talloc parent, as other threads allocate concurrently.
+        MP_TARRAY_APPEND(NULL, p->uids, p->num_segments, uid);
+    }
+    p->probed = true;
+}
+
+static void *probe_thread(void *arg)
+{
+    struct prober *pr = arg;
+    mpthread_set_name("mkv probe");
+    while (1) {
+        pthread_mutex_lock(&pr->lock);
+        int i = pr->next;
+        while (i < pr->num_probes && pr->probes[i].probed)
+            i++;
+        pr->next = i + 1;
+        pthread_mutex_unlock(&pr->lock);
+        if (i >= pr->num_probes)
+            break;
+        probe_file(pr->ctx, &pr->probes[i]);
+    }
+    return NULL;
+}
+
+static void probe_files(struct tl_ctx *ctx, struct probe *probes, int num)
+{
+    struct prober pr = {
+        .ctx = ctx,
+        .probes = probes,
+        .num_probes = num,
+    };
+    pthread_mutex_init(&pr.lock, NULL);
+    pthread_t threads[MAX_PROBE_THREADS];
+    int num_threads = 0;
+    for (int n = 0; n < MPMIN(num, MAX_PROBE_THREADS); n++) {
+        if (pthread_create(&threads[n], NULL, probe_thread, &pr))
+            break;
+        num_threads++;
+    }
+    // Without threads, probe everything on this thread.
+    if (!num_threads)
+        probe_thread(&pr);
+    for (int n = 0; n < num_threads; n++)
+        pthread_join(threads[n], NULL);
+    pthread_mutex_destroy(&pr.lock);
+}
+
+static char *get_uid_cache_file(struct tl_ctx *ctx, void *ta_ctx)
+{
+    if (!ctx->global->opts->demuxer_index_cache)
+        return NULL;
+    return mp_find_user_config_file(ta_ctx, ctx->global, UID_CACHE_FILE);
+}
+
+// Read all entries of the UID cache. The entries are returned as struct probe,
+// with probed set.
+static struct probe *load_uid_cache(struct tl_ctx *ctx, void *ta_ctx, int *num)
+{
+    struct probe *entries = NULL;
+    *num = 0;
+    char *filename = get_uid_cache_file(ctx, ta_ctx);
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    if (!f)
+        return NULL;
+    uint8_t header[UID_CACHE_HEADER_SIZE];
+    if (fread(header, UID_CACHE_HEADER_SIZE, 1, f) != 1 ||
+        memcmp(header, UID_CACHE_MAGIC, 8) != 0)
+        goto done;
+    uint64_t num_entries = MPMIN(AV_RL64(header + 8), UID_CACHE_MAX_ENTRIES);
+    for (uint64_t n = 0; n < num_entries; n++) {
+        uint8_t p[UID_CACHE_ENTRY_SIZE];
+        if (fread(p, UID_CACHE_ENTRY_SIZE, 1, f) != 1)
+            break;
+        struct probe e = {
+            .size = AV_RL64(p),
+            .mtime = AV_RL64(p + 8),
+            .num_segments = AV_RL32(p + 16),
+            .probed = true,
+        };
+        uint32_t path_len = AV_RL32(p + 20);
+        if (path_len > 4096 || e.num_segments < 0 || e.num_segments > 1000)
+            break;
+        e.path = talloc_zero_size(ta_ctx, path_len + 1);
+        e.uids = talloc_zero_array(ta_ctx, struct matroska_segment_uid,
+                                   e.num_segments);
+        bool ok = fread(e.path, path_len, 1, f) == 1;
+        for (int i = 0; i < e.num_segments && ok; i++)
+            ok = fread(e.uids[i].segment, 16, 1, f) == 1;
+        if (!ok)
+            break;
+        MP_TARRAY_APPEND(ta_ctx, entries, *num, e);
+    }
+done:
+    fclose(f);
+    return entries;
+}
+
+// Write the probed files and the old cache entries to the UID cache.
+static void store_uid_cache(struct tl_ctx *ctx, void *ta_ctx,
+                            struct probe *probes, int num_probes,
+                            struct probe *old, int num_old)
+{
+    char *filename = get_uid_cache_file(ctx, ta_ctx);
+    if (!filename)
+        return;
+
+    struct probe *entries = NULL;
+    int num_entries = 0;
+    for (int n = 0; n < num_probes; n++) {
+        if (probes[n].path && probes[n].probed)
+            MP_TARRAY_APPEND(ta_ctx, entries, num_entries, probes[n]);
+    }
+    for (int n = 0; n < num_old; n++) {
+        bool replaced = false;
+        for (int i = 0; i < num_probes; i++) {
+            if (probes[i].path && strcmp(probes[i].path, old[n].path) == 0)
+                replaced = true;
+        }
+        if (!replaced)
+            MP_TARRAY_APPEND(ta_ctx, entries, num_entries, old[n]);
+    }
+    num_entries = MPMIN(num_entries, UID_CACHE_MAX_ENTRIES);
+
+    mp_mk_config_dir(ctx->global, "index_cache");
+
+    // Write to a temporary file and rename it, like the index cache.
+    char *tmpname = talloc_asprintf(ta_ctx, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f)
+        return;
+    uint8_t header[UID_CACHE_HEADER_SIZE];
+    memcpy(header, UID_CACHE_MAGIC, 8);
+    AV_WL64(header + 8, num_entries);
+    bool ok = fwrite(header, UID_CACHE_HEADER_SIZE, 1, f) == 1;
+    for (int n = 0; n < num_entries && ok; n++) {
+        struct probe *e = &entries[n];
+        uint8_t p[UID_CACHE_ENTRY_SIZE];
+        AV_WL64(p, e->size);
+        AV_WL64(p + 8, e->mtime);
+        AV_WL32(p + 16, e->num_segments);
+        AV_WL32(p + 20, strlen(e->path));
+        ok = fwrite(p, UID_CACHE_ENTRY_SIZE, 1, f) == 1 &&
+             fwrite(e->path, strlen(e->path), 1, f) == 1;
+        for (int i = 0; i < e->num_segments && ok; i++)
+            ok = fwrite(e->uids[i].segment, 16, 1, f) == 1;
+    }
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmpname, filename)) {
+        MP_WARN(ctx, "Could not write %s.\n", filename);
+        unlink(tmpname);
+    }
+}
+
+// Determine the segment UIDs of all files, using the cache where possible, and
+// opening the other files in parallel.
+static struct probe *probe_sources(struct tl_ctx *ctx, void *ta_ctx,
+                                   char **filenames, int num_filenames)
+{
+    struct probe *probes = talloc_zero_array(ta_ctx, struct probe,
+                                             num_filenames);
+    int num_old = 0;
+    struct probe *old = load_uid_cache(ctx, ta_ctx, &num_old);
+    char *cwd = mp_getcwd(ta_ctx);
+    int num_cached = 0;
+    for (int n = 0; n < num_filenames; n++) {
+        struct probe *p = &probes[n];
+        p->filename = filenames[n];
+        struct stat st;
+        if (mp_is_url(bstr0(p->filename)) || stat(p->filename, &st) ||
+            !S_ISREG(st.st_mode))
+            continue;
+        p->path = cwd ? mp_path_join(ta_ctx, cwd, p->filename) : NULL;
+        p->size = st.st_size;
+        p->mtime = st.st_mtime;
+        for (int i = 0; i < num_old && p->path; i++) {
+            struct probe *e = &old[i];
+            if (strcmp(e->path, p->path) == 0 && e->size == p->size &&
+                e->mtime == p->mtime)
+            {
+                p->uids = e->uids;
+                p->num_segments = e->num_segments;
+                p->probed = true;
+                num_cached++;
+                break;
+            }
+        }
+    }
+    MP_VERBOSE(ctx, "Probing %d files (%d cached).\n",
+               num_filenames - num_cached, num_cached);
+
+    probe_files(ctx, probes, num_filenames);
+    for (int n = 0; n < num_filenames; n++)
+        talloc_steal(ta_ctx, probes[n].uids);
+
+    if (num_cached < num_filenames && !mp_cancel_test(ctx->tl->cancel))
+        store_uid_cache(ctx, ta_ctx, probes, num_filenames, old, num_old);
+    return probes;
+}
+
+// Open the segments of the file which may be a missing source.
+static void check_probed_file(struct tl_ctx *ctx, struct probe *p)
+{
+    if (!p->probed) {
+        check_file(ctx, p->filename, 0);
+        return;
+    }
+    for (int segment = 0; segment < p->num_segments; segment++) {
+        for (int i = 1; i < ctx->num_sources; i++) {
+            if (!ctx->sources[i] &&
+                memcmp(ctx->uids[i].segment, p->uids[segment].segment, 16) == 0)
+            {
+                check_file_seg(ctx, p->filename, segment);
+                break;
+            }
+        }
+    }
+}
+
 static bool missing(struct tl_ctx *ctx)
 {
     for (int i = 0; i < ctx->num_sources; i++) {
@@ -276,6 +548,10 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
         check_file(ctx, main_filename, 1);
     }
 
+    struct probe *probes = NULL;
+    if (num_filenames && missing(ctx))
+        probes = probe_sources(ctx, tmp, filenames, num_filenames);
+
     int old_source_count;
     do {
         old_source_count = ctx->num_sources;
@@ -283,7 +559,7 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
             if (!missing(ctx))
                 break;
             MP_VERBOSE(ctx, "Checking file %s\n", filenames[i]);
-            check_file(ctx, filenames[i], 0);
+            check_probed_file(ctx, &probes[i]);
         }
     } while (old_source_count != ctx->num_sources);
 
@@ -22,6 +22,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <libavcodec/avcodec.h>
+
 #include "options/m_option.h"
 #include "options/options.h"
 
@@ -245,17 +247,35 @@ static int raw_fill_buffer(demuxer_t *demuxer)
     if (demuxer->stream->eof)
         return 0;
 
-    struct demux_packet *dp = new_demux_packet(p->frame_size * p->read_frames);
+    int64_t pos = stream_tell(demuxer->stream);
+    int size = p->frame_size * p->read_frames;
+    struct demux_packet *dp = NULL;
+
+    // Reference the data directly if the stream is memory mapped. Decoders
+    // may read up to FF_INPUT_BUFFER_PADDING_SIZE bytes past the packet, so
+    // near the end of the file it's copied into a padded packet instead.
+    AVBufferRef *slice = stream_read_slice(demuxer->stream, size,
+                                           FF_INPUT_BUFFER_PADDING_SIZE);
+    if (slice) {
+        AVPacket pkt = {.buf = slice, .data = slice->data, .size = size};
+        dp = demux_packet_pool_new_from_avpacket(demuxer->packet_pool, &pkt);
+        av_buffer_unref(&slice);
+    } else {
+        dp = demux_packet_pool_new(demuxer->packet_pool, size);
+        if (dp) {
+            int len = stream_read(demuxer->stream, dp->buffer, dp->len);
+            demux_packet_shorten(dp, len);
+        }
+    }
     if (!dp) {
         MP_ERR(demuxer, "Can't read packet.\n");
         return 1;
     }
 
-    dp->pos = stream_tell(demuxer->stream);
+    dp->pos = pos;
     dp->pts = (dp->pos  / p->frame_size) / p->frame_rate;
+    dp->keyframe = true;
 
-    int len = stream_read(demuxer->stream, dp->buffer, dp->len);
-    demux_packet_shorten(dp, len);
     demux_add_packet(demuxer->streams[0], dp);
 
     return 1;
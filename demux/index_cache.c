@@ -0,0 +1,216 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavutil/md5.h>
+#include <libavutil/intreadwrite.h>
+
+#include "talloc.h"
+
+#include "osdep/io.h"
+#include "common/msg.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "stream/stream.h"
+#include "demux.h"
+#include "index_cache.h"
+
+#define INDEX_CACHE_DIR "index_cache"
+
+// Cache files start with this header, followed by num_entries entries.
+#define MAGIC "mpvidx01"
+#define HEAD_BYTES (64 * 1024)   // bytes of the file start that are hashed
+#define HEADER_SIZE (8 + 8 + 8 + 16 + 8 + 8)
+#define ENTRY_SIZE (4 + 4 + 8 + 8 + 8 + 4 + 4)
+
+// Identifies a specific version of a file.
+struct file_key {
+    uint64_t size;
+    int64_t mtime;
+    uint8_t head_md5[16];
+};
+
+// Return the cache filename for the demuxer's file, and set *key. Returns
+// NULL if caching is not possible.
+static char *get_cache_file(struct demuxer *demuxer, void *ta_ctx,
+                            const char *type, struct file_key *key)
+{
+    struct stream *s = demuxer->stream;
+    if (!demuxer->opts->demuxer_index_cache || !s ||
+        s->uncached_type != STREAMTYPE_FILE || !s->path)
+        return NULL;
+
+    char *path = s->path;
+    char *cwd = mp_getcwd(ta_ctx);
+    if (cwd)
+        path = mp_path_join(ta_ctx, cwd, path);
+
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode))
+        return NULL;
+    *key = (struct file_key){
+        .size = st.st_size,
+        .mtime = st.st_mtime,
+    };
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    uint8_t *head = talloc_size(ta_ctx, HEAD_BYTES);
+    size_t head_len = fread(head, 1, HEAD_BYTES, f);
+    fclose(f);
+    av_md5_sum(key->head_md5, head, head_len);
+
+    char *name = talloc_asprintf(ta_ctx, "%s\n%s", type, path);
+    uint8_t md5[16];
+    av_md5_sum(md5, name, strlen(name));
+    char *conf = talloc_strdup(ta_ctx, "");
+    for (int i = 0; i < 16; i++)
+        conf = talloc_asprintf_append(conf, "%02X", md5[i]);
+
+    char *dir = mp_find_user_config_file(ta_ctx, demuxer->global,
+                                         INDEX_CACHE_DIR);
+    return dir ? mp_path_join(ta_ctx, dir, conf) : NULL;
+}
+
+static void write_header(uint8_t *p, struct file_key *key, int64_t timebase,
+                         uint64_t num_entries)
+{
+    memcpy(p, MAGIC, 8);
+    AV_WL64(p + 8, key->size);
+    AV_WL64(p + 16, key->mtime);
+    memcpy(p + 24, key->head_md5, 16);
+    AV_WL64(p + 40, timebase);
+    AV_WL64(p + 48, num_entries);
+}
+
+struct demux_index_cache *demux_index_cache_load(struct demuxer *demuxer,
+                                                 const char *type,
+                                                 int64_t timebase)
+{
+    void *tmp = talloc_new(NULL);
+    struct demux_index_cache *res = NULL;
+    FILE *f = NULL;
+
+    struct file_key key;
+    char *filename = get_cache_file(demuxer, tmp, type, &key);
+    if (!filename)
+        goto done;
+
+    f = fopen(filename, "rb");
+    if (!f)
+        goto done;
+
+    uint8_t header[HEADER_SIZE], expected[HEADER_SIZE];
+    if (fread(header, HEADER_SIZE, 1, f) != 1)
+        goto done;
+    uint64_t num_entries = AV_RL64(header + 48);
+    write_header(expected, &key, timebase, num_entries);
+    if (memcmp(header, expected, HEADER_SIZE) != 0) {
+        MP_VERBOSE(demuxer, "Index cache %s is stale.\n", filename);
+        goto done;
+    }
+
+    struct stat st;
+    if (fstat(fileno(f), &st) ||
+        num_entries > (st.st_size - HEADER_SIZE) / ENTRY_SIZE)
+        goto done;
+
+    res = talloc_zero(NULL, struct demux_index_cache);
+    res->entries = talloc_array(res, struct demux_index_cache_entry, num_entries);
+    for (uint64_t n = 0; n < num_entries; n++) {
+        uint8_t p[ENTRY_SIZE];
+        if (fread(p, ENTRY_SIZE, 1, f) != 1) {
+            talloc_free(res);
+            res = NULL;
+            goto done;
+        }
+        res->entries[n] = (struct demux_index_cache_entry){
+            .stream = (int32_t)AV_RL32(p),
+            .flags = (int32_t)AV_RL32(p + 4),
+            .ts = AV_RL64(p + 8),
+            .pos = AV_RL64(p + 16),
+            .duration = AV_RL64(p + 24),
+            .size = (int32_t)AV_RL32(p + 32),
+            .distance = (int32_t)AV_RL32(p + 36),
+        };
+    }
+    res->num_entries = num_entries;
+    MP_VERBOSE(demuxer, "Loaded %zu index entries from %s.\n",
+               res->num_entries, filename);
+
+done:
+    if (f)
+        fclose(f);
+    talloc_free(tmp);
+    return res;
+}
+
+void demux_index_cache_store(struct demuxer *demuxer, const char *type,
+                             int64_t timebase,
+                             struct demux_index_cache_entry *entries,
+                             size_t num_entries)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct file_key key;
+    char *filename = get_cache_file(demuxer, tmp, type, &key);
+    if (!filename || !num_entries)
+        goto done;
+
+    mp_mk_config_dir(demuxer->global, INDEX_CACHE_DIR);
+
+    // Write to a temporary file and rename it, so that concurrent readers
+    // never see a partially written cache.
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f)
+        goto done;
+
+    uint8_t header[HEADER_SIZE];
+    write_header(header, &key, timebase, num_entries);
+    bool ok = fwrite(header, HEADER_SIZE, 1, f) == 1;
+    for (size_t n = 0; n < num_entries && ok; n++) {
+        struct demux_index_cache_entry *e = &entries[n];
+        uint8_t p[ENTRY_SIZE];
+        AV_WL32(p, e->stream);
+        AV_WL32(p + 4, e->flags);
+        AV_WL64(p + 8, e->ts);
+        AV_WL64(p + 16, e->pos);
+        AV_WL64(p + 24, e->duration);
+        AV_WL32(p + 32, e->size);
+        AV_WL32(p + 36, e->distance);
+        ok = fwrite(p, ENTRY_SIZE, 1, f) == 1;
+    }
+    ok &= fclose(f) == 0;
+
+    if (!ok || rename(tmpname, filename)) {
+        MP_WARN(demuxer, "Could not write index cache %s.\n", filename);
+        unlink(tmpname);
+        goto done;
+    }
+    MP_VERBOSE(demuxer, "Stored %zu index entries to %s.\n",
+               num_entries, filename);
+
+done:
+    talloc_free(tmp);
+}
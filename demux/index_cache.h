@@ -0,0 +1,60 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_INDEX_CACHE_H
+#define MP_DEMUX_INDEX_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct demuxer;
+
+// A seek index entry. The meaning of the fields (apart from pos) is up to the
+// demuxer using the cache.
+struct demux_index_cache_entry {
+    int stream;
+    int flags;
+    int64_t ts;
+    int64_t pos;
+    int64_t duration;
+    int size;
+    int distance;
+};
+
+// A loaded index. Entries are in the order they were stored.
+struct demux_index_cache {
+    struct demux_index_cache_entry *entries;
+    size_t num_entries;
+};
+
+// Load the cached index for the file opened by demuxer. type identifies the
+// user (e.g. demuxer name), and timebase can be used to reject entries
+// created with different units. Returns NULL if caching is disabled, the file
+// is not a local file, or no valid cache exists. Free with talloc_free().
+struct demux_index_cache *demux_index_cache_load(struct demuxer *demuxer,
+                                                 const char *type,
+                                                 int64_t timebase);
+
+// Replace the cached index for the file opened by demuxer. Does nothing if
+// caching is disabled or the file is not a local file.
+void demux_index_cache_store(struct demuxer *demuxer, const char *type,
+                             int64_t timebase,
+                             struct demux_index_cache_entry *entries,
+                             size_t num_entries);
+
+#endif
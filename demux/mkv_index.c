@@ -0,0 +1,284 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "mkv_index.h"
+
+struct mkv_index_table *mkv_index_table_create(void *talloc_ctx)
+{
+    return talloc_zero(talloc_ctx, struct mkv_index_table);
+}
+
+void mkv_index_table_reset(struct mkv_index_table *t)
+{
+    for (int n = 0; n < t->num_tracks; n++)
+        talloc_free(t->tracks[n].entries);
+    t->num_tracks = 0;
+    t->num_entries = 0;
+}
+
+struct mkv_track_index *mkv_index_get_track(struct mkv_index_table *t,
+                                            int tnum)
+{
+    for (int n = 0; n < t->num_tracks; n++) {
+        if (t->tracks[n].tnum == tnum)
+            return &t->tracks[n];
+    }
+    return NULL;
+}
+
+void mkv_index_add(struct mkv_index_table *t, int tnum, uint64_t filepos,
+                   uint64_t timecode, uint64_t duration)
+{
+    struct mkv_track_index *tr = mkv_index_get_track(t, tnum);
+    if (!tr) {
+        MP_TARRAY_APPEND(t, t->tracks, t->num_tracks, (struct mkv_track_index){
+            .tnum = tnum,
+            .sorted = true,
+            .filepos_sorted = true,
+        });
+        tr = &t->tracks[t->num_tracks - 1];
+    }
+
+    if (tr->num_entries) {
+        struct mkv_index *last = &tr->entries[tr->num_entries - 1];
+        if (timecode < last->timecode ||
+            (timecode == last->timecode && filepos < last->filepos))
+            tr->sorted = false;
+        if (filepos < last->filepos)
+            tr->filepos_sorted = false;
+    }
+
+    MP_TARRAY_APPEND(t, tr->entries, tr->num_entries, (struct mkv_index){
+        .tnum = tnum,
+        .filepos = filepos,
+        .timecode = timecode,
+        .duration = duration,
+    });
+    tr->max_duration = MPMAX(tr->max_duration, duration);
+    t->num_entries++;
+}
+
+static int cmp_entry(const void *p1, const void *p2)
+{
+    const struct mkv_index *e1 = p1, *e2 = p2;
+    if (e1->timecode != e2->timecode)
+        return e1->timecode > e2->timecode ? 1 : -1;
+    if (e1->filepos != e2->filepos)
+        return e1->filepos > e2->filepos ? 1 : -1;
+    return 0;
+}
+
+// Cues are usually sorted already, so this is rarely done.
+static void ensure_sorted(struct mkv_track_index *tr)
+{
+    if (tr->sorted)
+        return;
+    qsort(tr->entries, tr->num_entries, sizeof(tr->entries[0]), cmp_entry);
+    tr->filepos_sorted = true;
+    for (size_t i = 1; i < tr->num_entries; i++)
+        tr->filepos_sorted &= tr->entries[i].filepos >= tr->entries[i - 1].filepos;
+    tr->sorted = true;
+}
+
+// Index of the first entry with a timecode >= timecode, or num_entries.
+static size_t lower_bound(struct mkv_track_index *tr, uint64_t timecode)
+{
+    size_t lo = 0, hi = tr->num_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (tr->entries[mid].timecode < timecode) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// First entry with the same timecode as entries[i].
+static struct mkv_index *first_equal(struct mkv_track_index *tr, size_t i)
+{
+    return &tr->entries[lower_bound(tr, tr->entries[i].timecode)];
+}
+
+struct mkv_index *mkv_index_last(struct mkv_index_table *t, int tnum)
+{
+    struct mkv_track_index *tr = mkv_index_get_track(t, tnum);
+    if (!tr || !tr->num_entries)
+        return NULL;
+    ensure_sorted(tr);
+    return &tr->entries[tr->num_entries - 1];
+}
+
+// Entry closest to target (in ns), as described in mkv_index_seek().
+static struct mkv_index *track_seek(struct mkv_track_index *tr, int64_t target,
+                                    uint64_t tc_scale, bool backward)
+{
+    if (!tr->num_entries)
+        return NULL;
+    ensure_sorted(tr);
+    if (backward) {
+        // First entry with timecode * tc_scale > target.
+        uint64_t tc = target < 0 ? 0 : target / tc_scale + 1;
+        size_t i = lower_bound(tr, tc);
+        return i > 0 ? first_equal(tr, i - 1) : &tr->entries[0];
+    } else {
+        // First entry with timecode * tc_scale >= target.
+        uint64_t tc = target <= 0 ? 0 : (target + tc_scale - 1) / tc_scale;
+        size_t i = lower_bound(tr, tc);
+        return i < tr->num_entries ? &tr->entries[i]
+                                   : first_equal(tr, tr->num_entries - 1);
+    }
+}
+
+static int64_t seek_diff(struct mkv_index *e, int64_t target, uint64_t tc_scale,
+                         bool backward)
+{
+    int64_t diff = target - (int64_t) (e->timecode * tc_scale);
+    return backward ? -diff : diff;
+}
+
+// Return the entry of the given track (or of any track if tnum < 0) closest to
+// the target time (in ns). Entries at or after the target are preferred
+// (at or before it if backward is set). If there are several candidates with
+// the same timecode, the one with the lowest filepos is used, and if they are
+// in the same cluster, the one with the lowest track number. (The order in
+// which the entries were added doesn't matter.)
+struct mkv_index *mkv_index_seek(struct mkv_index_table *t, int tnum,
+                                 int64_t target, uint64_t tc_scale,
+                                 bool backward)
+{
+    struct mkv_index *index = NULL;
+    int64_t min_diff = 0;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        if (tnum >= 0 && tr->tnum != tnum)
+            continue;
+        struct mkv_index *e = track_seek(tr, target, tc_scale, backward);
+        if (!e)
+            continue;
+        int64_t diff = seek_diff(e, target, tc_scale, backward);
+        if (index) {
+            if (diff == min_diff) {
+                if (e->filepos > index->filepos ||
+                    (e->filepos == index->filepos && e->tnum >= index->tnum))
+                    continue;
+            } else if (diff <= 0) {
+                if (min_diff <= 0 && diff <= min_diff)
+                    continue;
+            } else if (diff >= min_diff)
+                continue;
+        }
+        min_diff = diff;
+        index = e;
+    }
+    return index;
+}
+
+// Return the entry with the highest timecode that is <= timecode, of the given
+// track (or of any track if tnum < 0). NULL if there is none.
+struct mkv_index *mkv_index_last_until(struct mkv_index_table *t, int tnum,
+                                       uint64_t timecode)
+{
+    struct mkv_index *index = NULL;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        if (tnum >= 0 && tr->tnum != tnum)
+            continue;
+        ensure_sorted(tr);
+        size_t i = timecode == UINT64_MAX ? tr->num_entries
+                                          : lower_bound(tr, timecode + 1);
+        if (i > 0 && (!index || tr->entries[i - 1].timecode >= index->timecode))
+            index = &tr->entries[i - 1];
+    }
+    return index;
+}
+
+// Return the lowest filepos in [min_pos, max_pos) of all entries (of all
+// tracks) whose duration overlaps with timecode. Return max_pos if there is
+// no such entry.
+uint64_t mkv_index_overlap_pos(struct mkv_index_table *t, uint64_t timecode,
+                               uint64_t min_pos, uint64_t max_pos)
+{
+    uint64_t pos = max_pos;
+    for (int n = 0; n < t->num_tracks; n++) {
+        struct mkv_track_index *tr = &t->tracks[n];
+        ensure_sorted(tr);
+        // Only entries with timecode + max_duration > timecode can overlap.
+        size_t i = timecode < tr->max_duration ? 0
+                 : lower_bound(tr, timecode - tr->max_duration + 1);
+        for (; i < tr->num_entries; i++) {
+            struct mkv_index *cur = &tr->entries[i];
+            if (cur->timecode > timecode)
+                break;
+            if (cur->timecode + cur->duration > timecode &&
+                cur->filepos >= min_pos && cur->filepos < pos)
+                pos = cur->filepos;
+        }
+    }
+    return pos;
+}
+
+// Return the entry of the given track with the lowest filepos >= filepos. If
+// there is none, return the first entry. NULL if the track has no entries.
+struct mkv_index *mkv_index_seek_pos(struct mkv_index_table *t, int tnum,
+                                     uint64_t filepos)
+{
+    struct mkv_track_index *tr = mkv_index_get_track(t, tnum);
+    if (!tr || !tr->num_entries)
+        return NULL;
+    ensure_sorted(tr);
+    if (tr->filepos_sorted) {
+        size_t lo = 0, hi = tr->num_entries;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (tr->entries[mid].filepos < filepos) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return &tr->entries[lo < tr->num_entries ? lo : 0];
+    }
+    struct mkv_index *index = &tr->entries[0];
+    for (size_t i = 1; i < tr->num_entries; i++) {
+        struct mkv_index *cur = &tr->entries[i];
+        if (cur->filepos >= filepos &&
+            (index->filepos < filepos || cur->filepos < index->filepos))
+            index = cur;
+    }
+    return index;
+}
+
+// Return the highest filepos of all entries of the given track, or 0.
+uint64_t mkv_index_max_pos(struct mkv_index_table *t, int tnum)
+{
+    struct mkv_track_index *tr = mkv_index_get_track(t, tnum);
+    if (!tr || !tr->num_entries)
+        return 0;
+    ensure_sorted(tr);
+    if (tr->filepos_sorted)
+        return tr->entries[tr->num_entries - 1].filepos;
+    uint64_t pos = 0;
+    for (size_t i = 0; i < tr->num_entries; i++)
+        pos = MPMAX(pos, tr->entries[i].filepos);
+    return pos;
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MKV_INDEX_H
+#define MP_MKV_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Seek index of a Matroska file (from Cues, or built while demuxing).
+// Timecodes are in units of the segment's TimecodeScale.
+
+typedef struct mkv_index {
+    int tnum;
+    uint64_t timecode, duration;
+    uint64_t filepos; // position of the cluster which contains the packet
+} mkv_index_t;
+
+// Index entries of a single track, sorted by timecode (then filepos).
+struct mkv_track_index {
+    int tnum;
+    struct mkv_index *entries;
+    size_t num_entries;
+    uint64_t max_duration;  // largest duration of all entries
+    bool sorted;            // entries are sorted (lazily restored on lookup)
+    bool filepos_sorted;    // if sorted, filepos is sorted too
+};
+
+struct mkv_index_table {
+    struct mkv_track_index *tracks;
+    int num_tracks;
+    size_t num_entries;     // sum of all tracks' num_entries
+};
+
+struct mkv_index_table *mkv_index_table_create(void *talloc_ctx);
+void mkv_index_table_reset(struct mkv_index_table *t);
+
+void mkv_index_add(struct mkv_index_table *t, int tnum, uint64_t filepos,
+                   uint64_t timecode, uint64_t duration);
+
+struct mkv_track_index *mkv_index_get_track(struct mkv_index_table *t,
+                                            int tnum);
+struct mkv_index *mkv_index_last(struct mkv_index_table *t, int tnum);
+
+struct mkv_index *mkv_index_seek(struct mkv_index_table *t, int tnum,
+                                 int64_t target, uint64_t tc_scale,
+                                 bool backward);
+struct mkv_index *mkv_index_last_until(struct mkv_index_table *t, int tnum,
+                                       uint64_t timecode);
+uint64_t mkv_index_overlap_pos(struct mkv_index_table *t, uint64_t timecode,
+                               uint64_t min_pos, uint64_t max_pos);
+struct mkv_index *mkv_index_seek_pos(struct mkv_index_table *t, int tnum,
+                                     uint64_t filepos);
+uint64_t mkv_index_max_pos(struct mkv_index_table *t, int tnum);
+
+#endif
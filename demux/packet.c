@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -29,37 +30,249 @@
 
 #include "packet.h"
 
+// Payloads are pooled in power-of-2 size classes, from 2^MIN_CLASS_BITS up to
+// 2^MAX_CLASS_BITS bytes (including padding). Larger packets are allocated
+// directly.
+#define MIN_CLASS_BITS 10
+#define MAX_CLASS_BITS 20
+#define NUM_CLASSES (MAX_CLASS_BITS - MIN_CLASS_BITS + 1)
+
+// Limits for the unused memory kept by a pool.
+#define MAX_FREE_PACKETS 1024
+#define MAX_FREE_BYTES (32 * 1024 * 1024)
+
+// Header in front of each pooled payload allocation.
+struct payload {
+    struct payload *next;           // free list link
+    struct demux_packet_pool *pool;
+    int cls;
+};
+
+// Keep the payload data aligned.
+#define PAYLOAD_OFFSET FFALIGN(sizeof(struct payload), 64)
+
+// Pooled packets have the AVPacket in the same allocation.
+struct pooled_packet {
+    struct demux_packet dp;
+    AVPacket avpkt;
+};
+
+struct demux_packet_pool {
+    pthread_mutex_t lock;
+    // One reference for the owner, plus one for each pooled packet or payload
+    // in use. Packets can outlive the demuxer (e.g. if a decoder still holds
+    // a reference to the payload), so the pool can't go away before them.
+    int refcount;
+    bool released;          // owner is gone; don't keep unused memory
+    struct pooled_packet *free_packets[MAX_FREE_PACKETS];
+    int num_free_packets;
+    struct payload *free_payloads[NUM_CLASSES];
+    struct demux_packet_pool_stats stats;
+};
+
+struct demux_packet_pool *demux_packet_pool_create(void)
+{
+    struct demux_packet_pool *pool = talloc_zero(NULL, struct demux_packet_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+// Free all unused memory.
+// must be called locked
+static void pool_flush(struct demux_packet_pool *pool)
+{
+    for (int n = 0; n < pool->num_free_packets; n++)
+        talloc_free(pool->free_packets[n]);
+    pool->num_free_packets = 0;
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        while (pool->free_payloads[c]) {
+            struct payload *p = pool->free_payloads[c];
+            pool->free_payloads[c] = p->next;
+            av_free(p);
+        }
+    }
+    pool->stats.bytes_held = 0;
+}
+
+static void pool_unref(struct demux_packet_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    assert(pool->refcount > 0);
+    bool destroy = --pool->refcount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (destroy) {
+        pool_flush(pool);
+        pthread_mutex_destroy(&pool->lock);
+        talloc_free(pool);
+    }
+}
+
+// Drop the owner's reference. Packets still in use stay valid, but are not
+// recycled anymore.
+void demux_packet_pool_release(struct demux_packet_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->released = true;
+    pool_flush(pool);
+    pthread_mutex_unlock(&pool->lock);
+    pool_unref(pool);
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *st)
+{
+    pthread_mutex_lock(&pool->lock);
+    *st = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void payload_free(void *opaque, uint8_t *data)
+{
+    struct payload *p = opaque;
+    struct demux_packet_pool *pool = p->pool;
+    size_t size = (size_t)1 << (p->cls + MIN_CLASS_BITS);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.bytes_used -= size;
+    if (!pool->released && pool->stats.bytes_held + size <= MAX_FREE_BYTES) {
+        p->next = pool->free_payloads[p->cls];
+        pool->free_payloads[p->cls] = p;
+        pool->stats.bytes_held += size;
+        p = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    av_free(p);
+    pool_unref(pool);
+}
+
+// Set up avpkt with a padded buffer of the given size from the pool, and copy
+// data into it (if not NULL). Returns -1 if the size is not pooled.
+static int set_pooled_payload(struct demux_packet_pool *pool, AVPacket *avpkt,
+                              void *data, int len)
+{
+    size_t alloc = (size_t)len + FF_INPUT_BUFFER_PADDING_SIZE;
+    int cls = 0;
+    while (((size_t)1 << (cls + MIN_CLASS_BITS)) < alloc)
+        cls++;
+    if (cls >= NUM_CLASSES)
+        return -1;
+    size_t size = (size_t)1 << (cls + MIN_CLASS_BITS);
+
+    pthread_mutex_lock(&pool->lock);
+    struct payload *p = pool->free_payloads[cls];
+    if (p) {
+        pool->free_payloads[cls] = p->next;
+        pool->stats.bytes_held -= size;
+        pool->stats.payload_hits++;
+    }
+    pool->stats.payloads++;
+    pool->stats.bytes_used += size;
+    pool->refcount++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!p) {
+        p = av_malloc(PAYLOAD_OFFSET + size);
+        if (!p)
+            goto fail;
+        *p = (struct payload){ .pool = pool, .cls = cls };
+    }
+
+    uint8_t *buf = (uint8_t *)p + PAYLOAD_OFFSET;
+    avpkt->buf = av_buffer_create(buf, alloc, payload_free, p, 0);
+    if (!avpkt->buf)
+        goto fail;
+    avpkt->data = buf;
+    avpkt->size = len;
+    if (data)
+        memcpy(buf, data, len);
+    memset(buf + len, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    return 0;
+
+fail:
+    // Undo the accounting (also frees p if it's set).
+    if (p) {
+        payload_free(p, NULL);
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.bytes_used -= size;
+        pthread_mutex_unlock(&pool->lock);
+        pool_unref(pool);
+    }
+    return -1;
+}
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
     av_packet_unref(dp->avpacket);
+    if (dp->pool)
+        pool_unref(dp->pool);
 }
 
-// This actually preserves only data and side data, not PTS/DTS/pos/etc.
-// It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
-// does not allow it, but we do it to simplify new_demux_packet().
-struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
+static struct demux_packet *alloc_packet(struct demux_packet_pool *pool)
 {
-    if (avpkt->size > 1000000000)
-        return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
-    talloc_set_destructor(dp, packet_destroy);
+    struct demux_packet *dp = NULL;
+    AVPacket *avpkt = NULL;
+    if (pool) {
+        struct pooled_packet *pp = NULL;
+        pthread_mutex_lock(&pool->lock);
+        if (pool->num_free_packets) {
+            pp = pool->free_packets[--pool->num_free_packets];
+            pool->stats.bytes_held -= sizeof(*pp);
+            pool->stats.packet_hits++;
+        }
+        pool->stats.packets++;
+        pool->refcount++;
+        pthread_mutex_unlock(&pool->lock);
+        if (!pp) {
+            pp = talloc_zero(NULL, struct pooled_packet);
+            talloc_set_destructor(&pp->dp, packet_destroy);
+        }
+        dp = &pp->dp;
+        avpkt = &pp->avpkt;
+    } else {
+        dp = talloc(NULL, struct demux_packet);
+        talloc_set_destructor(dp, packet_destroy);
+        avpkt = talloc_zero(dp, AVPacket);
+    }
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
         .dts = MP_NOPTS_VALUE,
         .duration = -1,
         .pos = -1,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = avpkt,
+        .pool = pool,
     };
     av_init_packet(dp->avpacket);
+    return dp;
+}
+
+// This actually preserves only data and side data, not PTS/DTS/pos/etc.
+// It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
+// does not allow it, but we do it to simplify new_demux_packet().
+// pool can be NULL.
+struct demux_packet *demux_packet_pool_new_from_avpacket(
+    struct demux_packet_pool *pool, struct AVPacket *avpkt)
+{
+    if (avpkt->size > 1000000000)
+        return NULL;
+    struct demux_packet *dp = alloc_packet(pool);
     int r = -1;
-    if (avpkt->data) {
-        // We hope that this function won't need/access AVPacket input padding,
-        // because otherwise new_demux_packet_from() wouldn't work.
-        r = av_packet_ref(dp->avpacket, avpkt);
-    } else {
-        r = av_new_packet(dp->avpacket, avpkt->size);
+    if (pool && !avpkt->buf && !avpkt->side_data_elems)
+        r = set_pooled_payload(pool, dp->avpacket, avpkt->data, avpkt->size);
+    if (r < 0) {
+        if (avpkt->data) {
+            // We hope that this function won't need/access AVPacket input
+            // padding, because otherwise new_demux_packet_from() wouldn't work.
+            r = av_packet_ref(dp->avpacket, avpkt);
+        } else {
+            r = av_new_packet(dp->avpacket, avpkt->size);
+        }
     }
     if (r < 0) {
         *dp->avpacket = (AVPacket){0};
@@ -72,20 +285,37 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 }
 
 // Input data doesn't need to be padded.
-struct demux_packet *new_demux_packet_from(void *data, size_t len)
+struct demux_packet *demux_packet_pool_new_from(struct demux_packet_pool *pool,
+                                                void *data, size_t len)
 {
     if (len > INT_MAX)
         return NULL;
     AVPacket pkt = { .data = data, .size = len };
-    return new_demux_packet_from_avpacket(&pkt);
+    return demux_packet_pool_new_from_avpacket(pool, &pkt);
 }
 
-struct demux_packet *new_demux_packet(size_t len)
+struct demux_packet *demux_packet_pool_new(struct demux_packet_pool *pool,
+                                           size_t len)
 {
     if (len > INT_MAX)
         return NULL;
     AVPacket pkt = { .data = NULL, .size = len };
-    return new_demux_packet_from_avpacket(&pkt);
+    return demux_packet_pool_new_from_avpacket(pool, &pkt);
+}
+
+struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
+{
+    return demux_packet_pool_new_from_avpacket(NULL, avpkt);
+}
+
+struct demux_packet *new_demux_packet_from(void *data, size_t len)
+{
+    return demux_packet_pool_new_from(NULL, data, len);
+}
+
+struct demux_packet *new_demux_packet(size_t len)
+{
+    return demux_packet_pool_new(NULL, len);
 }
 
 void demux_packet_shorten(struct demux_packet *dp, size_t len)
@@ -95,8 +325,26 @@ void demux_packet_shorten(struct demux_packet *dp, size_t len)
     memset(dp->buffer + dp->len, 0, FF_INPUT_BUFFER_PADDING_SIZE);
 }
 
+// Free the packet, or return it to its pool. Using talloc_free() on a pooled
+// packet is allowed, but bypasses recycling.
 void free_demux_packet(struct demux_packet *dp)
 {
+    struct demux_packet_pool *pool = dp ? dp->pool : NULL;
+    if (pool) {
+        av_packet_unref(dp->avpacket);
+        pthread_mutex_lock(&pool->lock);
+        bool keep = !pool->released && pool->num_free_packets < MAX_FREE_PACKETS;
+        if (keep) {
+            // The pool still has the owner's reference, so it stays alive.
+            dp->pool = NULL;
+            pool->free_packets[pool->num_free_packets++] = (void *)dp;
+            pool->stats.bytes_held += sizeof(struct pooled_packet);
+            pool->refcount--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        if (keep)
+            return;
+    }
     talloc_free(dp);
 }
 
@@ -114,10 +362,10 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 {
     struct demux_packet *new = NULL;
     if (dp->avpacket) {
-        new = new_demux_packet_from_avpacket(dp->avpacket);
+        new = demux_packet_pool_new_from_avpacket(dp->pool, dp->avpacket);
     } else {
         // Some packets might be not created by new_demux_packet*().
-        new = new_demux_packet_from(dp->buffer, dp->len);
+        new = demux_packet_pool_new_from(dp->pool, dp->buffer, dp->len);
     }
     if (!new)
         return NULL;
@@ -34,8 +34,30 @@ typedef struct demux_packet {
     int stream; // source stream index
     struct demux_packet *next;
     struct AVPacket *avpacket;   // keep the buffer allocation
+    struct demux_packet_pool *pool; // if allocated from a pool
 } demux_packet_t;
 
+struct demux_packet_pool_stats {
+    int64_t packets;        // number of packet allocations
+    int64_t packet_hits;    // packet structs reused from the pool
+    int64_t payloads;       // number of pooled payload allocations
+    int64_t payload_hits;   // payloads reused from the pool
+    int64_t bytes_held;     // unused memory kept by the pool
+    int64_t bytes_used;     // pooled payload memory currently in use
+};
+
+struct demux_packet_pool *demux_packet_pool_create(void);
+void demux_packet_pool_release(struct demux_packet_pool *pool);
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *st);
+
+struct demux_packet *demux_packet_pool_new(struct demux_packet_pool *pool,
+                                           size_t len);
+struct demux_packet *demux_packet_pool_new_from(struct demux_packet_pool *pool,
+                                                void *data, size_t len);
+struct demux_packet *demux_packet_pool_new_from_avpacket(
+    struct demux_packet_pool *pool, struct AVPacket *avpkt);
+
 struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
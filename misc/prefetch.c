@@ -0,0 +1,204 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/threads.h"
+
+#include "prefetch.h"
+
+// A fixed number of worker threads reads the items following the one the
+// user currently needs, into a fixed number of slots. Items are identified
+// by consecutive integer keys (e.g. file offset / chunk size).
+
+enum {
+    SLOT_FREE = 0,
+    SLOT_QUEUED,    // waiting for a worker thread
+    SLOT_BUSY,      // being read by a worker thread
+    SLOT_DONE,
+};
+
+struct mp_prefetch {
+    mp_prefetch_fn fn;
+    void *ctx;
+    char *thread_name;
+    int64_t num_keys;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // signaled if a slot was queued
+    pthread_cond_t done;        // signaled if a slot was read
+    bool terminate;
+    pthread_t *threads;
+    int num_threads;
+    struct mp_prefetch_slot **slots;
+    int num_slots;
+};
+
+static void *prefetch_thread(void *arg)
+{
+    struct mp_prefetch *pf = arg;
+    mpthread_set_name(pf->thread_name);
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->terminate) {
+        // Read the queued item with the lowest key first.
+        struct mp_prefetch_slot *slot = NULL;
+        for (int n = 0; n < pf->num_slots; n++) {
+            struct mp_prefetch_slot *cur = pf->slots[n];
+            if (cur->state == SLOT_QUEUED && (!slot || cur->key < slot->key))
+                slot = cur;
+        }
+        if (!slot) {
+            pthread_cond_wait(&pf->wakeup, &pf->lock);
+            continue;
+        }
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pf->lock);
+
+        pf->fn(pf->ctx, slot);
+
+        pthread_mutex_lock(&pf->lock);
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&pf->done);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+void mp_prefetch_destroy(struct mp_prefetch *pf)
+{
+    if (!pf)
+        return;
+    pthread_mutex_lock(&pf->lock);
+    pf->terminate = true;
+    pthread_cond_broadcast(&pf->wakeup);
+    pthread_mutex_unlock(&pf->lock);
+    for (int n = 0; n < pf->num_threads; n++)
+        pthread_join(pf->threads[n], NULL);
+    pthread_cond_destroy(&pf->wakeup);
+    pthread_cond_destroy(&pf->done);
+    pthread_mutex_destroy(&pf->lock);
+    talloc_free(pf);
+}
+
+// Start depth worker threads, which read items with keys in [0, num_keys)
+// with fn. Returns NULL if no thread could be created.
+struct mp_prefetch *mp_prefetch_create(int depth, int64_t num_keys,
+                                       mp_prefetch_fn fn, void *ctx,
+                                       const char *thread_name)
+{
+    struct mp_prefetch *pf = talloc_zero(NULL, struct mp_prefetch);
+    pf->fn = fn;
+    pf->ctx = ctx;
+    pf->thread_name = talloc_strdup(pf, thread_name);
+    pf->num_keys = num_keys;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wakeup, NULL);
+    pthread_cond_init(&pf->done, NULL);
+    // Twice as many slots as items read at once, so that items which are
+    // still being read can't prevent queuing new ones after a seek.
+    pf->num_slots = depth * 2;
+    pf->slots = talloc_array(pf, struct mp_prefetch_slot *, pf->num_slots);
+    for (int n = 0; n < pf->num_slots; n++)
+        pf->slots[n] = talloc_zero(pf, struct mp_prefetch_slot);
+    pf->threads = talloc_array(pf, pthread_t, depth);
+    for (int n = 0; n < depth; n++) {
+        if (pthread_create(&pf->threads[n], NULL, prefetch_thread, pf))
+            break;
+        pf->num_threads++;
+    }
+    if (!pf->num_threads) {
+        mp_prefetch_destroy(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+int mp_prefetch_num_threads(struct mp_prefetch *pf)
+{
+    return pf->num_threads;
+}
+
+static struct mp_prefetch_slot *find_slot(struct mp_prefetch *pf, int64_t key)
+{
+    for (int n = 0; n < pf->num_slots; n++) {
+        struct mp_prefetch_slot *slot = pf->slots[n];
+        if (slot->state != SLOT_FREE && slot->key == key)
+            return slot;
+    }
+    return NULL;
+}
+
+// Make sure the given key and the following ones are queued, reusing slots
+// of keys outside of this range.
+static void schedule(struct mp_prefetch *pf, int64_t key)
+{
+    int64_t end = MPMIN(key + pf->num_threads, pf->num_keys);
+    bool queued = false;
+    for (int64_t k = key; k < end; k++) {
+        if (find_slot(pf, k))
+            continue;
+        struct mp_prefetch_slot *slot = NULL;
+        for (int n = 0; n < pf->num_slots; n++) {
+            struct mp_prefetch_slot *cur = pf->slots[n];
+            if (cur->state == SLOT_BUSY)
+                continue;
+            if (cur->state == SLOT_FREE || cur->key < key || cur->key >= end) {
+                slot = cur;
+                break;
+            }
+        }
+        if (!slot)
+            break;
+        slot->state = SLOT_QUEUED;
+        slot->key = k;
+        queued = true;
+    }
+    if (queued)
+        pthread_cond_broadcast(&pf->wakeup);
+}
+
+// Queue the given key and the following ones, and wait until the given key
+// was read. Returns its slot with the pool locked; the caller can access (or
+// take over) slot->data, and must call mp_prefetch_release() after that.
+// Returns NULL if no slot was available (the pool is not locked then).
+// This and mp_prefetch_release() must always be called from the same thread.
+struct mp_prefetch_slot *mp_prefetch_wait(struct mp_prefetch *pf, int64_t key)
+{
+    pthread_mutex_lock(&pf->lock);
+    schedule(pf, key);
+    struct mp_prefetch_slot *slot = find_slot(pf, key);
+    // Only the user thread reuses slots, so slot stays valid while waiting.
+    while (slot && slot->state != SLOT_DONE)
+        pthread_cond_wait(&pf->done, &pf->lock);
+    if (!slot)
+        pthread_mutex_unlock(&pf->lock);
+    return slot;
+}
+
+// Unlock the pool after mp_prefetch_wait(). If discard is set, the slot is not
+// kept for further mp_prefetch_wait() calls with the same key, and is used to
+// read the next key instead.
+void mp_prefetch_release(struct mp_prefetch *pf, struct mp_prefetch_slot *slot,
+                         bool discard)
+{
+    if (discard) {
+        slot->state = SLOT_FREE;
+        schedule(pf, slot->key + 1);
+    }
+    pthread_mutex_unlock(&pf->lock);
+}
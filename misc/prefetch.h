@@ -0,0 +1,32 @@
+#ifndef MP_PREFETCH_H_
+#define MP_PREFETCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Result of reading the item identified by key. The slot is a talloc context,
+// so data can be allocated with it as parent (it's freed with the pool).
+struct mp_prefetch_slot {
+    int64_t key;
+    void *data;     // set by the read function
+    int64_t len;    // set by the read function
+    int state;      // private
+};
+
+// Read slot->key, and set slot->data and slot->len. Called on a worker thread,
+// without the pool locked. If the slot is reused, data and len still contain
+// the previous result.
+typedef void (*mp_prefetch_fn)(void *ctx, struct mp_prefetch_slot *slot);
+
+struct mp_prefetch;
+
+struct mp_prefetch *mp_prefetch_create(int depth, int64_t num_keys,
+                                       mp_prefetch_fn fn, void *ctx,
+                                       const char *thread_name);
+void mp_prefetch_destroy(struct mp_prefetch *pf);
+int mp_prefetch_num_threads(struct mp_prefetch *pf);
+struct mp_prefetch_slot *mp_prefetch_wait(struct mp_prefetch *pf, int64_t key);
+void mp_prefetch_release(struct mp_prefetch *pf, struct mp_prefetch_slot *slot,
+                         bool discard);
+
+#endif
@@ -976,3 +976,20 @@ struct m_config *m_config_dup(void *talloc_ctx, struct m_config *config)
     }
     return new;
 }
+
+bool m_config_equals(struct m_config *a, struct m_config *b)
+{
+    assert(a->num_opts == b->num_opts);
+    bool equal = true;
+    for (int n = 0; n < a->num_opts && equal; n++) {
+        struct m_config_option *co_a = &a->opts[n], *co_b = &b->opts[n];
+        if (!co_a->data || !co_b->data)
+            continue;
+        char *va = m_option_print(co_a->opt, co_a->data);
+        char *vb = m_option_print(co_b->opt, co_b->data);
+        equal = (!va && !vb) || (va && vb && strcmp(va, vb) == 0);
+        talloc_free(va);
+        talloc_free(vb);
+    }
+    return equal;
+}
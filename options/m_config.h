@@ -95,6 +95,10 @@ struct m_config *m_config_new(void *talloc_ctx, struct mp_log *log,
 // (Warning: new object references config->log and others.)
 struct m_config *m_config_dup(void *talloc_ctx, struct m_config *config);
 
+// Return whether all options have the same values in a and b. One of them must
+// be a copy of the other made with m_config_dup().
+bool m_config_equals(struct m_config *a, struct m_config *b);
+
 struct m_config *m_config_from_obj_desc(void *talloc_ctx, struct mp_log *log,
                                         struct m_obj_desc *desc);
 
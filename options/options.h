@@ -85,6 +85,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_thread;
 
     mp_vo_opts vo;
     int allow_win_drag;
@@ -115,11 +116,14 @@ typedef struct MPOpts {
     int osd_duration;
     int osd_fractions;
     int untimed;
+    int file_readahead;
+    int file_mmap;
     char *stream_capture;
     char *stream_dump;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
+    double prefetch_playlist;
     int shuffle;
     int ordered_chapters;
     char *ordered_chapters_files;
@@ -194,6 +198,8 @@ typedef struct MPOpts {
     int demuxer_min_packs;
     int demuxer_min_bytes;
     double demuxer_min_secs;
+    int demuxer_max_back_bytes;
+    int demuxer_index_cache;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -283,6 +289,7 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
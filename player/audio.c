@@ -21,6 +21,7 @@
 #include <limits.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "talloc.h"
@@ -29,6 +30,9 @@
 #include "common/encode.h"
 #include "options/options.h"
 #include "common/common.h"
+#include "input/input.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "audio/mixer.h"
 #include "audio/audio.h"
@@ -132,6 +136,91 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
     recreate_audio_filters(mpctx);
 }
 
+static void fill_audio(struct MPContext *mpctx, double endpts, bool in_thread);
+
+// With --audio-thread, the main thread holds the lock at all times, except in
+// places where it's known not to touch any playback state (while sleeping and
+// while decoding video). Only then the thread can refill the AO, which it does
+// with the same code the playloop uses.
+struct audio_thread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    double period;
+    bool terminate;
+};
+
+static void *audio_thread(void *p)
+{
+    struct MPContext *mpctx = p;
+    struct audio_thread *t = mpctx->audio_thread;
+    mpthread_set_name("audio");
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->terminate) {
+        fill_audio(mpctx, get_play_end_pts(mpctx), true);
+        struct timespec ts = mp_rel_time_to_timespec(t->period);
+        pthread_cond_timedwait(&t->wakeup, &t->lock, &ts);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static void start_audio_thread(struct MPContext *mpctx)
+{
+    if (mpctx->audio_thread || !mpctx->opts->audio_thread ||
+        mpctx->encode_lavc_ctx)
+        return;
+
+    struct audio_thread *t = talloc_zero(NULL, struct audio_thread);
+    // Poll often enough to refill the AO buffer before it runs out.
+    t->period = MPCLAMP(mpctx->opts->audio_buffer / 4, 0.005, 0.05);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    pthread_mutex_lock(&t->lock);
+    mpctx->audio_thread = t;
+    if (pthread_create(&t->thread, NULL, audio_thread, mpctx)) {
+        mpctx->audio_thread = NULL;
+        pthread_mutex_unlock(&t->lock);
+        pthread_cond_destroy(&t->wakeup);
+        pthread_mutex_destroy(&t->lock);
+        talloc_free(t);
+    }
+}
+
+static void stop_audio_thread(struct MPContext *mpctx)
+{
+    struct audio_thread *t = mpctx->audio_thread;
+    if (!t)
+        return;
+    t->terminate = true;
+    pthread_cond_signal(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+    talloc_free(t);
+    mpctx->audio_thread = NULL;
+}
+
+// Let the audio thread run until mp_audio_thread_lock() is called. The caller
+// must not access any player state in between.
+void mp_audio_thread_unlock(struct MPContext *mpctx)
+{
+    struct audio_thread *t = mpctx->audio_thread;
+    if (t) {
+        pthread_cond_signal(&t->wakeup);
+        pthread_mutex_unlock(&t->lock);
+    }
+}
+
+void mp_audio_thread_lock(struct MPContext *mpctx)
+{
+    struct audio_thread *t = mpctx->audio_thread;
+    if (t)
+        pthread_mutex_lock(&t->lock);
+}
+
 void reset_audio_state(struct MPContext *mpctx)
 {
     if (mpctx->d_audio)
@@ -144,6 +233,7 @@ void reset_audio_state(struct MPContext *mpctx)
 
 void uninit_audio_out(struct MPContext *mpctx)
 {
+    stop_audio_thread(mpctx);
     if (mpctx->ao) {
         // Note: with gapless_audio, stop_play is not correctly set
         if (mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE)
@@ -160,6 +250,9 @@ void uninit_audio_out(struct MPContext *mpctx)
 
 void uninit_audio_chain(struct MPContext *mpctx)
 {
+    stop_audio_thread(mpctx);
+    audio_uninit(mpctx->primed_audio);
+    mpctx->primed_audio = NULL;
     if (mpctx->d_audio) {
         mixer_uninit_audio(mpctx->mixer);
         audio_uninit(mpctx->d_audio);
@@ -186,19 +279,32 @@ void reinit_audio_chain(struct MPContext *mpctx)
     mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
 
     if (!mpctx->d_audio) {
-        mpctx->d_audio = talloc_zero(NULL, struct dec_audio);
-        mpctx->d_audio->log = mp_log_new(mpctx->d_audio, mpctx->log, "!ad");
+        bool primed = mpctx->primed_audio && mpctx->primed_audio->header == sh;
+        if (primed) {
+            mpctx->d_audio = mpctx->primed_audio;
+            mpctx->primed_audio = NULL;
+        } else {
+            mpctx->d_audio = talloc_zero(NULL, struct dec_audio);
+            mpctx->d_audio->log = mp_log_new(mpctx->d_audio, mpctx->log, "!ad");
+            mpctx->d_audio->header = sh;
+            mpctx->d_audio->pool = mp_audio_pool_create(mpctx->d_audio);
+            mpctx->d_audio->spdif_passthrough = true;
+        }
         mpctx->d_audio->global = mpctx->global;
         mpctx->d_audio->opts = opts;
-        mpctx->d_audio->header = sh;
-        mpctx->d_audio->pool = mp_audio_pool_create(mpctx->d_audio);
         mpctx->d_audio->afilter = af_new(mpctx->global);
         mpctx->d_audio->afilter->replaygain_data = sh->audio->replaygain_data;
-        mpctx->d_audio->spdif_passthrough = true;
         mpctx->ao_buffer = mp_audio_buffer_create(NULL);
-        if (!audio_init_best_codec(mpctx->d_audio))
-            goto init_error;
-        reset_audio_state(mpctx);
+        if (primed) {
+            // Keep the audio it decoded already.
+            MP_VERBOSE(mpctx, "Using primed audio decoder.\n");
+            mpctx->audio_status = STATUS_SYNCING;
+            mpctx->delay = 0;
+        } else {
+            if (!audio_init_best_codec(mpctx->d_audio))
+                goto init_error;
+            reset_audio_state(mpctx);
+        }
 
         if (mpctx->ao) {
             struct mp_audio fmt;
@@ -305,6 +411,7 @@ void reinit_audio_chain(struct MPContext *mpctx)
 
     set_playback_speed(mpctx, opts->playback_speed);
 
+    start_audio_thread(mpctx);
     return;
 
 init_error:
@@ -451,12 +558,20 @@ static bool get_sync_samples(struct MPContext *mpctx, int *skip)
     return true;
 }
 
-void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
+// in_thread: called by the audio thread, which can only continue playback.
+static void fill_audio(struct MPContext *mpctx, double endpts, bool in_thread)
 {
     struct MPOpts *opts = mpctx->opts;
     struct dec_audio *d_audio = mpctx->d_audio;
 
-    if (mpctx->ao && ao_query_and_reset_events(mpctx->ao, AO_EVENT_RELOAD)) {
+    if (in_thread && (!d_audio || !mpctx->ao ||
+                      d_audio->afilter->initialized < 1 ||
+                      mpctx->audio_status != STATUS_PLAYING))
+        return;
+
+    if (!in_thread && mpctx->ao &&
+        ao_query_and_reset_events(mpctx->ao, AO_EVENT_RELOAD))
+    {
         ao_reset(mpctx->ao);
         uninit_audio_out(mpctx);
         if (d_audio)
@@ -510,6 +625,11 @@ void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
         status = audio_decode(d_audio, mpctx->ao_buffer, playsize);
         if (status == AD_WAIT)
             return;
+        if (status == AD_NEW_FMT && in_thread) {
+            // The decoder keeps returning this until the chain is reinited.
+            mp_input_wakeup(mpctx->input);
+            return;
+        }
         if (status == AD_NEW_FMT) {
             /* The format change isn't handled too gracefully. A more precise
              * implementation would require draining buffered old-format audio
@@ -601,12 +721,21 @@ void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
     if (mpctx->paused)
         playsize = 0;
 
-    struct mp_audio data;
-    mp_audio_buffer_peek(mpctx->ao_buffer, &data);
-    data.samples = MPMIN(data.samples, playsize);
-    int played = write_to_ao(mpctx, &data, playflags, written_audio_pts(mpctx));
-    assert(played >= 0 && played <= data.samples);
-    mp_audio_buffer_skip(mpctx->ao_buffer, played);
+    // The buffered data can wrap around the end of the ring buffer.
+    struct mp_audio data[2];
+    mp_audio_buffer_peek(mpctx->ao_buffer, &data[0], &data[1]);
+    for (int n = 0; n < 2; n++) {
+        data[n].samples = MPMIN(data[n].samples, playsize);
+        playsize -= data[n].samples;
+        // Only the last part can be the final chunk.
+        int flags = playsize ? playflags & ~AOPLAY_FINAL_CHUNK : playflags;
+        int played = write_to_ao(mpctx, &data[n], flags,
+                                 written_audio_pts(mpctx));
+        assert(played >= 0 && played <= data[n].samples);
+        mp_audio_buffer_skip(mpctx->ao_buffer, played);
+        if (played < data[n].samples || !playsize)
+            break;
+    }
 
     mpctx->audio_status = STATUS_PLAYING;
     if (audio_eof && !mpctx->paused) {
@@ -615,9 +744,16 @@ void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
         // we trigger EOF immediately, and let it play asynchronously.
         if (ao_eof_reached(mpctx->ao) || opts->gapless_audio)
             mpctx->audio_status = STATUS_EOF;
+        if (in_thread)
+            mp_input_wakeup(mpctx->input);
     }
 }
 
+void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
+{
+    fill_audio(mpctx, endpts, false);
+}
+
 // Drop data queued for output, or which the AO is currently outputting.
 void clear_audio_output_buffers(struct MPContext *mpctx)
 {
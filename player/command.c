@@ -1415,6 +1415,44 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, s.idle);
 }
 
+static int mp_property_demuxer_index_progress(void *ctx, struct m_property *prop,
+                                              int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    double progress;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_INDEX_PROGRESS,
+                      &progress) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_double_ro(action, arg, progress * 100);
+}
+
+static int mp_property_demuxer_packet_pool(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || !mpctx->demuxer->packet_pool)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct demux_packet_pool_stats s;
+    demux_packet_pool_get_stats(mpctx->demuxer->packet_pool, &s);
+
+    struct m_sub_property props[] = {
+        {"packets",         SUB_PROP_INT64(s.packets)},
+        {"packet-hits",     SUB_PROP_INT64(s.packet_hits)},
+        {"payloads",        SUB_PROP_INT64(s.payloads)},
+        {"payload-hits",    SUB_PROP_INT64(s.payload_hits)},
+        {"bytes-held",      SUB_PROP_INT64(s.bytes_held)},
+        {"bytes-used",      SUB_PROP_INT64(s.bytes_used)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_paused_for_cache(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
@@ -3342,6 +3380,8 @@ static const struct m_property mp_properties[] = {
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
+    {"demuxer-index-progress", mp_property_demuxer_index_progress},
+    {"demuxer-packet-pool", mp_property_demuxer_packet_pool},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"pts-association-mode", mp_property_generic_option},
@@ -3542,7 +3582,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_CHAPTER_CHANGE, "chapter", "chapter-metadata"),
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
-      "demuxer-cache-time"),
+      "demuxer-cache-time", "demuxer-index-progress"),
     E(MP_EVENT_WIN_RESIZE, "window-scale"),
     E(MP_EVENT_WIN_STATE, "window-minimized", "display-names", "display-fps"),
 };
@@ -4730,6 +4770,14 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         return edit_filters_osd(mpctx, STREAM_AUDIO, cmd->args[0].v.s,
                                 cmd->args[1].v.s, msg_osd);
 
+    case MP_CMD_AF_COMMAND:
+        if (!mpctx->d_audio)
+            return -1;
+        if (af_send_command(mpctx->d_audio->afilter, cmd->args[0].v.s,
+                            cmd->args[1].v.s, cmd->args[2].v.s) != AF_OK)
+            return -1;
+        break;
+
     case MP_CMD_VF:
         return edit_filters_osd(mpctx, STREAM_VIDEO, cmd->args[0].v.s,
                                 cmd->args[1].v.s, msg_osd);
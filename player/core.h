@@ -144,6 +144,9 @@ typedef struct MPContext {
     struct mp_client_api *clients;
     struct mp_dispatch_queue *dispatch;
     struct mp_cancel *playback_abort;
+    // Next playlist entry opened ahead of time (--prefetch-playlist), or NULL.
+    struct playlist_prefetch *prefetch;
+    bool prefetch_started; // prefetching was attempted for the current file
 
     struct mp_log *statusline;
     struct osd_state *osd;
@@ -194,6 +197,8 @@ typedef struct MPContext {
     struct timeline_part *timeline;
     int num_timeline_parts;
     int timeline_part;
+    // Part whose source was seeked to the part start ahead of time, or -1.
+    int timeline_preload_part;
     struct demux_chapter *chapters;
     int num_chapters;
     double video_offset;
@@ -213,6 +218,8 @@ typedef struct MPContext {
 
     struct dec_video *d_video;
     struct dec_audio *d_audio;
+    // Decoder opened with the prefetched file, used by reinit_audio_chain().
+    struct dec_audio *primed_audio;
     struct dec_sub *d_sub[2];
 
     // Uses: accessing metadata (consider ordered chapters case, where the main
@@ -224,6 +231,7 @@ typedef struct MPContext {
     struct ao *ao;
     struct mp_audio *ao_decoder_fmt; // for weak gapless audio check
     struct mp_audio_buffer *ao_buffer;  // queued audio; passed to ao_play() later
+    struct audio_thread *audio_thread;  // --audio-thread, or NULL
 
     struct vo *video_out;
     // next_frame[0] is the next frame, next_frame[1] the one after that.
@@ -358,6 +366,8 @@ void clear_audio_output_buffers(struct MPContext *mpctx);
 void set_playback_speed(struct MPContext *mpctx, double new_speed);
 void uninit_audio_out(struct MPContext *mpctx);
 void uninit_audio_chain(struct MPContext *mpctx);
+void mp_audio_thread_unlock(struct MPContext *mpctx);
+void mp_audio_thread_lock(struct MPContext *mpctx);
 
 // configfiles.c
 void mp_parse_cfgfiles(struct MPContext *mpctx);
@@ -390,6 +400,8 @@ void mp_deselect_track(struct MPContext *mpctx, struct track *track);
 struct track *mp_track_by_tid(struct MPContext *mpctx, enum stream_type type,
                               int tid);
 double timeline_set_from_time(struct MPContext *mpctx, double pts, bool *need_reset);
+void timeline_preload_next(struct MPContext *mpctx);
+void prefetch_next_file(struct MPContext *mpctx);
 void add_demuxer_tracks(struct MPContext *mpctx, struct demuxer *demuxer);
 bool mp_remove_track(struct MPContext *mpctx, struct track *track);
 struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
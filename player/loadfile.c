@@ -20,6 +20,7 @@
 #include <strings.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/avutil.h>
 
@@ -28,6 +29,7 @@
 
 #include "osdep/io.h"
 #include "osdep/terminal.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "common/msg.h"
@@ -260,6 +262,18 @@ static struct sh_stream *select_fallback_stream(struct demuxer *d,
     return best_stream;
 }
 
+// Return the stream of the source d that track maps to in a timeline.
+static struct sh_stream *timeline_track_stream(struct track *track,
+                                              struct demuxer *d)
+{
+    struct sh_stream *stream = demuxer_stream_by_demuxer_id(d, track->type,
+                                                            track->demuxer_id);
+    // EDL can have mismatched files in the same timeline
+    if (!stream)
+        stream = select_fallback_stream(d, track->type, track->user_tid - 1);
+    return stream;
+}
+
 // Called from the demuxer thread if a new packet is available.
 static void wakeup_demux(void *pctx)
 {
@@ -306,6 +320,16 @@ static bool timeline_set_part(struct MPContext *mpctx, int i, bool initial)
         demux_flush(mpctx->demuxer);
     }
 
+    // Keep the readahead of the preloaded source only if it's used now.
+    if (mpctx->timeline_preload_part >= 0) {
+        struct demuxer *pre = mpctx->timeline[mpctx->timeline_preload_part].source;
+        if (pre != n->source) {
+            demux_stop_thread(pre);
+            demux_flush(pre);
+        }
+        mpctx->timeline_preload_part = -1;
+    }
+
     mpctx->demuxer = n->source;
 
     // While another timeline was active, the selection of active tracks might
@@ -314,15 +338,7 @@ static bool timeline_set_part(struct MPContext *mpctx, int i, bool initial)
         struct track *track = mpctx->tracks[x];
         if (track->under_timeline) {
             track->demuxer = mpctx->demuxer;
-            track->stream = demuxer_stream_by_demuxer_id(track->demuxer,
-                                                         track->type,
-                                                         track->demuxer_id);
-            // EDL can have mismatched files in the same timeline
-            if (!track->stream) {
-                track->stream = select_fallback_stream(track->demuxer,
-                                                       track->type,
-                                                       track->user_tid - 1);
-            }
+            track->stream = timeline_track_stream(track, track->demuxer);
         }
     }
 
@@ -353,6 +369,55 @@ double timeline_set_from_time(struct MPContext *mpctx, double pts, bool *need_re
     return pts - mpctx->timeline[new].start + mpctx->timeline[new].source_start;
 }
 
+// Select the streams of the timeline source d which the currently selected
+// tracks would use. Return whether the selection changed.
+static bool select_timeline_streams(struct MPContext *mpctx, struct demuxer *d)
+{
+    bool changed = false;
+    for (int n = 0; n < d->num_streams; n++) {
+        struct sh_stream *stream = d->streams[n];
+        bool selected = false;
+        for (int x = 0; x < mpctx->num_tracks; x++) {
+            struct track *track = mpctx->tracks[x];
+            if (track->under_timeline && track->selected &&
+                timeline_track_stream(track, d) == stream)
+                selected = true;
+        }
+        if (demux_stream_is_selected(stream) != selected) {
+            demuxer_select_track(d, stream, selected);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// If the next timeline part uses a different source, seek that source to the
+// start of the part and let its demuxer thread read ahead, so that switching
+// to it on playback doesn't have to wait for the seek and the first packets.
+void timeline_preload_next(struct MPContext *mpctx)
+{
+    int next = mpctx->timeline_part + 1;
+    if (!mpctx->timeline || !mpctx->opts->demuxer_thread ||
+        next >= mpctx->num_timeline_parts)
+        return;
+    struct timeline_part *n = mpctx->timeline + next;
+    if (n->source == mpctx->demuxer || !n->source->seekable)
+        return;
+
+    // Redo the preloading if the track selection was changed meanwhile.
+    bool changed = select_timeline_streams(mpctx, n->source);
+    if (!changed && mpctx->timeline_preload_part == next)
+        return;
+
+    MP_VERBOSE(mpctx, "Preloading timeline part %d.\n", next);
+    demux_set_wakeup_cb(n->source, wakeup_demux, mpctx);
+    demux_start_thread(n->source);
+    demux_seek(n->source, n->source_start - mpctx->opts->hr_seek_demuxer_offset,
+               SEEK_ABSOLUTE | SEEK_BACKWARD);
+    demux_prefetch(n->source);
+    mpctx->timeline_preload_part = next;
+}
+
 static int find_new_tid(struct MPContext *mpctx, enum stream_type t)
 {
     int new_id = 0;
@@ -1004,6 +1069,256 @@ static void load_timeline(struct MPContext *mpctx)
     print_timeline(mpctx);
 }
 
+struct playlist_prefetch {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+    struct playlist_entry *entry;
+    char *filename;
+    int stream_flags;
+    struct mp_cancel *cancel;
+    struct mpv_global *stream_global;   // copies of the global options
+    struct mpv_global *demux_global;
+    struct m_config *config;            // options when opening was started
+    bool use_thread;
+    bool prime_audio;
+    pthread_t thread;
+    // results
+    struct stream *stream;
+    struct demuxer *demux;
+    struct timeline *tl;
+    struct dec_audio *d_audio;
+};
+
+// Open the decoder of the file's audio stream and decode the first frame, so
+// that audio can be written right after the previous file's (gapless audio).
+// Only done if the file has a single audio stream, because the track
+// selection is not known yet.
+static void prime_audio_decoder(struct playlist_prefetch *pf)
+{
+    struct demuxer *demux = pf->demux;
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux->num_streams; n++) {
+        if (demux->streams[n]->type == STREAM_AUDIO) {
+            if (sh)
+                return;
+            sh = demux->streams[n];
+        }
+    }
+    if (!sh)
+        return;
+    // Decoding reads packets of all streams until it gets an audio packet,
+    // and packets of unselected streams are dropped, which would lose the
+    // start of the video (the demuxer is not seeked back).
+    for (int n = 0; n < demux->num_streams; n++)
+        assert(demux_stream_is_selected(demux->streams[n]));
+
+    struct dec_audio *d_audio = talloc_zero(NULL, struct dec_audio);
+    d_audio->log = mp_log_new(d_audio, pf->log, "!ad");
+    d_audio->global = pf->demux_global;
+    d_audio->opts = pf->demux_global->opts;
+    d_audio->header = sh;
+    d_audio->pool = mp_audio_pool_create(d_audio);
+    d_audio->spdif_passthrough = true;
+    d_audio->pts = MP_NOPTS_VALUE;
+    if (!audio_init_best_codec(d_audio) ||
+        initial_audio_decode(d_audio) != AD_OK)
+    {
+        audio_uninit(d_audio);
+        return;
+    }
+    pf->d_audio = d_audio;
+}
+
+static void *prefetch_thread(void *pctx)
+{
+    struct playlist_prefetch *pf = pctx;
+    mpthread_set_name("prefetch");
+
+    struct stream *s = stream_create(pf->filename, pf->stream_flags,
+                                     pf->cancel, pf->stream_global);
+    if (!s)
+        return NULL;
+    stream_enable_cache(&s, &pf->stream_global->opts->stream_cache);
+    pf->stream = s;
+
+    struct demuxer_params p = {
+        .force_format = pf->demux_global->opts->demuxer_name,
+    };
+    pf->demux = demux_open(s, &p, pf->demux_global);
+    if (!pf->demux)
+        return NULL;
+    pf->tl = timeline_load(pf->demux_global, pf->log, pf->demux);
+    if (pf->tl || pf->demux->playlist)
+        return NULL;
+
+    // Fill the packet queues of all streams; the ones not selected for
+    // playback are flushed when the tracks are selected.
+    if (pf->use_thread || pf->prime_audio) {
+        for (int n = 0; n < pf->demux->num_streams; n++)
+            demuxer_select_track(pf->demux, pf->demux->streams[n], true);
+    }
+
+    // Before starting the demuxer thread, as this reads packets synchronously.
+    if (pf->prime_audio)
+        prime_audio_decoder(pf);
+
+    if (pf->use_thread) {
+        demux_set_wakeup_cb(pf->demux, wakeup_demux, pf->mpctx);
+        demux_start_thread(pf->demux);
+        demux_prefetch(pf->demux);
+    }
+    return NULL;
+}
+
+static void prefetch_destroy(struct playlist_prefetch *pf)
+{
+    mp_cancel_trigger(pf->cancel);
+    pthread_join(pf->thread, NULL);
+    audio_uninit(pf->d_audio);
+    timeline_destroy(pf->tl);
+    free_demuxer(pf->demux);
+    free_stream(pf->stream);
+    playlist_entry_unref(pf->entry);
+    talloc_free(pf);
+}
+
+// Abort and free the prefetched entry, unless it's keep.
+static void cancel_prefetch(struct MPContext *mpctx, struct playlist_entry *keep)
+{
+    struct playlist_prefetch *pf = mpctx->prefetch;
+    if (!pf || pf->entry == keep)
+        return;
+    MP_VERBOSE(mpctx, "Discarding prefetched %s\n", pf->filename);
+    prefetch_destroy(pf);
+    mpctx->prefetch = NULL;
+}
+
+// Things like disc, TV or CD streams can't be opened a second time while the
+// current file still uses the device, so only files and network streams are
+// prefetched. This has to be decided before opening the stream.
+static bool can_prefetch_protocol(const char *filename)
+{
+    static const char *const protocols[] = {
+        "file", "http", "https", "ftp", "edl", "mf", NULL
+    };
+    bstr proto = mp_split_proto(bstr0(filename), NULL);
+    if (!proto.len)
+        return true; // plain path
+    for (int n = 0; protocols[n]; n++) {
+        if (bstrcasecmp0(proto, protocols[n]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// If the current file is in its last --prefetch-playlist seconds, start
+// opening the next playlist entry in the background.
+void prefetch_next_file(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (opts->prefetch_playlist <= 0 || mpctx->prefetch ||
+        mpctx->prefetch_started || opts->loop_file ||
+        (opts->stream_dump && opts->stream_dump[0]))
+        return;
+
+    double len = get_time_length(mpctx);
+    double pos = get_current_time(mpctx);
+    if (len <= 0 || pos == MP_NOPTS_VALUE ||
+        get_start_time(mpctx) + len - pos > opts->prefetch_playlist)
+        return;
+    mpctx->prefetch_started = true;
+
+    // The next file would be opened with the options of the current file.
+    struct playlist_entry *next = playlist_get_next(mpctx->playlist, +1);
+    if (!next || !next->filename || next->num_params ||
+        mpctx->playing->num_params)
+        return;
+    if (!can_prefetch_protocol(next->filename)) {
+        MP_VERBOSE(mpctx, "Not prefetching this type of stream.\n");
+        return;
+    }
+
+    struct playlist_prefetch *pf = talloc_ptrtype(NULL, pf);
+    *pf = (struct playlist_prefetch){
+        .mpctx = mpctx,
+        .log = mpctx->log,
+        .entry = next,
+        .filename = talloc_strdup(pf, next->filename),
+        .stream_flags = STREAM_READ,
+        .cancel = mp_cancel_new(pf),
+        .stream_global = create_sub_global(mpctx),
+        .demux_global = create_sub_global(mpctx),
+        .config = m_config_dup(pf, mpctx->mconfig),
+        .use_thread = opts->demuxer_thread,
+        .prime_audio = opts->gapless_audio && !mpctx->encode_lavc_ctx,
+    };
+    talloc_steal(pf, pf->stream_global);
+    talloc_steal(pf, pf->demux_global);
+    if (!opts->load_unsafe_playlists)
+        pf->stream_flags |= next->stream_flags;
+    if (pthread_create(&pf->thread, NULL, prefetch_thread, pf)) {
+        talloc_free(pf);
+        return;
+    }
+    next->reserved += 1;
+    mpctx->prefetch = pf;
+    MP_VERBOSE(mpctx, "Prefetching %s\n", pf->filename);
+}
+
+static void join_prefetch_thread(void *pctx)
+{
+    struct playlist_prefetch *pf = pctx;
+    pthread_join(pf->thread, NULL);
+}
+
+// Take over the stream and demuxer opened by prefetch_next_file(), if they
+// are for the file that is going to be played. Returns success.
+static bool use_prefetch(struct MPContext *mpctx, int stream_flags)
+{
+    struct playlist_prefetch *pf = mpctx->prefetch;
+    if (!pf)
+        return false;
+    if (pf->entry != mpctx->playing || pf->stream_flags != stream_flags ||
+        strcmp(pf->filename, mpctx->stream_open_filename) != 0)
+    {
+        cancel_prefetch(mpctx, NULL);
+        return false;
+    }
+    // The file was opened with the options as they were while the previous
+    // file was playing. Options applied since then (--reset-on-next-file,
+    // auto profiles, resumed playback, file-local options set by hooks, or
+    // runtime changes) would be ignored by it.
+    if (!m_config_equals(pf->config, mpctx->mconfig)) {
+        MP_VERBOSE(mpctx, "Options changed, not using prefetched file.\n");
+        cancel_prefetch(mpctx, NULL);
+        return false;
+    }
+    mpctx->prefetch = NULL;
+
+    // Everything opened by the prefetch thread uses its own cancel object.
+    mp_cancel_set_parent(pf->cancel, mpctx->playback_abort);
+
+    // Wait until it's done opening, while still reacting to input.
+    mpctx_run_reentrant(mpctx, join_prefetch_thread, pf);
+
+    bool ok = pf->demux;
+    if (ok) {
+        MP_VERBOSE(mpctx, "Using prefetched file.\n");
+        mpctx->stream = pf->stream;
+        talloc_steal(pf->stream, pf->stream_global);
+        mpctx->master_demuxer = pf->demux;
+        talloc_steal(pf->demux, pf->demux_global);
+        mpctx->tl = pf->tl;
+        mpctx->primed_audio = pf->d_audio;
+        talloc_steal(pf->stream, pf->cancel);
+    } else {
+        free_stream(pf->stream);
+    }
+    playlist_entry_unref(pf->entry);
+    talloc_free(pf);
+    return ok;
+}
+
 // Start playing the current playlist entry.
 // Handle initialization and deinitialization.
 static void play_current_file(struct MPContext *mpctx)
@@ -1029,6 +1344,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->paused_for_cache = false;
     mpctx->playing_msg_shown = false;
     mpctx->backstep_active = false;
+    mpctx->prefetch_started = false;
     mpctx->max_frames = -1;
     mpctx->seek = (struct seek_params){ 0 };
 
@@ -1081,8 +1397,12 @@ static void play_current_file(struct MPContext *mpctx)
     int stream_flags = STREAM_READ;
     if (!opts->load_unsafe_playlists)
         stream_flags |= mpctx->playing->stream_flags;
-    mpctx->stream = open_stream_reentrant(mpctx, mpctx->stream_open_filename,
-                                          stream_flags);
+    bool prefetched = use_prefetch(mpctx, stream_flags);
+    if (!prefetched) {
+        mpctx->stream = open_stream_reentrant(mpctx,
+                                              mpctx->stream_open_filename,
+                                              stream_flags);
+    }
     if (!mpctx->stream)
         goto terminate_playback;
 
@@ -1095,7 +1415,8 @@ static void play_current_file(struct MPContext *mpctx)
     // Must be called before enabling cache.
     mp_nav_init(mpctx);
 
-    stream_enable_cache(&mpctx->stream, &opts->stream_cache);
+    if (!prefetched)
+        stream_enable_cache(&mpctx->stream, &opts->stream_cache);
 
     mp_notify(mpctx, MP_EVENT_CHANGE_ALL, NULL);
     mp_process_input(mpctx);
@@ -1108,7 +1429,10 @@ goto_reopen_demuxer: ;
 
     mp_nav_reset(mpctx);
 
-    open_demux_reentrant(mpctx);
+    // The prefetched demuxer can be used only once.
+    if (!prefetched)
+        open_demux_reentrant(mpctx);
+    prefetched = false;
     if (!mpctx->master_demuxer) {
         MP_ERR(mpctx, "Failed to recognize file format.\n");
         mpctx->error_playing = MPV_ERROR_UNKNOWN_FORMAT;
@@ -1138,6 +1462,7 @@ goto_reopen_demuxer: ;
     add_demuxer_tracks(mpctx, mpctx->track_layout);
 
     mpctx->timeline_part = 0;
+    mpctx->timeline_preload_part = -1;
     if (mpctx->timeline)
         timeline_set_part(mpctx, mpctx->timeline_part, true);
 
@@ -1413,9 +1738,13 @@ void mp_play_files(struct MPContext *mpctx)
         mpctx->playlist->current_was_replaced = false;
         mpctx->stop_play = 0;
 
+        cancel_prefetch(mpctx, new_entry);
+
         if (!mpctx->playlist->current && mpctx->opts->player_idle_mode < 2)
             break;
     }
+
+    cancel_prefetch(mpctx, NULL);
 }
 
 // Abort current playback and set the given entry to play next.
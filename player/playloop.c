@@ -55,7 +55,9 @@
 // mp_wait_events() was called. (But see mp_process_input().)
 void mp_wait_events(struct MPContext *mpctx, double sleeptime)
 {
+    mp_audio_thread_unlock(mpctx);
     mp_input_wait(mpctx->input, sleeptime);
+    mp_audio_thread_lock(mpctx);
 }
 
 // Process any queued input, whether it's user input, or requests from client
@@ -212,10 +214,14 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
     hr_seek &= seek.type == MPSEEK_ABSOLUTE; // otherwise, no target PTS known
 
     double demuxer_amount = seek.amount;
+    bool preloaded = false;
     if (mpctx->timeline) {
+        int preload_part = mpctx->timeline_preload_part;
         bool need_reset = false;
         demuxer_amount = timeline_set_from_time(mpctx, seek.amount,
                                                 &need_reset);
+        // The source was already seeked to the start of the new part.
+        preloaded = timeline_fallthrough && mpctx->timeline_part == preload_part;
         if (need_reset) {
             reinit_video_chain(mpctx);
             reinit_audio_chain(mpctx);
@@ -243,7 +249,8 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
 
     if (hr_seek)
         demuxer_amount -= hr_seek_offset;
-    demux_seek(mpctx->demuxer, demuxer_amount, demuxer_style);
+    if (!preloaded)
+        demux_seek(mpctx->demuxer, demuxer_amount, demuxer_style);
 
     // Seek external, extra files too:
     for (int t = 0; t < mpctx->num_tracks; t++) {
@@ -1038,6 +1045,8 @@ void run_playloop(struct MPContext *mpctx)
     update_subtitles(mpctx);
 
     handle_segment_switch(mpctx, end_is_new_segment);
+    timeline_preload_next(mpctx);
+    prefetch_next_file(mpctx);
 
     mp_handle_nav(mpctx);
 
@@ -269,7 +269,7 @@ static void update_subtitle(struct MPContext *mpctx, int order)
             MP_DBG(mpctx, "Sub: c_pts=%5.3f s_pts=%5.3f duration=%5.3f len=%d\n",
                    curpts_s, pkt->pts, pkt->duration, pkt->len);
             sub_decode(dec_sub, pkt);
-            talloc_free(pkt);
+            free_demux_packet(pkt);
         }
     }
 
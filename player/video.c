@@ -390,10 +390,12 @@ static int decode_image(struct MPContext *mpctx)
     bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
     int framedrop_type = hrseek && mpctx->hrseek_framedrop ?
                          2 : check_framedrop(mpctx);
+    mp_audio_thread_unlock(mpctx);
     d_video->waiting_decoded_mpi =
         video_decode(d_video, pkt, framedrop_type);
+    mp_audio_thread_lock(mpctx);
     bool had_packet = !!pkt;
-    talloc_free(pkt);
+    free_demux_packet(pkt);
 
     if (had_packet && !d_video->waiting_decoded_mpi &&
         mpctx->video_status == STATUS_PLAYING &&
@@ -17,21 +17,21 @@
 
 // Time in seconds the main thread waits for the cache thread. On wakeups, the
 // code checks for user requested aborts and also prints warnings that the
-// cache is being slow.
+// cache is being slow. (The cache thread wakes the main thread as soon as
+// data arrives, so this is only for the case the cache is stuck.)
 #define CACHE_WAIT_TIME 1.0
 
-// The time the cache sleeps in idle mode. This controls how often the cache
-// retries reading from the stream after EOF has reached (in case the stream is
-// actually readable again, for example if data has been appended to a file).
-// Note that if this timeout is too low, the player will waste too much CPU
-// when player is paused.
-#define CACHE_IDLE_SLEEP_TIME 1.0
-
-// Time in seconds the cache updates "cached" controls. Note that idle mode
-// will block the cache from doing this, and this timeout is honored only if
-// the cache is active.
+// Time in seconds the cache updates "cached" controls while it is reading.
+// They are also updated each time the cache stops reading.
 #define CACHE_UPDATE_CONTROLS_TIME 2.0
 
+// The cache reads ahead until the high watermark (the readahead limit) is
+// reached. Then it sleeps until the data ahead of the read position drops
+// below the low watermark, which is this fraction of the high watermark. This
+// makes it read in large batches instead of topping up after each read. At
+// EOF, it sleeps until the reader tries to read again.
+#define CACHE_LOW_WATERMARK 0.5
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,6 +39,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
 #include <pthread.h>
 #include <time.h>
@@ -59,18 +60,29 @@
 #include "common/common.h"
 
 
+// The cache is split into blocks of this size. Each block caches (part of)
+// the BLOCK_SIZE aligned file range starting at its pos.
+#define BLOCK_SIZE (32 * 1024)
+
+struct cache_block {
+    int64_t pos;            // aligned file position, -1 if unused
+    int start, end;         // range of valid bytes within the block
+    int hash_next;          // next block in the same hash bucket, or -1
+    int lru_prev, lru_next; // LRU list, or -1
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
     bool cache_thread_running;
     pthread_mutex_t mutex;
-    pthread_cond_t wakeup;
+    pthread_cond_t wakeup;      // signaled to wake up the cache thread
+    pthread_cond_t wakeup_main; // signaled to wake up threads waiting on it
 
     // Constants (as long as cache thread is running)
     // Some of these might actually be changed by a synced cache resize.
     unsigned char *buffer;  // base pointer of the allocated buffer memory
     int64_t buffer_size;    // size of the allocated buffer memory
-    int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
 
@@ -85,15 +97,21 @@ struct priv {
     // All the following members are shared between the threads.
     // You must lock the mutex to access them.
 
-    // Ringbuffer
-    int64_t min_filepos;    // range of file that is cached in the buffer
-    int64_t max_filepos;    // ... max_filepos being the last read position
-    bool eof;               // true if max_filepos = EOF
-    int64_t offset;         // buffer[WRAP(s->max_filepos - offset)] corresponds
-                            // to the byte at max_filepos (must be wrapped by
-                            // buffer_size)
+    // Blocks, each one using BLOCK_SIZE bytes of buffer. The blocks are only
+    // added/removed by the cache thread, but the reader updates the LRU list.
+    struct cache_block *blocks;
+    int num_blocks;
+    int *hash;              // block index by aligned pos, -1 if empty
+    int hash_size;          // power of 2
+    int lru_first, lru_last; // most/least recently used block
+
+    int64_t fill_pos;       // position of the underlying stream
+    bool eof;               // true if fill_pos = EOF
 
     bool idle;              // cache thread has stopped reading
+    bool filling;           // below high watermark after low watermark
+    int64_t wakeup_pos;     // idle cache thread needs to be woken up only if
+                            // read_filepos reaches this (or on seeks/controls)
     int64_t reads;          // number of actual read attempts performed
 
     int64_t read_filepos;   // client read position (mirrors cache->pos)
@@ -117,9 +135,6 @@ enum {
     CACHE_CTRL_NONE = 0,
     CACHE_CTRL_QUIT = -1,
     CACHE_CTRL_PING = -2,
-
-    // we should fill buffer only if space>=FILL_LIMIT
-    FILL_LIMIT = 16 * 1024,
 };
 
 // Used by the main thread to wakeup the cache thread, and to wait for the
@@ -135,124 +150,233 @@ static void cache_wakeup_and_wait(struct priv *s, double *retry_time)
 
     pthread_cond_signal(&s->wakeup);
     struct timespec ts = mp_rel_time_to_timespec(CACHE_WAIT_TIME);
-    pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
+    pthread_cond_timedwait(&s->wakeup_main, &s->mutex, &ts);
 
     if (*retry_time >= 0)
         *retry_time += mp_time_sec() - start;
 }
 
+static int *hash_bucket(struct priv *s, int64_t pos)
+{
+    return &s->hash[(uint64_t)(pos / BLOCK_SIZE) & (s->hash_size - 1)];
+}
+
+// Return the block caching the given aligned position, or NULL.
+static struct cache_block *find_block(struct priv *s, int64_t pos)
+{
+    if (!s->num_blocks)
+        return NULL;
+    for (int n = *hash_bucket(s, pos); n >= 0; n = s->blocks[n].hash_next) {
+        if (s->blocks[n].pos == pos)
+            return &s->blocks[n];
+    }
+    return NULL;
+}
+
+static unsigned char *block_data(struct priv *s, struct cache_block *b)
+{
+    return s->buffer + (b - s->blocks) * (int64_t)BLOCK_SIZE;
+}
+
+static void lru_remove(struct priv *s, struct cache_block *b)
+{
+    if (b->lru_prev >= 0) {
+        s->blocks[b->lru_prev].lru_next = b->lru_next;
+    } else {
+        s->lru_first = b->lru_next;
+    }
+    if (b->lru_next >= 0) {
+        s->blocks[b->lru_next].lru_prev = b->lru_prev;
+    } else {
+        s->lru_last = b->lru_prev;
+    }
+    b->lru_prev = b->lru_next = -1;
+}
+
+// Mark the block as most recently used.
+static void lru_touch(struct priv *s, struct cache_block *b)
+{
+    int n = b - s->blocks;
+    if (s->lru_first == n)
+        return;
+    lru_remove(s, b);
+    b->lru_next = s->lru_first;
+    if (s->lru_first >= 0)
+        s->blocks[s->lru_first].lru_prev = n;
+    s->lru_first = n;
+    if (s->lru_last < 0)
+        s->lru_last = n;
+}
+
+static void hash_remove(struct priv *s, struct cache_block *b)
+{
+    int n = b - s->blocks;
+    for (int *p = hash_bucket(s, b->pos); *p >= 0; p = &s->blocks[*p].hash_next) {
+        if (*p == n) {
+            *p = b->hash_next;
+            break;
+        }
+    }
+    b->hash_next = -1;
+}
+
+// Reuse the least recently used block that does not overlap with the file
+// range [keep_min, keep_max) for the aligned position pos. Runs in the cache
+// thread, or on resize.
+static struct cache_block *alloc_block(struct priv *s, int64_t pos,
+                                       int64_t keep_min, int64_t keep_max)
+{
+    struct cache_block *b = NULL;
+    for (int n = s->lru_last; n >= 0; n = s->blocks[n].lru_prev) {
+        struct cache_block *cur = &s->blocks[n];
+        if (cur->pos < 0 || cur->pos + BLOCK_SIZE <= keep_min ||
+            cur->pos >= keep_max)
+        {
+            b = cur;
+            break;
+        }
+    }
+    if (!b)
+        return NULL;
+    if (b->pos >= 0)
+        hash_remove(s, b);
+    b->pos = pos;
+    b->start = b->end = 0;
+    int *bucket = hash_bucket(s, pos);
+    b->hash_next = *bucket;
+    *bucket = b - s->blocks;
+    lru_touch(s, b);
+    return b;
+}
+
 // Runs in the cache thread
 static void cache_drop_contents(struct priv *s)
 {
-    s->offset = s->min_filepos = s->max_filepos = s->read_filepos;
+    for (int n = 0; n < s->hash_size; n++)
+        s->hash[n] = -1;
+    for (int n = 0; n < s->num_blocks; n++) {
+        s->blocks[n] = (struct cache_block){
+            .pos = -1,
+            .hash_next = -1,
+            .lru_prev = n - 1,
+            .lru_next = n + 1 < s->num_blocks ? n + 1 : -1,
+        };
+    }
+    s->lru_first = s->num_blocks ? 0 : -1;
+    s->lru_last = s->num_blocks - 1;
+    s->fill_pos = s->read_filepos;
     s->eof = false;
     s->start_pts = MP_NOPTS_VALUE;
 }
 
 // Copy at most dst_size from the cache at the given absolute file position pos.
 // Return number of bytes that could actually be read.
-// Does not advance the file position, or change anything else.
+// Does not advance the file position, or change anything else (except marking
+// the blocks as used).
 // Can be called from anywhere, as long as the mutex is held.
 static size_t read_buffer(struct priv *s, unsigned char *dst,
                           size_t dst_size, int64_t pos)
 {
     size_t read = 0;
     while (read < dst_size) {
-        if (pos >= s->max_filepos || pos < s->min_filepos)
+        int64_t bpos = pos % BLOCK_SIZE;
+        struct cache_block *b = find_block(s, pos - bpos);
+        if (!b || bpos < b->start || bpos >= b->end)
             break;
-        int64_t newb = s->max_filepos - pos; // new bytes in the buffer
-
-        int64_t bpos = pos - s->offset; // file pos to buffer memory pos
-        if (bpos < 0) {
-            bpos += s->buffer_size;
-        } else if (bpos >= s->buffer_size) {
-            bpos -= s->buffer_size;
-        }
-
-        if (newb > s->buffer_size - bpos)
-            newb = s->buffer_size - bpos; // handle wrap...
-
-        newb = MPMIN(newb, dst_size - read);
-
-        assert(newb >= 0 && read + newb <= dst_size);
-        assert(bpos >= 0 && bpos + newb <= s->buffer_size);
-        memcpy(&dst[read], &s->buffer[bpos], newb);
+        size_t newb = MPMIN(b->end - bpos, dst_size - read);
+        memcpy(&dst[read], block_data(s, b) + bpos, newb);
+        lru_touch(s, b);
         read += newb;
         pos += newb;
     }
     return read;
 }
 
+// Return the end of the data that is cached without holes from pos on.
+static int64_t cached_end(struct priv *s, int64_t pos)
+{
+    while (1) {
+        int64_t bpos = pos % BLOCK_SIZE;
+        struct cache_block *b = find_block(s, pos - bpos);
+        if (!b || bpos < b->start || bpos >= b->end)
+            return pos;
+        pos += b->end - bpos;
+    }
+}
+
 // Runs in the cache thread.
-// Returns true if reading was attempted, and the mutex was shortly unlocked.
+// Returns true if it should be called again (the mutex was shortly unlocked),
+// false if the cache thread can go to sleep.
 static bool cache_fill(struct priv *s)
 {
     int64_t read = s->read_filepos;
     int len = 0;
 
-    // drop cache contents only if seeking backward or too much fwd.
-    // This is also done for on-disk files, since it loses the backseek cache.
-    // That in turn can cause major bandwidth increase and performance
-    // issues with e.g. mov or badly interleaved files
-    if (read < s->min_filepos || read > s->max_filepos + s->seek_limit) {
-        MP_VERBOSE(s, "Dropping cache at pos %"PRId64", "
-                   "cached range: %"PRId64"-%"PRId64".\n", read,
-                   s->min_filepos, s->max_filepos);
-        cache_drop_contents(s);
+    // First byte after read_filepos that is not cached. Unseekable streams
+    // can only append at the current position.
+    int64_t pos = s->seekable ? cached_end(s, read) : s->fill_pos;
+
+    // For small forward seeks, keep reading instead of seeking the stream.
+    if (s->seekable && pos == read && s->fill_pos < read &&
+        read - s->fill_pos <= s->seek_limit)
+        pos = s->fill_pos;
+
+    // Limit readahead to half the total buffer size, so that data before the
+    // read position can be kept for seeking back - unless the whole file fits
+    // in the cache. Data after read_filepos is never evicted while reading
+    // ahead, so always leave some blocks that can be reused.
+    int64_t high = s->buffer_size / 2;
+    if (s->stream_size >= 0 && s->stream_size <= s->buffer_size)
+        high = s->buffer_size - 2 * BLOCK_SIZE;
+    int64_t low = high * CACHE_LOW_WATERMARK;
+
+    if (pos - read >= high) {
+        s->filling = false;
+    } else if (pos - read <= low) {
+        s->filling = true;
+    }
+    if (!s->filling) {
+        s->idle = true;
+        s->wakeup_pos = pos - low;
+        s->reads++; // don't stuck main thread
+        return false;
     }
+    s->wakeup_pos = INT64_MAX;
 
-    if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
+    if (stream_tell(s->stream) != pos && s->seekable) {
         MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
-                   stream_tell(s->stream), s->max_filepos);
-        stream_seek(s->stream, s->max_filepos);
-        if (stream_tell(s->stream) != s->max_filepos)
+                   stream_tell(s->stream), pos);
+        stream_seek(s->stream, pos);
+        if (stream_tell(s->stream) != pos)
             goto done;
     }
+    s->fill_pos = pos;
 
     if (mp_cancel_test(s->cache->cancel))
         goto done;
 
-    // number of buffer bytes which should be preserved in backwards direction
-    int64_t back = MPCLAMP(read - s->min_filepos, 0, s->back_size);
-
-    // limit maximum readahead to half the total buffer size, to ensure that
-    // we don't stall the network when starting a file (not reading new data
-    // by preserving the backbuffer) - unless the whole file fits in the cache
-    if (s->stream_size > s->buffer_size)
-        back = MPMAX(back, s->buffer_size / 2);
-
-    // number of buffer bytes that are valid and can be read
-    int64_t newb = FFMAX(s->max_filepos - read, 0);
-
-    // max. number of bytes that can be written (starting from max_filepos)
-    int64_t space = s->buffer_size - (newb + back);
-
-    // offset into the buffer that maps to max_filepos
-    int64_t pos = s->max_filepos - s->offset;
-    if (pos >= s->buffer_size)
-        pos -= s->buffer_size; // wrap-around
-
-    if (space < FILL_LIMIT) {
+    int64_t bpos = pos % BLOCK_SIZE;
+    struct cache_block *b = find_block(s, pos - bpos);
+    if (!b)
+        b = alloc_block(s, pos - bpos, read - read % BLOCK_SIZE, pos);
+    if (!b) {
         s->idle = true;
-        s->reads++; // don't stuck main thread
+        s->filling = false;
+        s->reads++;
         return false;
     }
-
-    // limit to end of buffer (without wrapping)
-    if (pos + space >= s->buffer_size)
-        space = s->buffer_size - pos;
+    // Blocks are filled contiguously; discard data that can't be appended to.
+    if (bpos < b->start || bpos > b->end)
+        b->start = bpos;
+    b->end = bpos;
 
     // limit read size (or else would block and read the entire buffer in 1 call)
-    space = FFMIN(space, s->stream->read_chunk);
-
-    // back+newb+space <= buffer_size
-    int64_t back2 = s->buffer_size - (space + newb); // max back size
-    if (s->min_filepos < (read - back2))
-        s->min_filepos = read - back2;
+    int space = MPMIN(BLOCK_SIZE - bpos, s->stream->read_chunk);
 
-    // The read call might take a long time and block, so drop the lock.
+    // The read call might take a long time and block, so drop the lock. Only
+    // the cache thread reuses blocks, so b stays valid.
     pthread_mutex_unlock(&s->mutex);
-    len = stream_read_partial(s->stream, &s->buffer[pos], space);
+    len = stream_read_partial(s->stream, block_data(s, b) + bpos, space);
     pthread_mutex_lock(&s->mutex);
 
     // Do this after reading a block, because at least libdvdnav updates the
@@ -263,9 +387,11 @@ static bool cache_fill(struct priv *s)
             s->start_pts = pts;
     }
 
-    s->max_filepos += len;
-    if (pos + len == s->buffer_size)
-        s->offset += s->buffer_size; // wrap...
+    if (len > 0) {
+        b->end += len;
+        s->fill_pos += len;
+        lru_touch(s, b);
+    }
 
 done:
     s->eof = len <= 0;
@@ -276,62 +402,78 @@ done:
         MP_TRACE(s, "EOF reached.\n");
     }
 
-    pthread_cond_signal(&s->wakeup);
+    pthread_cond_signal(&s->wakeup_main);
 
-    return true;
+    return !s->eof;
 }
 
 // This is called both during init and at runtime.
 static int resize_cache(struct priv *s, int64_t size)
 {
-    int64_t min_size = FILL_LIMIT * 4;
+    int64_t min_size = BLOCK_SIZE * 4;
     int64_t max_size = ((size_t)-1) / 4;
     int64_t buffer_size = MPCLAMP(size, min_size, max_size);
+    int num_blocks = MPMIN(buffer_size / BLOCK_SIZE, INT_MAX / 2);
+    buffer_size = num_blocks * (int64_t)BLOCK_SIZE;
 
     unsigned char *buffer = malloc(buffer_size);
-    if (!buffer) {
-        free(buffer);
+    if (!buffer)
         return STREAM_ERROR;
-    }
 
-    if (s->buffer) {
-        // Copy & free the old ringbuffer data.
-        // If the buffer is too small, prefer to copy these regions:
-        // 1. Data starting from read_filepos, until cache end
-        size_t read_1 = read_buffer(s, buffer, buffer_size, s->read_filepos);
-        // 2. then data from before read_filepos until cache start
-        //    (this one needs to be copied to the end of the ringbuffer)
-        size_t read_2 = 0;
-        if (s->min_filepos < s->read_filepos) {
-            size_t copy_len = buffer_size - read_1;
-            copy_len = MPMIN(copy_len, s->read_filepos - s->min_filepos);
-            assert(copy_len + read_1 <= buffer_size);
-            read_2 = read_buffer(s, buffer + buffer_size - copy_len, copy_len,
-                                 s->read_filepos - copy_len);
-            // This shouldn't happen, unless copy_len was computed incorrectly.
-            assert(read_2 == copy_len);
+    unsigned char *old_buffer = s->buffer;
+    struct cache_block *old_blocks = s->blocks;
+    int old_first = s->lru_first;
+    int *old_hash = s->hash;
+
+    s->buffer = buffer;
+    s->buffer_size = buffer_size;
+    s->blocks = talloc_array(s, struct cache_block, num_blocks);
+    s->num_blocks = num_blocks;
+    s->hash_size = 1;
+    while (s->hash_size < num_blocks)
+        s->hash_size *= 2;
+    s->hash = talloc_array(s, int, s->hash_size);
+
+    int64_t fill_pos = s->fill_pos;
+    double start_pts = s->start_pts;
+    cache_drop_contents(s);
+
+    if (old_buffer) {
+        // Copy the most recently used blocks that fit into the new buffer,
+        // keeping their LRU order.
+        int *copy = talloc_array(NULL, int, num_blocks);
+        int num_copy = 0;
+        for (int n = old_first; n >= 0 && num_copy < num_blocks;
+             n = old_blocks[n].lru_next)
+        {
+            if (old_blocks[n].pos >= 0)
+                copy[num_copy++] = n;
         }
-        // Set it up such that read_1 is at buffer pos 0, and read_2 wraps
-        // around below it, so that it is located at the end of the buffer.
-        s->min_filepos = s->read_filepos - read_2;
-        s->max_filepos = s->read_filepos + read_1;
-        s->offset = s->max_filepos - read_1;
-    } else {
-        cache_drop_contents(s);
+        for (int i = num_copy - 1; i >= 0; i--) {
+            struct cache_block *old = &old_blocks[copy[i]];
+            struct cache_block *b = alloc_block(s, old->pos, 0, 0);
+            b->start = old->start;
+            b->end = old->end;
+            memcpy(block_data(s, b) + b->start,
+                   old_buffer + copy[i] * (int64_t)BLOCK_SIZE + b->start,
+                   b->end - b->start);
+        }
+        talloc_free(copy);
+        s->fill_pos = fill_pos;
+        s->start_pts = start_pts;
     }
 
-    free(s->buffer);
+    free(old_buffer);
+    talloc_free(old_blocks);
+    talloc_free(old_hash);
 
-    s->buffer_size = buffer_size;
-    s->back_size = buffer_size / 2;
-    s->buffer = buffer;
     s->idle = false;
     s->eof = false;
 
     //make sure that we won't wait from cache_fill
     //more data than it is allowed to fill
-    if (s->seek_limit > s->buffer_size - FILL_LIMIT)
-        s->seek_limit = s->buffer_size - FILL_LIMIT;
+    if (s->seek_limit > s->buffer_size - BLOCK_SIZE)
+        s->seek_limit = s->buffer_size - BLOCK_SIZE;
 
     return STREAM_OK;
 }
@@ -363,7 +505,7 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
         *(int64_t *)arg = s->buffer_size;
         return STREAM_OK;
     case STREAM_CTRL_GET_CACHE_FILL:
-        *(int64_t *)arg = s->max_filepos - s->read_filepos;
+        *(int64_t *)arg = cached_end(s, s->read_filepos) - s->read_filepos;
         return STREAM_OK;
     case STREAM_CTRL_GET_CACHE_IDLE:
         *(int *)arg = s->idle;
@@ -395,6 +537,7 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     }
     case STREAM_CTRL_RESUME_CACHE:
         s->idle = s->eof = false;
+        s->filling = true;
         pthread_cond_signal(&s->wakeup);
         return STREAM_OK;
     case STREAM_CTRL_AVSEEK:
@@ -448,7 +591,7 @@ static void cache_execute_control(struct priv *s)
 
     update_cached_controls(s);
     s->control = CACHE_CTRL_NONE;
-    pthread_cond_signal(&s->wakeup);
+    pthread_cond_signal(&s->wakeup_main);
 }
 
 static void *cache_thread(void *arg)
@@ -459,25 +602,29 @@ static void *cache_thread(void *arg)
     update_cached_controls(s);
     double last = mp_time_sec();
     while (s->control != CACHE_CTRL_QUIT) {
-        if (mp_time_sec() - last > CACHE_UPDATE_CONTROLS_TIME) {
-            update_cached_controls(s);
-            last = mp_time_sec();
-        }
+        bool active = true;
         if (s->control > 0) {
             cache_execute_control(s);
         } else {
-            cache_fill(s);
+            active = cache_fill(s);
         }
         if (s->control == CACHE_CTRL_PING) {
-            pthread_cond_signal(&s->wakeup);
+            pthread_cond_signal(&s->wakeup_main);
             s->control = CACHE_CTRL_NONE;
         }
-        if (s->idle && s->control == CACHE_CTRL_NONE) {
-            struct timespec ts = mp_rel_time_to_timespec(CACHE_IDLE_SLEEP_TIME);
-            pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
+        if (active) {
+            if (mp_time_sec() - last > CACHE_UPDATE_CONTROLS_TIME) {
+                update_cached_controls(s);
+                last = mp_time_sec();
+            }
+        } else if (s->control == CACHE_CTRL_NONE) {
+            update_cached_controls(s);
+            last = mp_time_sec();
+            // Sleep until the reader, a seek, or a control wakes us up.
+            pthread_cond_wait(&s->wakeup, &s->mutex);
         }
     }
-    pthread_cond_signal(&s->wakeup);
+    pthread_cond_signal(&s->wakeup_main);
     pthread_mutex_unlock(&s->mutex);
     MP_VERBOSE(s, "Cache exiting...\n");
     return NULL;
@@ -502,8 +649,12 @@ static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
             s->read_filepos += readb;
             if (readb > 0)
                 break;
-            if (s->eof && s->read_filepos >= s->max_filepos && s->reads >= retry)
+            if (s->eof && s->read_filepos >= s->fill_pos && s->reads >= retry)
+                break;
+            if (!s->seekable && s->read_filepos < s->fill_pos) {
+                MP_ERR(s, "Cached data was dropped in unseekable stream.\n");
                 break;
+            }
             s->idle = false;
             if (mp_cancel_test(s->cache->cancel))
                 break;
@@ -511,8 +662,12 @@ static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
         }
     }
 
-    // wakeup the cache thread, possibly make it read more data ahead
-    pthread_cond_signal(&s->wakeup);
+    // Wakeup the cache thread if it should read more data ahead, or retry
+    // reading at EOF (in case data has been appended to a file).
+    if (s->read_filepos >= s->wakeup_pos || (readb == 0 && s->eof)) {
+        s->wakeup_pos = INT64_MAX;
+        pthread_cond_signal(&s->wakeup);
+    }
     pthread_mutex_unlock(&s->mutex);
     return readb;
 }
@@ -525,20 +680,25 @@ static int cache_seek(stream_t *cache, int64_t pos)
 
     pthread_mutex_lock(&s->mutex);
 
-    MP_DBG(s, "request seek: %" PRId64 " <= to=%" PRId64
-           " (cur=%" PRId64 ") <= %" PRId64 "  \n",
-           s->min_filepos, pos, s->read_filepos, s->max_filepos);
+    MP_DBG(s, "request seek: to=%" PRId64 " (cur=%" PRId64 ", fill=%" PRId64
+           ")\n", pos, s->read_filepos, s->fill_pos);
 
-    if (!s->seekable && pos > s->max_filepos) {
+    if (!s->seekable && pos > s->fill_pos) {
         MP_ERR(s, "Attempting to seek past cached data in unseekable stream.\n");
         r = 0;
-    } else if (!s->seekable && pos < s->min_filepos) {
-        MP_ERR(s, "Attempting to seek before cached data in unseekable stream.\n");
+    } else if (!s->seekable && pos < s->fill_pos && cached_end(s, pos) == pos) {
+        MP_ERR(s, "Attempting to seek to uncached data in unseekable stream.\n");
         r = 0;
     } else {
+        // The data from the old read position up to where the cache thread
+        // stopped is cached, so it doesn't need to wake up for seeks into it.
+        bool wakeup = pos < s->read_filepos || pos >= s->wakeup_pos;
         cache->pos = s->read_filepos = pos;
         s->eof = false; // so that cache_read() will actually wait for new data
-        pthread_cond_signal(&s->wakeup);
+        if (wakeup) {
+            s->wakeup_pos = INT64_MAX;
+            pthread_cond_signal(&s->wakeup);
+        }
     }
 
     pthread_mutex_unlock(&s->mutex);
@@ -596,6 +756,7 @@ static void cache_uninit(stream_t *cache)
     }
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
+    pthread_cond_destroy(&s->wakeup_main);
     free(s->buffer);
     talloc_free(s);
 }
@@ -611,6 +772,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     struct priv *s = talloc_zero(NULL, struct priv);
     s->log = cache->log;
     s->eof_pos = -1;
+    s->wakeup_pos = INT64_MAX;
 
     cache_drop_contents(s);
 
@@ -634,6 +796,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     pthread_mutex_init(&s->mutex, NULL);
     pthread_cond_init(&s->wakeup, NULL);
+    pthread_cond_init(&s->wakeup_main, NULL);
 
     cache->priv = s;
     s->cache = cache;
@@ -645,8 +808,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     cache->close = cache_uninit;
 
     int64_t min = opts->initial * 1024ULL;
-    if (min > s->buffer_size - FILL_LIMIT)
-        min = s->buffer_size - FILL_LIMIT;
+    if (min > s->buffer_size - BLOCK_SIZE)
+        min = s->buffer_size - BLOCK_SIZE;
 
     s->seekable = stream->seekable;
 
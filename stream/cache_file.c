@@ -16,6 +16,15 @@
  */
 #include <stdio.h>
 #include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libavutil/intreadwrite.h>
+#include <libavutil/md5.h>
 
 #include "osdep/io.h"
 
@@ -26,32 +35,219 @@
 
 #include "stream.h"
 
-#define BLOCK_SIZE 1024LL
+#define BLOCK_SIZE (64 * 1024LL)
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// The range map is stored next to the cache file, with this header, followed
+// by the source URL and num_ranges start/end pairs. The header contains the
+// source size, modification time (local files only) and the MD5 of its first
+// block, and the cache is discarded if any of them differ.
+#define MAP_MAGIC "mpvcmap2"
+#define MAP_HEADER_SIZE (8 + 8 + 8 + 16 + 8 + 8)
+
+struct range {
+    int64_t start, end;
+};
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
-    uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
+    char *map_filename;     // NULL if the cache is not persistent
+    uint8_t *map;           // mmap'd cache file, only read from
+    int64_t map_size;       // size of the mapping (at most max_size)
     int64_t size;           // currently known size
-    int64_t max_size;       // max. size for block_bits and cache_file
+    int64_t max_size;       // max. size of cache_file
+    int64_t mtime;          // source modification time, or 0 if unknown
+    uint8_t head_md5[16];   // MD5 of the source's first block
+    uint8_t *block;         // BLOCK_SIZE buffer for reading the source
+    bool write_failed;      // if set, uncached data is not added anymore
+    struct range *ranges;   // sorted, non-overlapping, non-adjacent
+    int num_ranges;
+    bool ranges_changed;
 };
 
-static bool test_bit(struct priv *p, int64_t pos)
+// Index of the first range with end > pos, or num_ranges.
+static int find_range(struct priv *p, int64_t pos)
+{
+    int lo = 0, hi = p->num_ranges;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (p->ranges[mid].end <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Number of bytes cached starting at pos.
+static int64_t cached_bytes(struct priv *p, int64_t pos)
+{
+    int i = find_range(p, pos);
+    if (i < p->num_ranges && p->ranges[i].start <= pos)
+        return p->ranges[i].end - pos;
+    return 0;
+}
+
+static void add_range(struct priv *p, int64_t start, int64_t end)
+{
+    if (start >= end)
+        return;
+    // First range that touches or overlaps [start, end).
+    int i = find_range(p, start - 1);
+    if (i < p->num_ranges && p->ranges[i].start <= end) {
+        struct range *r = &p->ranges[i];
+        r->start = MPMIN(r->start, start);
+        r->end = MPMAX(r->end, end);
+        while (i + 1 < p->num_ranges && p->ranges[i + 1].start <= r->end) {
+            r->end = MPMAX(r->end, p->ranges[i + 1].end);
+            MP_TARRAY_REMOVE_AT(p->ranges, p->num_ranges, i + 1);
+        }
+    } else {
+        MP_TARRAY_INSERT_AT(p, p->ranges, p->num_ranges, i,
+                            (struct range){start, end});
+    }
+    p->ranges_changed = true;
+}
+
+// Drop all cached data at or after pos.
+static void cut_ranges(struct priv *p, int64_t pos)
 {
-    if (pos < 0 || pos >= p->size)
+    int i = find_range(p, pos);
+    if (i < p->num_ranges && p->ranges[i].start < pos) {
+        p->ranges[i].end = pos;
+        i++;
+    }
+    if (i < p->num_ranges)
+        p->ranges_changed = true;
+    p->num_ranges = i;
+}
+
+// Return a pointer to the cached data at pos, and set *len to the number of
+// bytes available there. Returns NULL if pos is not cached.
+static uint8_t *get_slice(struct priv *p, int64_t pos, int64_t *len)
+{
+    *len = cached_bytes(p, pos);
+    return *len > 0 ? p->map + pos : NULL;
+}
+
+static bool load_map(stream_t *s, struct priv *p)
+{
+    FILE *f = fopen(p->map_filename, "rb");
+    if (!f)
         return false;
-    size_t block = pos / BLOCK_SIZE;
-    return p->block_bits[block / 8] & (1 << (block % 8));
+    bool ok = false;
+    uint8_t header[MAP_HEADER_SIZE];
+    if (fread(header, MAP_HEADER_SIZE, 1, f) != 1 ||
+        memcmp(header, MAP_MAGIC, 8) != 0)
+        goto done;
+    int64_t size = AV_RL64(header + 8);
+    int64_t mtime = AV_RL64(header + 16);
+    uint64_t url_len = AV_RL64(header + 40);
+    uint64_t num_ranges = AV_RL64(header + 48);
+    const char *url = p->original->url;
+    if (size != p->size || url_len != strlen(url) || num_ranges > INT_MAX / 2)
+        goto done;
+    if (mtime != p->mtime || memcmp(header + 24, p->head_md5, 16) != 0) {
+        MP_VERBOSE(s, "Source changed, not using %s.\n", p->map_filename);
+        goto done;
+    }
+    char *tmp = talloc_size(NULL, url_len + 1);
+    ok = fread(tmp, url_len, 1, f) == 1 && memcmp(tmp, url, url_len) == 0;
+    talloc_free(tmp);
+    for (uint64_t n = 0; n < num_ranges && ok; n++) {
+        uint8_t r[16];
+        ok = fread(r, 16, 1, f) == 1;
+        if (ok)
+            add_range(p, AV_RL64(r), MPMIN(AV_RL64(r + 8), p->map_size));
+    }
+done:
+    fclose(f);
+    if (!ok)
+        p->num_ranges = 0;
+    p->ranges_changed = false;
+    if (ok)
+        MP_VERBOSE(s, "Using %d cached ranges from %s.\n", p->num_ranges,
+                   p->map_filename);
+    return ok;
 }
 
-static void set_bit(struct priv *p, int64_t pos, bool bit)
+static void store_map(stream_t *s, struct priv *p)
 {
-    if (pos < 0 || pos >= p->size)
+    if (!p->map_filename || !p->ranges_changed)
         return;
-    size_t block = pos / BLOCK_SIZE;
-    unsigned int m = (1 << (block % 8));
-    p->block_bits[block / 8] = (p->block_bits[block / 8] & ~m) | (bit ? m : 0);
+    // Make sure the data is on disk before it's declared valid.
+    if (msync(p->map, p->map_size, MS_SYNC))
+        return;
+    char *tmpname = talloc_asprintf(NULL, "%s.tmp", p->map_filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f)
+        goto done;
+    const char *url = p->original->url;
+    uint8_t header[MAP_HEADER_SIZE];
+    memcpy(header, MAP_MAGIC, 8);
+    AV_WL64(header + 8, p->size);
+    AV_WL64(header + 16, p->mtime);
+    memcpy(header + 24, p->head_md5, 16);
+    AV_WL64(header + 40, strlen(url));
+    AV_WL64(header + 48, p->num_ranges);
+    bool ok = fwrite(header, MAP_HEADER_SIZE, 1, f) == 1 &&
+              fwrite(url, strlen(url), 1, f) == 1;
+    for (int n = 0; n < p->num_ranges && ok; n++) {
+        uint8_t r[16];
+        AV_WL64(r, p->ranges[n].start);
+        AV_WL64(r + 8, p->ranges[n].end);
+        ok = fwrite(r, 16, 1, f) == 1;
+    }
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmpname, p->map_filename)) {
+        MP_WARN(s, "could not write cache map '%s'\n", p->map_filename);
+        unlink(tmpname);
+    }
+done:
+    talloc_free(tmpname);
+}
+
+// Read the first block of the source, and compute the values which identify
+// its version. Returns the number of bytes read into head, or -1 on error.
+static int read_validator(struct priv *p, uint8_t *head)
+{
+    struct stream *orig = p->original;
+    struct stat st;
+    if (orig->type == STREAMTYPE_FILE && orig->path && !stat(orig->path, &st))
+        p->mtime = st.st_mtime;
+    int len = MPMIN(BLOCK_SIZE, p->map_size);
+    if (stream_seek(orig, 0) < 1 || stream_read(orig, head, len) != len)
+        return -1;
+    av_md5_sum(p->head_md5, head, len);
+    return len;
+}
+
+// Write data to the cache file at pos. The file is sparse, and if the disk is
+// full, writing to a hole through the mapping raises SIGBUS. Writing with
+// stdio allocates the space and reports the error instead. The mapping sees
+// the new data once it was flushed.
+static bool write_block(stream_t *s, struct priv *p, int64_t pos,
+                        uint8_t *data, int len)
+{
+    if (fseeko(p->cache_file, pos, SEEK_SET) ||
+        fwrite(data, len, 1, p->cache_file) != 1 ||
+        fflush(p->cache_file))
+    {
+        MP_ERR(s, "can't write cache file, reading directly from the source "
+               "from now on\n");
+        p->write_failed = true;
+        return false;
+    }
+    return true;
+}
+
+static int read_direct(struct priv *p, char *buffer, int64_t pos, int max_len)
+{
+    if (stream_seek(p->original, pos) < 1)
+        return -1;
+    return stream_read(p->original, buffer, max_len);
 }
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -59,25 +255,26 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     struct priv *p = s->priv;
     if (s->pos < 0)
         return -1;
-    if (s->pos >= p->max_size) {
-        if (stream_seek(p->original, s->pos) < 1)
-            return -1;
-        return stream_read(p->original, buffer, max_len);
-    }
+    if (s->pos >= p->map_size)
+        return read_direct(p, buffer, s->pos, max_len);
     // Size of file changes -> invalidate last block
     if (s->pos >= p->size - BLOCK_SIZE) {
         int64_t new_size = -1;
         stream_control(s, STREAM_CTRL_GET_SIZE, &new_size);
         if (p->size >= 0 && new_size != p->size)
-            set_bit(p, BLOCK_ALIGN(p->size), 0);
-        p->size = MPMIN(p->max_size, new_size);
+            cut_ranges(p, BLOCK_ALIGN(p->size));
+        p->size = new_size;
     }
-    int64_t aligned = BLOCK_ALIGN(s->pos);
-    if (!test_bit(p, aligned)) {
-        char tmp[BLOCK_SIZE];
+    int64_t len = 0;
+    uint8_t *data = get_slice(p, s->pos, &len);
+    if (!data) {
+        if (p->write_failed)
+            return read_direct(p, buffer, s->pos, max_len);
+        int64_t aligned = BLOCK_ALIGN(s->pos);
+        int block = MPMIN(BLOCK_SIZE, p->map_size - aligned);
         stream_seek(p->original, aligned);
-        int r = stream_read(p->original, tmp, BLOCK_SIZE);
-        if (r < BLOCK_SIZE) {
+        int r = stream_read(p->original, p->block, block);
+        if (r < block) {
             if (p->size < 0) {
                 MP_WARN(s, "suspected EOF\n");
             } else if (aligned + r < p->size) {
@@ -85,20 +282,19 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
                 return -1;
             }
         }
-        if (fseeko(p->cache_file, aligned, SEEK_SET))
-            return -1;
-        if (fwrite(tmp, r, 1, p->cache_file) != 1)
-            return -1;
-        set_bit(p, aligned, 1);
+        if (r > 0 && !write_block(s, p, aligned, p->block, r))
+            return read_direct(p, buffer, s->pos, max_len);
+        add_range(p, aligned, aligned + r);
+        data = get_slice(p, s->pos, &len);
+        if (!data)
+            return 0;
     }
-    if (fseeko(p->cache_file, s->pos, SEEK_SET))
-        return -1;
-    // align/limit to blocks
-    max_len = MPMIN(max_len, BLOCK_SIZE - (s->pos % BLOCK_SIZE));
     // Limit to max. known file size
     if (p->size >= 0)
-        max_len = MPMIN(max_len, p->size - s->pos);
-    return fread(buffer, 1, max_len, p->cache_file);
+        len = MPCLAMP(p->size - s->pos, 0, len);
+    len = MPMIN(len, max_len);
+    memcpy(buffer, data, len);
+    return len;
 }
 
 static int seek(stream_t *s, int64_t newpos)
@@ -115,6 +311,10 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->map) {
+        store_map(s, p);
+        munmap(p->map, p->map_size);
+    }
     if (p->cache_file)
         fclose(p->cache_file);
     talloc_free(p);
@@ -132,22 +332,62 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
         return -1;
     }
 
+    struct priv *p = talloc_zero(NULL, struct priv);
+    cache->priv = p;
+    p->original = stream;
+    p->max_size = opts->file_max * 1024LL;
+    p->size = -1;
+    stream_control(stream, STREAM_CTRL_GET_SIZE, &p->size);
+    p->map_size = p->size >= 0 ? MPMIN(p->size, p->max_size) : p->max_size;
+
+    p->block = talloc_size(p, BLOCK_SIZE);
+
+    // A cache file can be reused only if the source is known to be the same.
     bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+    int head_len = -1;
+    if (!use_anon_file && p->size > 0) {
+        head_len = read_validator(p, p->block);
+        if (head_len > 0)
+            p->map_filename = talloc_asprintf(p, "%s.map", opts->file);
+    }
+
+    FILE *file = NULL;
+    if (use_anon_file) {
+        file = tmpfile();
+    } else {
+        if (p->map_filename && load_map(cache, p))
+            file = fopen(opts->file, "rb+");
+        if (!file) {
+            p->num_ranges = 0;
+            if (p->map_filename)
+                unlink(p->map_filename);
+            file = fopen(opts->file, "wb+");
+        }
+    }
     if (!file) {
         MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
-        return -1;
+        goto error;
     }
-
-    struct priv *p = talloc_zero(NULL, struct priv);
-
-    cache->priv = p;
-    p->original = stream;
     p->cache_file = file;
-    p->max_size = opts->file_max * 1024LL;
 
-    // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
+    if (p->map_size < 1 || (size_t)p->map_size != p->map_size ||
+        ftruncate(fileno(file), p->map_size))
+    {
+        MP_ERR(cache, "can't resize cache file '%s'\n", opts->file);
+        goto error;
+    }
+    p->map = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fileno(file), 0);
+    if (p->map == MAP_FAILED) {
+        p->map = NULL;
+        MP_ERR(cache, "can't map cache file '%s'\n", opts->file);
+        goto error;
+    }
+
+    // Don't read the first block twice.
+    if (head_len > 0 && cached_bytes(p, 0) < head_len &&
+        write_block(cache, p, 0, p->block, head_len))
+        add_range(p, 0, head_len);
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
@@ -155,4 +395,11 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
     cache->close = s_close;
 
     return 1;
+
+error:
+    cache->priv = NULL;
+    if (p->cache_file)
+        fclose(p->cache_file);
+    talloc_free(p);
+    return -1;
 }
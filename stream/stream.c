@@ -24,8 +24,10 @@
 
 #include <strings.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
+#include <libavutil/buffer.h>
 #include "osdep/atomics.h"
 #include "osdep/io.h"
 
@@ -546,6 +548,14 @@ struct bstr stream_peek(stream_t *s, int len)
 {
     assert(len >= 0);
     assert(len <= STREAM_MAX_BUFFER_SIZE);
+    if (s->mapped) {
+        // Return the data directly from the mapping.
+        int64_t pos = stream_tell(s);
+        if (pos >= 0 && pos < s->mapped_size) {
+            return (bstr){.start = s->mapped->data + pos,
+                          .len = MPMIN(len, s->mapped_size - pos)};
+        }
+    }
     if (s->buf_len - s->buf_pos < len) {
         // Move to front to guarantee we really can read up to max size.
         int buf_valid = s->buf_len - s->buf_pos;
@@ -570,6 +580,34 @@ struct bstr stream_peek(stream_t *s, int len)
                   .len = FFMIN(len, s->buf_len - s->buf_pos)};
 }
 
+// If the stream is memory mapped, return a reference to the next len bytes
+// (without copying them), and skip them. padding is the number of bytes after
+// them that must be accessible (e.g. for decoders which read past the end).
+// Note that the padding contains file data, not zeros.
+// Returns NULL without changing the position if the stream is not mapped, or
+// if fewer than len + padding bytes are left in the mapping (e.g. near the end
+// of the file). The caller has to read (copy) the data then.
+// Free with av_buffer_unref().
+struct AVBufferRef *stream_read_slice(stream_t *s, int len, int padding)
+{
+    if (!s->mapped || len < 0 || padding < 0)
+        return NULL;
+    int64_t pos = stream_tell(s);
+    if (pos < 0 || pos + len + padding > s->mapped_size)
+        return NULL;
+    AVBufferRef *ref = av_buffer_ref(s->mapped);
+    if (!ref)
+        return NULL;
+    ref->data += pos;
+    ref->size = len;
+    if (!stream_seek(s, pos + len)) {
+        av_buffer_unref(&ref);
+        return NULL;
+    }
+    stream_capture_write(s, ref->data, len);
+    return ref;
+}
+
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
 {
     int rd;
@@ -949,11 +987,37 @@ struct mp_cancel {
     HANDLE event;
 #endif
     int wakeup_pipe[2];
+    // Protected by cancel_link_lock.
+    struct mp_cancel *parent;
+    struct mp_cancel **slaves;
+    int num_slaves;
 };
 
+static pthread_mutex_t cancel_link_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Caller must hold cancel_link_lock.
+static void cancel_unlink(struct mp_cancel *c)
+{
+    struct mp_cancel *parent = c->parent;
+    if (!parent)
+        return;
+    for (int n = 0; n < parent->num_slaves; n++) {
+        if (parent->slaves[n] == c) {
+            MP_TARRAY_REMOVE_AT(parent->slaves, parent->num_slaves, n);
+            break;
+        }
+    }
+    c->parent = NULL;
+}
+
 static void cancel_destroy(void *p)
 {
     struct mp_cancel *c = p;
+    pthread_mutex_lock(&cancel_link_lock);
+    cancel_unlink(c);
+    for (int n = 0; n < c->num_slaves; n++)
+        c->slaves[n]->parent = NULL;
+    pthread_mutex_unlock(&cancel_link_lock);
 #ifdef __MINGW32__
     CloseHandle(c->event);
 #endif
@@ -973,14 +1037,41 @@ struct mp_cancel *mp_cancel_new(void *talloc_ctx)
     return c;
 }
 
-// Request abort.
-void mp_cancel_trigger(struct mp_cancel *c)
+// Caller must hold cancel_link_lock.
+static void cancel_trigger_locked(struct mp_cancel *c)
 {
     atomic_store(&c->triggered, true);
 #ifdef __MINGW32__
     SetEvent(c->event);
 #endif
     write(c->wakeup_pipe[1], &(char){0}, 1);
+    for (int n = 0; n < c->num_slaves; n++)
+        cancel_trigger_locked(c->slaves[n]);
+}
+
+// Request abort. This also triggers all slaves (see mp_cancel_set_parent()).
+void mp_cancel_trigger(struct mp_cancel *c)
+{
+    pthread_mutex_lock(&cancel_link_lock);
+    cancel_trigger_locked(c);
+    pthread_mutex_unlock(&cancel_link_lock);
+}
+
+// Make slave get triggered whenever parent is triggered (and trigger it right
+// away if parent is already triggered). Triggering slave doesn't affect parent.
+// parent==NULL removes the link. The link is removed automatically if either
+// of them is destroyed.
+void mp_cancel_set_parent(struct mp_cancel *slave, struct mp_cancel *parent)
+{
+    pthread_mutex_lock(&cancel_link_lock);
+    cancel_unlink(slave);
+    if (parent) {
+        MP_TARRAY_APPEND(parent, parent->slaves, parent->num_slaves, slave);
+        slave->parent = parent;
+        if (atomic_load(&parent->triggered))
+            cancel_trigger_locked(slave);
+    }
+    pthread_mutex_unlock(&cancel_link_lock);
 }
 
 // Restore original state. (Allows reusing a mp_cancel.)
@@ -28,6 +28,8 @@
 
 #include "misc/bstr.h"
 
+struct AVBufferRef;
+
 enum streamtype {
     STREAMTYPE_GENERIC = 0,
     STREAMTYPE_FILE,
@@ -207,6 +209,13 @@ typedef struct stream {
 
     struct stream *uncached_stream; // underlying stream for cache wrapper
 
+    // If set, the whole stream is memory mapped (read-only), and mapped->data
+    // points to the start of it. The stream implementation keeps one
+    // reference, see stream_read_slice(). (mapped->size is meaningless, because
+    // AVBufferRef can't represent the size of large files.)
+    struct AVBufferRef *mapped;
+    int64_t mapped_size;
+
     // Includes additional padding in case sizes get rounded up by sector size.
     unsigned char buffer[];
 } stream_t;
@@ -252,6 +261,7 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, char *mem, int total);
 int stream_read_partial(stream_t *s, char *buf, int buf_size);
 struct bstr stream_peek(stream_t *s, int len);
+struct AVBufferRef *stream_read_slice(stream_t *s, int len, int padding);
 void stream_drop_buffers(stream_t *s);
 
 struct mpv_global;
@@ -276,6 +286,7 @@ void mp_cancel_trigger(struct mp_cancel *c);
 bool mp_cancel_test(struct mp_cancel *c);
 bool mp_cancel_wait(struct mp_cancel *c, double timeout);
 void mp_cancel_reset(struct mp_cancel *c);
+void mp_cancel_set_parent(struct mp_cancel *slave, struct mp_cancel *parent);
 void *mp_cancel_get_event(struct mp_cancel *c); // win32 HANDLE
 int mp_cancel_get_fd(struct mp_cancel *c);
 
@@ -26,6 +26,8 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <libavutil/buffer.h>
+
 #ifndef __MINGW32__
 #include <poll.h>
 #endif
@@ -34,8 +36,10 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/prefetch.h"
 #include "stream.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "options/path.h"
 
 #if HAVE_BSD_FSTATFS
@@ -57,16 +61,74 @@
 #endif
 #endif
 
+// Size of a single asynchronous read with --file-readahead.
+#define READAHEAD_CHUNK (512 * 1024)
+
 struct priv {
     int fd;
     bool close;
     bool regular;
+    struct mp_prefetch *ra;     // reads chunk n at n * READAHEAD_CHUNK
 };
 
+#ifndef __MINGW32__
+static void readahead_chunk(void *ctx, struct mp_prefetch_slot *c)
+{
+    struct priv *p = ctx;
+    if (!c->data)
+        c->data = talloc_size(c, READAHEAD_CHUNK);
+    int64_t pos = c->key * READAHEAD_CHUNK;
+    int len = 0;
+    while (len < READAHEAD_CHUNK) {
+        ssize_t r = pread(p->fd, (char *)c->data + len, READAHEAD_CHUNK - len,
+                          pos + len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 && len == 0)
+            len = -1;
+        if (r <= 0)
+            break;
+        len += r;
+    }
+    c->len = len;
+}
+
+static int readahead_read(stream_t *s, struct mp_prefetch *ra, char *buffer,
+                          int max_len)
+{
+    int64_t key = s->pos / READAHEAD_CHUNK;
+    struct mp_prefetch_slot *c = mp_prefetch_wait(ra, key);
+    if (!c)
+        return -1;
+    int offset = s->pos - key * READAHEAD_CHUNK;
+    int res = -1;
+    if (c->len > offset) {
+        res = MPMIN(max_len, c->len - offset);
+        memcpy(buffer, (char *)c->data + offset, res);
+    }
+    // On EOF or error, don't keep the result, the file might be appended to
+    // later.
+    mp_prefetch_release(ra, c, res < 0);
+    return res;
+}
+#endif
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (s->mapped) {
+        if (s->pos < s->mapped_size) {
+            int len = MPMIN(max_len, s->mapped_size - s->pos);
+            memcpy(buffer, s->mapped->data + s->pos, len);
+            return len;
+        }
+        // The file was appended to after mapping it.
+        if (lseek(p->fd, s->pos, SEEK_SET) == (off_t)-1)
+            return -1;
+    }
 #ifndef __MINGW32__
+    if (p->ra)
+        return readahead_read(s, p->ra, buffer, max_len);
     if (!p->regular) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
         struct pollfd fds[2] = {
@@ -100,6 +162,8 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (s->mapped)
+        return 1; // fill_buffer() seeks if needed
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
@@ -123,6 +187,10 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    av_buffer_unref(&s->mapped);
+#ifndef __MINGW32__
+    mp_prefetch_destroy(p->ra);
+#endif
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
@@ -227,6 +295,32 @@ static bool check_stream_network(int fd)
 }
 #endif
 
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    munmap(data, (uintptr_t)opaque);
+}
+
+// Map the whole file, so that it can be read with stream_read_slice().
+static void map_file(stream_t *s, int fd, int64_t size)
+{
+    if ((size_t)size != size)
+        return;
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        MP_VERBOSE(s, "Could not map file: %s\n", mp_strerror(errno));
+        return;
+    }
+    s->mapped = av_buffer_create(data, MPMIN(size, INT_MAX), unmap_file,
+                                 (void *)(uintptr_t)size,
+                                 AV_BUFFER_FLAG_READONLY);
+    if (!s->mapped) {
+        munmap(data, size);
+        return;
+    }
+    s->mapped_size = size;
+    MP_VERBOSE(s, "Memory mapped %"PRId64" bytes.\n", size);
+}
+
 static int open_f(stream_t *stream)
 {
     int fd;
@@ -310,6 +404,27 @@ static int open_f(stream_t *stream)
     if (check_stream_network(fd))
         stream->streaming = true;
 
+    bool use_mmap = stream->opts && stream->opts->file_mmap;
+#ifndef __MINGW32__
+    use_mmap &= priv->regular;
+#endif
+    if (use_mmap && !write && !stream->streaming && len > 0)
+        map_file(stream, fd, len);
+
+#ifndef __MINGW32__
+    int depth = stream->opts ? stream->opts->file_readahead : 0;
+    if (!stream->mapped && priv->regular && !write && stream->seekable &&
+        depth > 0)
+    {
+        priv->ra = mp_prefetch_create(depth, INT64_MAX, readahead_chunk, priv,
+                                      "file readahead");
+        if (priv->ra) {
+            MP_VERBOSE(stream, "Using %d asynchronous reads.\n",
+                       mp_prefetch_num_threads(priv->ra));
+        }
+    }
+#endif
+
     return STREAM_OK;
 }
 
@@ -438,7 +438,7 @@ bool sub_read_all_packets(struct dec_sub *sub, struct sh_stream *sh)
             break;
         if (preprocess) {
             decode_chain(sub->sd, preprocess, pkt);
-            talloc_free(pkt);
+            free_demux_packet(pkt);
             while (1) {
                 pkt = get_decoded_packet(sub->sd[preprocess - 1]);
                 if (!pkt)
@@ -447,7 +447,7 @@ bool sub_read_all_packets(struct dec_sub *sub, struct sh_stream *sh)
             }
         } else {
             add_packet(subs, pkt);
-            talloc_free(pkt);
+            free_demux_packet(pkt);
         }
     }
 
@@ -0,0 +1,144 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+#include "talloc.h"
+
+// Planar S16 stereo; each sample of channel c is (value * 2 + c).
+static struct mp_audio make_fmt(void)
+{
+    struct mp_audio fmt = {.rate = 48000};
+    mp_audio_set_format(&fmt, AF_FORMAT_S16P);
+    mp_audio_set_num_channels(&fmt, 2);
+    return fmt;
+}
+
+static void append_seq(struct mp_audio_buffer *ab, int first, int samples)
+{
+    struct mp_audio fmt = make_fmt();
+    int16_t data[2][256];
+    assert_true(samples <= 256);
+    for (int c = 0; c < 2; c++) {
+        for (int n = 0; n < samples; n++)
+            data[c][n] = (first + n) * 2 + c;
+        fmt.planes[c] = data[c];
+    }
+    fmt.samples = samples;
+    mp_audio_buffer_append(ab, &fmt);
+}
+
+// Read and skip the given number of samples, check they're a sequence
+// starting with first. Return the number of spans the data was split into.
+static int check_seq(struct mp_audio_buffer *ab, int first, int samples)
+{
+    struct mp_audio data[2];
+    mp_audio_buffer_peek(ab, &data[0], &data[1]);
+    assert_int_equal(data[0].samples + data[1].samples,
+                     mp_audio_buffer_samples(ab));
+    int num_spans = 0;
+    for (int s = 0; s < 2 && samples > 0; s++) {
+        int len = MPMIN(data[s].samples, samples);
+        for (int c = 0; c < 2; c++) {
+            int16_t *plane = data[s].planes[c];
+            for (int n = 0; n < len; n++)
+                assert_int_equal(plane[n], (first + n) * 2 + c);
+        }
+        mp_audio_buffer_skip(ab, len);
+        first += len;
+        samples -= len;
+        num_spans++;
+    }
+    assert_int_equal(samples, 0);
+    return num_spans;
+}
+
+static void test_ring(void **state) {
+    struct mp_audio_buffer *ab = mp_audio_buffer_create(NULL);
+    struct mp_audio fmt = make_fmt();
+    mp_audio_buffer_reinit(ab, &fmt);
+    mp_audio_buffer_preallocate_min(ab, 100);
+    int size = mp_audio_buffer_get_write_available(ab);
+    assert_true(size >= 100);
+
+    // Keep the buffer partially filled, and move through it several times.
+    // This must never resize the internal buffer.
+    int wpos = 0, rpos = 0, wrapped = 0;
+    for (int i = 0; i < 50; i++) {
+        int n = 37 + i % 5;
+        append_seq(ab, wpos, n);
+        wpos += n;
+        if (mp_audio_buffer_samples(ab) > size / 2) {
+            int r = mp_audio_buffer_samples(ab) - 10;
+            wrapped += check_seq(ab, rpos, r) == 2;
+            rpos += r;
+        }
+        assert_int_equal(mp_audio_buffer_samples(ab) +
+                         mp_audio_buffer_get_write_available(ab), size);
+    }
+    assert_true(wrapped > 0);
+
+    // Silence is prepended before the start, wrapping around the other way.
+    check_seq(ab, rpos, mp_audio_buffer_samples(ab));
+    append_seq(ab, 0, 20);
+    check_seq(ab, 0, 5);
+    mp_audio_buffer_prepend_silence(ab, 30);
+    struct mp_audio data[2];
+    mp_audio_buffer_peek(ab, &data[0], &data[1]);
+    assert_int_equal(data[0].samples + data[1].samples, 45);
+    for (int n = 0; n < 30; n++) {
+        struct mp_audio *d = n < data[0].samples ? &data[0] : &data[1];
+        int pos = n < data[0].samples ? n : n - data[0].samples;
+        assert_int_equal(((int16_t *)d->planes[1])[pos], 0);
+    }
+    mp_audio_buffer_skip(ab, 30);
+    check_seq(ab, 5, 15);
+
+    talloc_free(ab);
+}
+
+static void test_grow(void **state) {
+    struct mp_audio_buffer *ab = mp_audio_buffer_create(NULL);
+    struct mp_audio fmt = make_fmt();
+    mp_audio_buffer_reinit(ab, &fmt);
+
+    // Growing a wrapped buffer keeps the data in order.
+    mp_audio_buffer_preallocate_min(ab, 64);
+    int size = mp_audio_buffer_get_write_available(ab);
+    append_seq(ab, 0, size - 10);
+    check_seq(ab, 0, size - 20);
+    append_seq(ab, size - 10, 15);
+    for (int n = 0; n < 4; n++)
+        append_seq(ab, size + 5 + n * 200, 200);
+    check_seq(ab, size - 20, 825);
+    assert_int_equal(mp_audio_buffer_samples(ab), 0);
+
+    // Data that wraps can be made contiguous.
+    mp_audio_buffer_reinit(ab, &fmt);
+    mp_audio_buffer_preallocate_min(ab, 64);
+    size = mp_audio_buffer_get_write_available(ab);
+    append_seq(ab, 0, 100);
+    check_seq(ab, 0, 90);
+    append_seq(ab, 100, size - 20);
+    struct mp_audio data[2];
+    mp_audio_buffer_peek(ab, &data[0], &data[1]);
+    assert_true(data[1].samples > 0);
+    // This happens within the internal buffer.
+    void *plane = data[1].planes[0];
+    mp_audio_buffer_make_contiguous(ab);
+    mp_audio_buffer_peek(ab, &data[0], &data[1]);
+    assert_int_equal(data[1].samples, 0);
+    assert_ptr_equal(data[0].planes[0], plane);
+    assert_int_equal(mp_audio_buffer_samples(ab) +
+                     mp_audio_buffer_get_write_available(ab), size);
+    assert_int_equal(check_seq(ab, 90, size - 10), 1);
+
+    talloc_free(ab);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_ring),
+        cmocka_unit_test(test_grow),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,365 @@
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/dsp.h"
+#include "audio/filter/fftconv.h"
+#include "audio/filter/xcorr.h"
+#include "audio_dsp_ref.h"
+
+// Compare the C and the runtime selected functions on all lengths up to a few
+// vectors, at all alignments.
+static void test_scale(void **state)
+{
+    struct af_dsp_funcs c, best;
+    af_dsp_init_funcs(&c, 0);
+    af_dsp_init_funcs(&best, av_get_cpu_flags());
+
+    uint64_t st = 1;
+    float gains[] = {0, 0.25, 1.0, 1.7, 30.0};
+    int vols[] = {0, 64, 255, 256, 1000, 32767, 40000};
+    for (int len = 0; len < 70; len++) {
+        for (int off = 0; off < 8; off++) {
+            float fa[80], fb[80];
+            fill_float(fa, len + off, &st);
+            memcpy(fb, fa, sizeof(fa));
+            float gain = gains[len % MP_ARRAY_SIZE(gains)];
+            c.scale_float(fa + off, len, gain);
+            best.scale_float(fb + off, len, gain);
+            assert_memory_equal(fa, fb, (len + off) * sizeof(float));
+
+            int16_t sa[80], sb[80];
+            fill_s16(sa, len + off, &st);
+            memcpy(sb, sa, sizeof(sa));
+            int vol = vols[(len + off) % MP_ARRAY_SIZE(vols)];
+            c.scale_s16(sa + off, len, vol);
+            best.scale_s16(sb + off, len, vol);
+            assert_memory_equal(sa, sb, (len + off) * sizeof(int16_t));
+        }
+    }
+}
+
+static void test_interleave(void **state)
+{
+    struct af_dsp_funcs c, best;
+    af_dsp_init_funcs(&c, 0);
+    af_dsp_init_funcs(&best, av_get_cpu_flags());
+
+    uint64_t st = 5;
+    for (int nch = 1; nch <= MP_NUM_CHANNELS; nch++) {
+        for (int len = 0; len < 40; len++) {
+            float in[MP_NUM_CHANNELS * 40], out[MP_NUM_CHANNELS * 40];
+            float planes[2][MP_NUM_CHANNELS][40];
+            float *pa[MP_NUM_CHANNELS], *pb[MP_NUM_CHANNELS];
+            for (int n = 0; n < nch; n++) {
+                pa[n] = planes[0][n];
+                pb[n] = planes[1][n];
+            }
+            fill_float(in, nch * len, &st);
+            c.deinterleave_float(pa, in, nch, len);
+            best.deinterleave_float(pb, in, nch, len);
+            for (int n = 0; n < nch; n++)
+                assert_memory_equal(pa[n], pb[n], len * sizeof(float));
+            best.interleave_float(out, pb, nch, len);
+            assert_memory_equal(in, out, nch * len * sizeof(float));
+        }
+    }
+}
+
+static void test_mix(void **state)
+{
+    uint64_t st = 6;
+    int num = 300;
+    float *in = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    float *a = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    float *b = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    for (int in_nch = 1; in_nch <= MP_NUM_CHANNELS; in_nch++) {
+        for (int out_nch = 1; out_nch <= MP_NUM_CHANNELS; out_nch++) {
+            // Mix of zero, copied and mixed channels.
+            float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS] = {{0}};
+            for (int o = 0; o < out_nch; o++) {
+                for (int i = 0; i < in_nch; i++) {
+                    int r = rnd(&st) % 4;
+                    if (o % 3 == 1) {
+                        matrix[o][i] = i == o % in_nch;
+                    } else if (o % 3 == 2 && r) {
+                        matrix[o][i] = r / 4.0f;
+                    }
+                }
+            }
+            fill_float(in, num * in_nch, &st);
+            mix_ref(a, out_nch, in, in_nch, matrix, num);
+            af_dsp_mix_float(b, out_nch, in, in_nch, matrix, num);
+            for (int n = 0; n < num * out_nch; n++)
+                assert_true(a[n] == b[n]);
+            if (in_nch == out_nch) {
+                af_dsp_mix_float(in, in_nch, in, in_nch, matrix, num);
+                for (int n = 0; n < num * out_nch; n++)
+                    assert_true(a[n] == in[n]);
+            }
+        }
+    }
+    talloc_free(in);
+    talloc_free(a);
+    talloc_free(b);
+}
+
+static void test_delay_line(void **state)
+{
+    uint64_t st = 7;
+    int bps_list[] = {1, 2, 3, 4};
+    for (int b = 0; b < MP_ARRAY_SIZE(bps_list); b++) {
+        for (int same = 0; same < 2; same++) {
+            int bps = bps_list[b], nch = 3, total = 20000;
+            int delays[3] = {100, same ? 100 : 0, same ? 100 : 5000};
+            uint8_t *in = talloc_size(NULL, total * nch * bps);
+            uint8_t *out = talloc_size(NULL, total * nch * bps);
+            for (int n = 0; n < total * nch * bps; n++)
+                in[n] = rnd(&st);
+            memcpy(out, in, total * nch * bps);
+            struct af_delay_line *d =
+                af_delay_line_alloc(NULL, nch, bps, delays);
+            // Feed the data in chunks of random size, some of which are
+            // larger than the internal chunk size.
+            int pos = 0;
+            while (pos < total) {
+                int n = rnd(&st) % 6000;
+                n = MPMIN(n, total - pos);
+                af_delay_line_process(d, out + pos * nch * bps, n);
+                pos += n;
+            }
+            for (int n = 0; n < total; n++) {
+                for (int c = 0; c < nch; c++) {
+                    uint8_t zero[4] = {0};
+                    int src = n - delays[c];
+                    uint8_t *exp = src < 0 ? zero : in + (src * nch + c) * bps;
+                    assert_memory_equal(out + (n * nch + c) * bps, exp, bps);
+                }
+            }
+            talloc_free(d);
+            talloc_free(in);
+            talloc_free(out);
+        }
+    }
+}
+
+static void test_biquad(void **state)
+{
+    struct af_dsp_funcs c, best;
+    af_dsp_init_funcs(&c, 0);
+    af_dsp_init_funcs(&best, av_get_cpu_flags());
+
+    uint64_t st = 9;
+    float a[10][2], b[10][2];
+    eq_design(48000, a, b);
+    int num = 1000;
+    float *ref = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    float *x = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    float *y = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    for (int nch = 1; nch <= MP_NUM_CHANNELS; nch++) {
+        struct af_biquad_lanes lx[10] = {{{{0}}}}, ly[10] = {{{{0}}}};
+        float g[MP_NUM_CHANNELS][10], wq[MP_NUM_CHANNELS][10][2] = {{{0}}};
+        for (int k = 0; k < 10; k++) {
+            for (int ch = 0; ch < nch; ch++) {
+                g[ch][k] = (rnd(&st) % 100) / 25.0f - 1.0f;
+                struct af_biquad bq = eq_section(a[k], b[k], g[ch][k]);
+                float v[] = {bq.b0, bq.a1, bq.a2, bq.d, bq.c0, bq.c1, bq.c2};
+                for (int i = 0; i < AF_BQ_NUM_COEFFS; i++)
+                    lx[k].coef[i][ch] = ly[k].coef[i][ch] = v[i];
+            }
+        }
+        fill_float(ref, num * nch, &st);
+        memcpy(x, ref, num * nch * sizeof(float));
+        memcpy(y, ref, num * nch * sizeof(float));
+        eq_ref(ref, nch, num, a, b, g, wq);
+        c.biquad_cascade(x, nch, num, lx, 10);
+        best.biquad_cascade(y, nch, num, ly, 10);
+        for (int n = 0; n < num * nch; n++) {
+            float tol = MPMAX(fabs(ref[n]), 1.0f);
+            assert_true(fabs(x[n] - ref[n]) < 1e-3 * tol);
+            assert_true(fabs(x[n] - y[n]) < 1e-6 * tol);
+        }
+    }
+    talloc_free(ref);
+    talloc_free(x);
+    talloc_free(y);
+}
+
+// Changing the gains must only crossfade the outputs: once the ramp is over,
+// the result is the same as with the new gains from the start.
+static void test_biquad_ramp(void **state)
+{
+    uint64_t st = 10;
+    float a[10][2], b[10][2];
+    eq_design(48000, a, b);
+    int nch = 2, num = 4000, ramp = 1000;
+    float *x = talloc_array(NULL, float, num * nch);
+    float *y = talloc_array(NULL, float, num * nch);
+    fill_float(x, num * nch, &st);
+    memcpy(y, x, num * nch * sizeof(float));
+
+    struct af_biquad_cascade *cx = af_biquad_cascade_alloc(NULL, nch, 1);
+    struct af_biquad_cascade *cy = af_biquad_cascade_alloc(NULL, nch, 1);
+    struct af_biquad from = eq_section(a[5], b[5], -0.5);
+    struct af_biquad to = eq_section(a[5], b[5], 2.0);
+    for (int ch = 0; ch < nch; ch++) {
+        af_biquad_cascade_set(cx, 0, ch, &from);
+        af_biquad_cascade_set(cy, 0, ch, &to);
+    }
+    af_biquad_cascade_update(cx, 0);
+    af_biquad_cascade_update(cy, 0);
+    af_biquad_cascade_process(cx, x, 500);
+    for (int ch = 0; ch < nch; ch++)
+        af_biquad_cascade_set(cx, 0, ch, &to);
+    af_biquad_cascade_update(cx, ramp);
+    af_biquad_cascade_process(cx, x + 500 * nch, num - 500);
+    af_biquad_cascade_process(cy, y, num);
+
+    for (int n = 500 + ramp; n < num; n++) {
+        for (int ch = 0; ch < nch; ch++)
+            assert_true(x[n * nch + ch] == y[n * nch + ch]);
+    }
+    talloc_free(cx);
+    talloc_free(cy);
+    talloc_free(x);
+    talloc_free(y);
+}
+
+static void test_xcorr(void **state)
+{
+    uint64_t st = 3;
+    int sizes[][2] = {{1, 1}, {1, 17}, {5, 5}, {100, 333}, {1150, 2494}};
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        int len_a = sizes[n][0], len_b = sizes[n][1];
+        struct mp_xcorr *x = mp_xcorr_create(NULL, len_a, len_b);
+        assert_non_null(x);
+        float *a = talloc_array(x, float, len_a);
+        float *b = talloc_array(x, float, len_b);
+        float *ref = talloc_array(x, float, len_b - len_a + 1);
+        fill_float(a, len_a, &st);
+        fill_float(b, len_b, &st);
+        xcorr_direct(a, len_a, b, len_b, ref);
+        // Run twice to check that no state is left over.
+        for (int r = 0; r < 2; r++) {
+            memcpy(mp_xcorr_get_a(x), a, len_a * sizeof(float));
+            memcpy(mp_xcorr_get_b(x), b, len_b * sizeof(float));
+            const float *res = mp_xcorr_run(x);
+            // The result has an unspecified scale.
+            double rr = 0, rf = 0;
+            for (int k = 0; k <= len_b - len_a; k++) {
+                rr += res[k] * ref[k];
+                rf += ref[k] * ref[k];
+            }
+            double scale = rr / rf;
+            assert_true(scale > 0);
+            for (int k = 0; k <= len_b - len_a; k++)
+                assert_true(fabs(res[k] / scale - ref[k]) < 1e-3 * len_a);
+        }
+        talloc_free(x);
+    }
+    assert_null(mp_xcorr_create(NULL, 1 << 20, 1 << 20));
+}
+
+static void test_cmul_add(void **state)
+{
+    struct af_dsp_funcs c, best;
+    af_dsp_init_funcs(&c, 0);
+    af_dsp_init_funcs(&best, av_get_cpu_flags());
+    uint64_t st = 12;
+    for (int num = 0; num < 20; num++) {
+        float a[40], b[40], x[40], y[40];
+        fill_float(a, num * 2, &st);
+        fill_float(b, num * 2, &st);
+        fill_float(x, num * 2, &st);
+        memcpy(y, x, sizeof(x));
+        c.cmul_add(x, a, b, num);
+        best.cmul_add(y, a, b, num);
+        for (int n = 0; n < num * 2; n++)
+            assert_true(fabs(x[n] - y[n]) < 1e-6);
+    }
+}
+
+struct test_ir {
+    int in, out, len, delay;
+    float gain;
+};
+
+static void test_fftconv(void **state)
+{
+    uint64_t st = 13;
+    int block = 32, num_in = 3, num_out = 2, num = 3000;
+    struct test_ir irs[] = {
+        {0, 0, 100, 0, 1},
+        {1, 0, 37, 300, 0.5},
+        {2, 1, 500, 5, 1},
+        // Added to the same response twice.
+        {0, 1, 10, 0, 0.25},
+        {0, 1, 10, 0, 0.75},
+    };
+    void *tmp = talloc_new(NULL);
+    struct mp_fftconv *c = mp_fftconv_create(tmp, block, num_in, num_out, 505);
+    assert_non_null(c);
+    float *in[3], *out[2], *ref[2];
+    for (int i = 0; i < num_in; i++) {
+        in[i] = talloc_array(tmp, float, num);
+        fill_float(in[i], num, &st);
+    }
+    for (int o = 0; o < num_out; o++) {
+        out[o] = talloc_array(tmp, float, num);
+        ref[o] = talloc_zero_array(tmp, float, num);
+    }
+    for (int n = 0; n < MP_ARRAY_SIZE(irs); n++) {
+        struct test_ir *t = &irs[n];
+        float *ir = talloc_array(tmp, float, t->len);
+        fill_float(ir, t->len, &st);
+        // A silent partition in the middle.
+        if (t->len >= 500)
+            memset(ir + 200, 0, 100 * sizeof(float));
+        mp_fftconv_add_ir(c, t->in, t->out, ir, t->len, t->delay, t->gain);
+        // The output lags by one block.
+        int lag = block + t->delay;
+        for (int k = lag; k < num; k++) {
+            for (int j = 0; j < t->len && j <= k - lag; j++)
+                ref[t->out][k] += t->gain * ir[j] * in[t->in][k - lag - j];
+        }
+    }
+    // Run twice to check that reset clears the state.
+    for (int r = 0; r < 2; r++) {
+        for (int pos = 0; pos < num;) {
+            int n = rnd(&st) % 100;
+            n = MPMIN(n, num - pos);
+            float *pin[3], *pout[2];
+            for (int i = 0; i < num_in; i++)
+                pin[i] = in[i] + pos;
+            for (int o = 0; o < num_out; o++)
+                pout[o] = out[o] + pos;
+            mp_fftconv_process(c, pin, pout, n);
+            pos += n;
+        }
+        for (int o = 0; o < num_out; o++) {
+            for (int k = 0; k < num; k++)
+                assert_true(fabs(out[o][k] - ref[o][k]) < 1e-4);
+        }
+        mp_fftconv_reset(c);
+    }
+    assert_null(mp_fftconv_create(tmp, 48, 1, 1, 100));
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_scale),
+        cmocka_unit_test(test_interleave),
+        cmocka_unit_test(test_mix),
+        cmocka_unit_test(test_delay_line),
+        cmocka_unit_test(test_biquad),
+        cmocka_unit_test(test_biquad_ramp),
+        cmocka_unit_test(test_xcorr),
+        cmocka_unit_test(test_cmul_add),
+        cmocka_unit_test(test_fftconv),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
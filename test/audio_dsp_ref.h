@@ -0,0 +1,98 @@
+#ifndef MP_TEST_AUDIO_DSP_REF_H
+#define MP_TEST_AUDIO_DSP_REF_H
+
+// Test data and the plain C loops replaced by the audio dsp functions, shared
+// by test/audio_dsp.c and test/bench/audio_dsp.c.
+
+#include <stdint.h>
+#include <math.h>
+
+#include "common/common.h"
+#include "audio/filter/dsp.h"
+
+// Simple deterministic PRNG, so that failures are reproducible.
+static inline uint32_t rnd(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+static inline void fill_float(float *a, int num, uint64_t *state)
+{
+    for (int i = 0; i < num; i++)
+        a[i] = (rnd(state) % 20001) / 10000.0f - 1.0f;
+}
+
+static inline void fill_s16(int16_t *a, int num, uint64_t *state)
+{
+    for (int i = 0; i < num; i++)
+        a[i] = (int)(rnd(state) & 0xFFFF) - 32768;
+}
+
+// The loop formerly used by af_pan.
+static inline void mix_ref(float *out, int out_nch, const float *in,
+                           int in_nch, float matrix[][MP_NUM_CHANNELS], int num)
+{
+    for (int n = 0; n < num; n++) {
+        for (int o = 0; o < out_nch; o++) {
+            float x = 0;
+            for (int i = 0; i < in_nch; i++)
+                x += in[n * in_nch + i] * matrix[o][i];
+            out[n * out_nch + o] = x;
+        }
+    }
+}
+
+// Band-pass filters as designed by af_equalizer, for the 10 octave bands.
+static inline void eq_design(int rate, float a[10][2], float b[10][2])
+{
+    for (int k = 0; k < 10; k++) {
+        double th = 2.0 * M_PI * 31.25 * (1 << k) / rate;
+        double q = 1.2247449;
+        double c = (1.0 - tan(th * q / 2.0)) / (1.0 + tan(th * q / 2.0));
+        a[k][0] = (1.0 + c) * cos(th);
+        a[k][1] = -1 * c;
+        b[k][0] = (1.0 - c) / 2.0;
+        b[k][1] = -1.0050;
+    }
+}
+
+static inline struct af_biquad eq_section(float a[2], float b[2], float g)
+{
+    return (struct af_biquad){
+        .b0 = b[0], .a1 = a[0], .a2 = a[1], .d = 1, .c0 = g, .c2 = g * b[1],
+    };
+}
+
+// The filter loop formerly used by af_equalizer.
+static inline void eq_ref(float *data, int nch, int num, float a[10][2],
+                          float b[10][2], float g[][10], float wq[][10][2])
+{
+    for (int ci = 0; ci < nch; ci++) {
+        for (int n = 0; n < num; n++) {
+            float yt = data[n * nch + ci];
+            for (int k = 0; k < 10; k++) {
+                float *w = wq[ci][k];
+                float wn = yt * b[k][0] + w[0] * a[k][0] + w[1] * a[k][1];
+                yt += (wn + w[1] * b[k][1]) * g[ci][k];
+                w[1] = w[0];
+                w[0] = wn;
+            }
+            data[n * nch + ci] = yt;
+        }
+    }
+}
+
+// The brute force overlap search as done by af_scaletempo.
+static inline void xcorr_direct(const float *a, int len_a, const float *b,
+                                int len_b, float *out)
+{
+    for (int k = 0; k <= len_b - len_a; k++) {
+        float corr = 0;
+        for (int i = 0; i < len_a; i++)
+            corr += a[i] * b[i + k];
+        out[k] = corr;
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "test_helpers.h"
+#include "audio/audio.h"
+#include "talloc.h"
+
+static struct mp_audio make_fmt(int format, int nch)
+{
+    struct mp_audio fmt = {.rate = 48000};
+    mp_audio_set_format(&fmt, format);
+    mp_audio_set_num_channels(&fmt, nch);
+    return fmt;
+}
+
+static void test_pool_recycle(void **state) {
+    struct mp_audio_pool *pool = mp_audio_pool_create(NULL);
+    struct mp_audio fmt = make_fmt(AF_FORMAT_FLOATP, 2);
+
+    // Two frames in flight at a time, as with a filter that gets its output
+    // frame before freeing the input frame.
+    struct mp_audio *prev = mp_audio_pool_get(pool, &fmt, 1024);
+    assert_non_null(prev);
+    for (int n = 0; n < 100; n++) {
+        struct mp_audio *cur = mp_audio_pool_get(pool, &fmt, 1024 - n);
+        assert_non_null(cur);
+        assert_true(mp_audio_is_writeable(cur));
+        talloc_free(prev);
+        prev = cur;
+    }
+    talloc_free(prev);
+    // 2 planes for each of the 2 frames.
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 4);
+
+    talloc_free(pool);
+}
+
+static void test_pool_reserve(void **state) {
+    struct mp_audio_pool *pool = mp_audio_pool_create(NULL);
+    struct mp_audio small = make_fmt(AF_FORMAT_S16, 2);
+    struct mp_audio large = make_fmt(AF_FORMAT_FLOAT, 6);
+
+    assert_true(mp_audio_pool_reserve(pool, 2048 * large.sstride));
+    for (int n = 0; n < 10; n++) {
+        struct mp_audio *a = mp_audio_pool_get(pool, &small, 2048);
+        struct mp_audio *b = mp_audio_pool_get(pool, &large, 2048);
+        assert_non_null(a);
+        assert_non_null(b);
+        talloc_free(a);
+        talloc_free(b);
+    }
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 2);
+
+    // Growing the pool discards the cached buffers.
+    struct mp_audio *c = mp_audio_pool_get(pool, &large, 8192);
+    assert_non_null(c);
+    talloc_free(c);
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 3);
+
+    assert_false(mp_audio_pool_reserve(pool, -1));
+
+    talloc_free(pool);
+}
+
+static void test_pool_release(void **state) {
+    struct mp_audio_pool *pool = mp_audio_pool_create(NULL);
+    struct mp_audio fmt = make_fmt(AF_FORMAT_S16P, 2);
+
+    // Released frames give back their data, and their structs are reused.
+    struct mp_audio *a = mp_audio_pool_get(pool, &fmt, 512);
+    assert_non_null(a);
+    uintptr_t a_addr = (uintptr_t)a;
+    mp_audio_pool_release(pool, a);
+    struct mp_audio *b = mp_audio_pool_get(pool, &fmt, 300);
+    assert_non_null(b);
+    assert_true((uintptr_t)b == a_addr);
+    assert_int_equal(b->samples, 300);
+    assert_true(mp_audio_is_writeable(b));
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 2);
+
+    // Two frames in flight; releasing them returns all buffers.
+    struct mp_audio *c = mp_audio_pool_new_copy(pool, b);
+    assert_non_null(c);
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 4);
+    mp_audio_pool_release(pool, b);
+    mp_audio_pool_release(pool, c);
+    b = mp_audio_pool_get(pool, &fmt, 512);
+    c = mp_audio_pool_get(pool, &fmt, 512);
+    assert_int_equal(mp_audio_pool_num_allocs(pool), 4);
+    talloc_free(b);
+    talloc_free(c);
+
+    talloc_free(pool);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_pool_recycle),
+        cmocka_unit_test(test_pool_reserve),
+        cmocka_unit_test(test_pool_release),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
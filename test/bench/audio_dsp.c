@@ -0,0 +1,254 @@
+// Print the throughput of the audio dsp functions, and of the plain C loops
+// they replaced, so that regressions are noticeable. This is not a test and
+// is not run by the test suite. Run it with the names of the benchmarks to
+// run, or without arguments to run all of them.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/dsp.h"
+#include "audio/filter/fftconv.h"
+#include "audio/filter/xcorr.h"
+#include "osdep/timer.h"
+#include "test/audio_dsp_ref.h"
+
+static int64_t timer_start;
+
+static void start_timer(void)
+{
+    timer_start = mp_time_us();
+}
+
+// Return the time since start_timer() in seconds.
+static double stop_timer(void)
+{
+    return MPMAX(mp_time_us() - timer_start, 1) / 1e6;
+}
+
+// The C and the selected functions on a 32 channel buffer.
+static void bench_scale(void)
+{
+    int num = 32 * 1024; // 32 channels, interleaved
+    int runs = 2000;
+    float *f = talloc_array(NULL, float, num);
+    int16_t *s = talloc_array(NULL, int16_t, num);
+    uint64_t st = 2;
+    fill_float(f, num, &st);
+    fill_s16(s, num, &st);
+
+    for (int n = 0; n < 2; n++) {
+        struct af_dsp_funcs funcs;
+        af_dsp_init_funcs(&funcs, n ? av_get_cpu_flags() : 0);
+
+        start_timer();
+        for (int r = 0; r < runs; r++)
+            funcs.scale_float(f, num, r & 1 ? 0.5f : 2.0f);
+        double t_float = stop_timer();
+
+        start_timer();
+        for (int r = 0; r < runs; r++)
+            funcs.scale_s16(s, num, r & 1 ? 128 : 512);
+        double t_s16 = stop_timer();
+
+        printf("scale %-5s: float %.1f Msamples/s, s16 %.1f Msamples/s\n",
+               funcs.name, num * runs / t_float / 1e6,
+               num * runs / t_s16 / 1e6);
+    }
+    talloc_free(f);
+    talloc_free(s);
+}
+
+// Mixing 8 to 8 channels with a full matrix, as done by af_pan, and a 2
+// channel mix as done by af_extrastereo.
+static void bench_mix(void)
+{
+    int num = 4096, runs = 500;
+    float *in = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    float *out = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    uint64_t st = 8;
+    fill_float(in, num * MP_NUM_CHANNELS, &st);
+    float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS];
+    for (int o = 0; o < MP_NUM_CHANNELS; o++) {
+        for (int i = 0; i < MP_NUM_CHANNELS; i++)
+            matrix[o][i] = (o + i + 1) / 16.0f;
+    }
+
+    for (int nch = 2; nch <= MP_NUM_CHANNELS; nch += 6) {
+        start_timer();
+        for (int r = 0; r < runs; r++)
+            mix_ref(out, nch, in, nch, matrix, num);
+        double t_ref = stop_timer();
+
+        start_timer();
+        for (int r = 0; r < runs; r++)
+            af_dsp_mix_float(out, nch, in, nch, matrix, num);
+        double t_dsp = stop_timer();
+
+        printf("mix %d -> %d channels: scalar %.1f Mframes/s, %s %.1f "
+               "Mframes/s\n", nch, nch, num * runs / t_ref / 1e6,
+               af_dsp_get()->name, num * runs / t_dsp / 1e6);
+    }
+    talloc_free(in);
+    talloc_free(out);
+}
+
+// A 10 band equalizer with the old loop and with the biquad cascade.
+static void bench_equalizer(void)
+{
+    int rates[] = {48000, 96000, 192000};
+    int num = 4096, runs = 100;
+    float *data = talloc_array(NULL, float, num * MP_NUM_CHANNELS);
+    uint64_t st = 11;
+    for (int r = 0; r < MP_ARRAY_SIZE(rates); r++) {
+        for (int nch = 2; nch <= MP_NUM_CHANNELS; nch += 6) {
+            float a[10][2], b[10][2];
+            eq_design(rates[r], a, b);
+            float g[MP_NUM_CHANNELS][10], wq[MP_NUM_CHANNELS][10][2] = {{{0}}};
+            struct af_biquad_cascade *c =
+                af_biquad_cascade_alloc(NULL, nch, 10);
+            for (int k = 0; k < 10; k++) {
+                for (int ch = 0; ch < nch; ch++) {
+                    g[ch][k] = 0.5;
+                    struct af_biquad bq = eq_section(a[k], b[k], g[ch][k]);
+                    af_biquad_cascade_set(c, k, ch, &bq);
+                }
+            }
+            af_biquad_cascade_update(c, 0);
+            fill_float(data, num * nch, &st);
+
+            start_timer();
+            for (int n = 0; n < runs; n++)
+                eq_ref(data, nch, num, a, b, g, wq);
+            double t_ref = stop_timer();
+
+            start_timer();
+            for (int n = 0; n < runs; n++)
+                af_biquad_cascade_process(c, data, num);
+            double t_bq = stop_timer();
+
+            // Realtime factor: seconds of audio processed per second.
+            double secs = (double)num * runs / rates[r];
+            printf("equalizer %d Hz, %d ch: scalar %.0fx realtime, %s %.0fx "
+                   "realtime\n", rates[r], nch, secs / t_ref,
+                   af_dsp_get()->name, secs / t_bq);
+            talloc_free(c);
+        }
+    }
+    talloc_free(data);
+}
+
+// The overlap search of af_scaletempo with default settings (60 ms stride, 20%
+// overlap, 14 ms search) for some sample rates and channel counts.
+static void bench_xcorr(void)
+{
+    int rates[] = {48000, 96000, 192000};
+    int channels[] = {2, 8};
+    uint64_t st = 4;
+    for (int r = 0; r < MP_ARRAY_SIZE(rates); r++) {
+        for (int c = 0; c < MP_ARRAY_SIZE(channels); c++) {
+            int nch = channels[c];
+            int frames_overlap = rates[r] / 1000 * 60 * 0.2;
+            int frames_search = rates[r] / 1000 * 14;
+            int len_a = (frames_overlap - 1) * nch;
+            int len_b = len_a + (frames_search - 1) * nch;
+            struct mp_xcorr *x = mp_xcorr_create(NULL, len_a, len_b);
+            float *a = talloc_array(x, float, len_a);
+            float *b = talloc_array(x, float, len_b);
+            float *out = talloc_array(x, float, len_b - len_a + 1);
+            fill_float(a, len_a, &st);
+            fill_float(b, len_b, &st);
+
+            int runs = 5;
+            start_timer();
+            for (int n = 0; n < runs; n++) {
+                // Only the lags at frame boundaries are used.
+                for (int k = 0; k < frames_search; k++)
+                    xcorr_direct(a, len_a, b + k * nch, len_a, out + k);
+            }
+            double t_direct = stop_timer();
+
+            start_timer();
+            for (int n = 0; n < runs; n++) {
+                memcpy(mp_xcorr_get_a(x), a, len_a * sizeof(float));
+                memcpy(mp_xcorr_get_b(x), b, len_b * sizeof(float));
+                mp_xcorr_run(x);
+            }
+            double t_fft = stop_timer();
+
+            printf("scaletempo search %d Hz, %d ch: direct %.3f ms, "
+                   "fft %.3f ms per stride (auto: %s)\n", rates[r], nch,
+                   t_direct * 1e3 / runs, t_fft * 1e3 / runs,
+                   mp_xcorr_cost(len_a, len_b) <
+                   (int64_t)frames_search * len_a ? "fft" : "direct");
+            talloc_free(x);
+        }
+    }
+}
+
+// Direct and FFT convolution with impulse responses of some lengths (the ones
+// af_surround, af_hrtf, and a typical room reverb use).
+static void bench_fftconv(void)
+{
+    int lengths[] = {32, 193, 4800, 96000};
+    int rate = 48000, num = 12000, block = 256;
+    uint64_t st = 14;
+    float *in = talloc_array(NULL, float, num + lengths[3]);
+    float *out = talloc_array(NULL, float, num);
+    fill_float(in, num + lengths[3], &st);
+    for (int l = 0; l < MP_ARRAY_SIZE(lengths); l++) {
+        int len = lengths[l];
+        float *ir = talloc_array(NULL, float, len);
+        fill_float(ir, len, &st);
+
+        start_timer();
+        for (int k = 0; k < num; k++) {
+            const float *x = in + len + k;
+            float y = 0;
+            for (int j = 0; j < len; j++)
+                y += ir[j] * x[-j];
+            out[k] = y;
+        }
+        double t_direct = stop_timer();
+
+        struct mp_fftconv *c = mp_fftconv_create(ir, block, 1, 1, len);
+        mp_fftconv_add_ir(c, 0, 0, ir, len, 0, 1);
+        start_timer();
+        mp_fftconv_process(c, &in, &out, num);
+        double t_fft = stop_timer();
+
+        printf("convolution, %d taps: direct %.1fx realtime, fft %.1fx "
+               "realtime\n", len, (double)num / rate / t_direct,
+               (double)num / rate / t_fft);
+        talloc_free(ir);
+    }
+    talloc_free(in);
+    talloc_free(out);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} benchmarks[] = {
+    {"scale",     bench_scale},
+    {"mix",       bench_mix},
+    {"equalizer", bench_equalizer},
+    {"xcorr",     bench_xcorr},
+    {"fftconv",   bench_fftconv},
+};
+
+int main(int argc, char **argv)
+{
+    mp_time_init();
+    for (int n = 0; n < MP_ARRAY_SIZE(benchmarks); n++) {
+        bool run = argc < 2;
+        for (int i = 1; i < argc; i++)
+            run |= strcmp(argv[i], benchmarks[n].name) == 0;
+        if (run)
+            benchmarks[n].run();
+    }
+    return 0;
+}
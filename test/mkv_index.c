@@ -0,0 +1,228 @@
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "demux/mkv_index.h"
+#include "osdep/timer.h"
+
+#define TC_SCALE 1000000
+
+// Simple deterministic PRNG, so that failures are reproducible.
+static uint64_t rnd(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+// Synthetic cue table: a video and an audio track with a cue point every
+// 500ms, and a sparse subtitle track with durations.
+static struct mkv_index_table *make_table(void *ctx, size_t num, bool shuffle,
+                                          struct mkv_index **flat)
+{
+    struct mkv_index_table *t = mkv_index_table_create(ctx);
+    size_t num_flat = 0;
+    uint64_t filepos = 4096;
+    for (size_t i = 0; i < num; i++) {
+        uint64_t tc = i * 500;
+        MP_TARRAY_APPEND(ctx, *flat, num_flat, (struct mkv_index){1, tc, 0, filepos});
+        MP_TARRAY_APPEND(ctx, *flat, num_flat, (struct mkv_index){2, tc, 0, filepos});
+        if (i % 7 == 0)
+            MP_TARRAY_APPEND(ctx, *flat, num_flat, (struct mkv_index){3, tc, 3000, filepos});
+        filepos += 100000 + i % 1000;
+    }
+    if (shuffle) {
+        uint64_t state = 1;
+        for (size_t i = num_flat - 1; i > 0; i--) {
+            size_t j = rnd(&state) % (i + 1);
+            MPSWAP(struct mkv_index, (*flat)[i], (*flat)[j]);
+        }
+    }
+    for (size_t i = 0; i < num_flat; i++) {
+        struct mkv_index *e = &(*flat)[i];
+        mkv_index_add(t, e->tnum, e->filepos, e->timecode, e->duration);
+    }
+    assert_int_equal(t->num_entries, num_flat);
+    return t;
+}
+
+// The linear scan demux_mkv.c used to do.
+static struct mkv_index *linear_seek(struct mkv_index *flat, size_t num,
+                                     int tnum, int64_t target, bool backward)
+{
+    struct mkv_index *index = NULL;
+    int64_t min_diff = INT64_MIN;
+    for (size_t i = 0; i < num; i++) {
+        if (tnum < 0 || flat[i].tnum == tnum) {
+            int64_t diff = target - (int64_t) (flat[i].timecode * TC_SCALE);
+            if (backward)
+                diff = -diff;
+            if (min_diff != INT64_MIN) {
+                if (diff <= 0) {
+                    if (min_diff <= 0 && diff <= min_diff)
+                        continue;
+                } else if (diff >= min_diff)
+                    continue;
+            }
+            min_diff = diff;
+            index = flat + i;
+        }
+    }
+    return index;
+}
+
+static void check_seeks(bool shuffle)
+{
+    void *ctx = talloc_new(NULL);
+    struct mkv_index *flat = NULL;
+    size_t num = 2000;
+    struct mkv_index_table *t = make_table(ctx, num, shuffle, &flat);
+    size_t num_flat = t->num_entries;
+    uint64_t state = 2;
+    for (int n = 0; n < 5000; n++) {
+        int64_t target = rnd(&state) % ((num + 10) * 500 * (int64_t)TC_SCALE);
+        if (n % 10 == 0)
+            target = (rnd(&state) % num) * 500 * (int64_t)TC_SCALE; // exact hit
+        bool backward = n & 1;
+        // With shuffled input, the linear search resolves ties between tracks
+        // by insertion order (see test_seek_ties()).
+        int tnum = 1 + n % 3;
+        if (!shuffle && n % 4 == 0)
+            tnum = -1;
+        struct mkv_index *a = mkv_index_seek(t, tnum, target, TC_SCALE, backward);
+        struct mkv_index *b = linear_seek(flat, num_flat, tnum, target, backward);
+        assert_non_null(a);
+        assert_non_null(b);
+        assert_int_equal(a->tnum, b->tnum);
+        assert_int_equal(a->timecode, b->timecode);
+        assert_int_equal(a->filepos, b->filepos);
+    }
+    talloc_free(ctx);
+}
+
+static void test_seek_sorted(void **state)
+{
+    check_seeks(false);
+}
+
+static void test_seek_unsorted(void **state)
+{
+    check_seeks(true);
+}
+
+static void test_seek_ties(void **state)
+{
+    // Entries with duplicate timecodes on several tracks, in several
+    // clusters. Each row is {tnum, timecode, duration, filepos}.
+    static const struct mkv_index entries[] = {
+        {3, 1000, 0, 700}, {1, 1000, 0, 800}, {2, 1000, 0, 600},
+        {1, 1000, 0, 600}, {3, 1000, 0, 650}, {2, 2000, 0, 900},
+        {3, 2000, 0, 900}, {1, 2000, 0, 950}, {1, 2000, 0, 900},
+    };
+    int num = MP_ARRAY_SIZE(entries);
+    // The result must not depend on the order the entries are added in, so
+    // try each rotation, forwards and backwards.
+    for (int order = 0; order < num * 2; order++) {
+        struct mkv_index_table *t = mkv_index_table_create(NULL);
+        for (int i = 0; i < num; i++) {
+            int j = (order / 2 + i) % num;
+            const struct mkv_index *e = &entries[order & 1 ? num - 1 - j : j];
+            mkv_index_add(t, e->tnum, e->filepos, e->timecode, e->duration);
+        }
+
+        // Lowest filepos wins, then lowest track number.
+        struct mkv_index *e = mkv_index_seek(t, -1, 1000 * (int64_t)TC_SCALE,
+                                             TC_SCALE, false);
+        assert_int_equal(e->tnum, 1);
+        assert_int_equal(e->filepos, 600);
+        e = mkv_index_seek(t, -1, 1500 * (int64_t)TC_SCALE, TC_SCALE, true);
+        assert_int_equal(e->tnum, 1);
+        assert_int_equal(e->filepos, 600);
+        e = mkv_index_seek(t, -1, 1500 * (int64_t)TC_SCALE, TC_SCALE, false);
+        assert_int_equal(e->tnum, 1);
+        assert_int_equal(e->filepos, 900);
+
+        // Within a single track, the lowest filepos wins.
+        e = mkv_index_seek(t, 3, 900 * (int64_t)TC_SCALE, TC_SCALE, false);
+        assert_int_equal(e->timecode, 1000);
+        assert_int_equal(e->filepos, 650);
+        e = mkv_index_seek(t, 1, 5000 * (int64_t)TC_SCALE, TC_SCALE, true);
+        assert_int_equal(e->timecode, 2000);
+        assert_int_equal(e->filepos, 900);
+
+        talloc_free(t);
+    }
+}
+
+static void test_helpers(void **state)
+{
+    void *ctx = talloc_new(NULL);
+    struct mkv_index *flat = NULL;
+    struct mkv_index_table *t = make_table(ctx, 1000, true, &flat);
+
+    struct mkv_index *e = mkv_index_last_until(t, 1, 1250);
+    assert_non_null(e);
+    assert_int_equal(e->timecode, 1000);
+    assert_null(mkv_index_last_until(t, 4, 1250));
+
+    struct mkv_index *last = mkv_index_last(t, 2);
+    assert_int_equal(last->timecode, 999 * 500);
+    assert_int_equal(mkv_index_max_pos(t, 2), last->filepos);
+
+    e = mkv_index_seek_pos(t, 1, last->filepos - 1);
+    assert_int_equal(e->filepos, last->filepos);
+
+    // Subtitle entries at tc 0, 3500, 7000, ... last 3000 units.
+    struct mkv_index *sub = mkv_index_seek(t, 3, 4000 * (int64_t)TC_SCALE,
+                                           TC_SCALE, true);
+    assert_int_equal(sub->timecode, 3500);
+    uint64_t pos = mkv_index_overlap_pos(t, 6000, 0, UINT64_MAX);
+    assert_int_equal(pos, sub->filepos);
+    assert_int_equal(mkv_index_overlap_pos(t, 6000, sub->filepos + 1, 42), 42);
+
+    mkv_index_table_reset(t);
+    assert_int_equal(t->num_entries, 0);
+    assert_null(mkv_index_seek(t, -1, 0, TC_SCALE, false));
+    talloc_free(ctx);
+}
+
+// Not really a test: print how long seeking in a large index takes, so that
+// regressions are noticeable. Only run with MPV_TEST_BENCHMARKS set.
+static void test_seek_benchmark(void **state)
+{
+    skip_unless_benchmark();
+
+    void *ctx = talloc_new(NULL);
+    struct mkv_index *flat = NULL;
+    size_t num = 500000; // ~70 hours of cues every 500ms
+    struct mkv_index_table *t = make_table(ctx, num, false, &flat);
+    int seeks = 100000;
+
+    mp_time_init();
+    uint64_t st = 3;
+    uint64_t sum = 0;
+    int64_t start = mp_time_us();
+    for (int n = 0; n < seeks; n++) {
+        int64_t target = rnd(&st) % (num * 500 * (int64_t)TC_SCALE);
+        struct mkv_index *e = mkv_index_seek(t, n & 1 ? 1 : -1, target,
+                                             TC_SCALE, n & 2);
+        uint64_t min_tc = e->timecode > 2000 ? e->timecode - 2000 : 0;
+        struct mkv_index *prev = mkv_index_last_until(t, -1, min_tc);
+        sum += mkv_index_overlap_pos(t, e->timecode, prev ? prev->filepos : 0,
+                                     e->filepos);
+    }
+    int64_t elapsed = mp_time_us() - start;
+    assert_true(sum > 0);
+    printf("mkv index: %zu entries, %d seeks in %"PRId64" us (%.3f us/seek)\n",
+           t->num_entries, seeks, elapsed, elapsed / (double)seeks);
+    talloc_free(ctx);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_seek_sorted),
+        cmocka_unit_test(test_seek_unsorted),
+        cmocka_unit_test(test_seek_ties),
+        cmocka_unit_test(test_helpers),
+        cmocka_unit_test(test_seek_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -7,9 +7,17 @@
 #include <cmocka.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <float.h>
 
 #define assert_double_equal(a, b) assert_true(fabs(a - b) <= DBL_EPSILON)
 
+// Benchmarks are skipped unless the MPV_TEST_BENCHMARKS environment variable
+// is set, so that the normal test run only checks correctness.
+#define skip_unless_benchmark() do {                                    \
+        if (!getenv("MPV_TEST_BENCHMARKS"))                             \
+            skip();                                                     \
+    } while (0)
+
 #endif
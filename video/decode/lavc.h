@@ -21,6 +21,12 @@ typedef struct lavc_ctx {
     const char *software_fallback_decoder;
     bool hwdec_failed;
 
+    // If not-0: mp-rawvideo packets are used as image data without copying,
+    // with the plane layout below.
+    int raw_imgfmt;
+    int raw_stride[MP_MAX_PLANES];
+    int raw_frame_size;
+
     // From VO
     struct mp_hwdec_info *hwdec_info;
 
@@ -329,6 +329,33 @@ static int init(struct dec_video *vd, const char *decoder)
     return 1;
 }
 
+// Determine the plane layout of mp-rawvideo packets, which is the same as the
+// one demux_raw.c uses to compute the frame size: planes are stored one after
+// another without padding. Leaves ctx->raw_imgfmt unset if the packet data
+// can't be used as mp_image planes directly.
+static void init_raw_layout(struct dec_video *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct sh_stream *sh = vd->header;
+    int w = sh->video->disp_w, h = sh->video->disp_h;
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(sh->format);
+    if (!desc.id || (desc.flags & (MP_IMGFLAG_HWACCEL | MP_IMGFLAG_PAL)))
+        return;
+    int size = 0;
+    for (int p = 0; p < desc.num_planes; p++) {
+        // Odd sizes and sub-byte line lengths round differently in mp_image.
+        int bits = (w >> desc.xs[p]) * desc.bpp[p];
+        if ((w & ((1 << desc.xs[p]) - 1)) || (h & ((1 << desc.ys[p]) - 1)) ||
+            bits % 8)
+            return;
+        ctx->raw_stride[p] = bits / 8;
+        size += ctx->raw_stride[p] * (h >> desc.ys[p]);
+    }
+    ctx->raw_imgfmt = sh->format;
+    ctx->raw_frame_size = size;
+    MP_VERBOSE(vd, "Using raw packet data directly.\n");
+}
+
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec)
 {
@@ -351,6 +378,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     ctx->hwdec_info = vd->hwdec_info;
 
     ctx->pix_fmt = AV_PIX_FMT_NONE;
+    ctx->raw_imgfmt = 0;
     ctx->hwdec = hwdec;
     ctx->hwdec_fmt = 0;
     ctx->avctx = avcodec_alloc_context3(lavc_codec);
@@ -411,6 +439,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         if (avctx->pix_fmt == AV_PIX_FMT_NONE && sh->format)
             MP_ERR(vd, "Image format %s not supported by lavc.\n",
                    mp_imgfmt_to_name(sh->format));
+        init_raw_layout(vd);
     }
 
     if (sh->lav_headers)
@@ -450,29 +479,18 @@ static void uninit_avctx(struct dec_video *vd)
     ctx->hwdec_failed = false;
 }
 
-static void update_image_params(struct dec_video *vd, AVFrame *frame,
-                                struct mp_image_params *out_params)
+static void set_image_params(struct dec_video *vd, int imgfmt, int width,
+                             int height, float aspect,
+                             struct mp_image_params *out_params)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
     struct MPOpts *opts = ctx->opts;
-    int width = frame->width;
-    int height = frame->height;
-    float aspect = av_q2d(frame->sample_aspect_ratio) * width / height;
-    int pix_fmt = frame->format;
-
-    if (pix_fmt != ctx->pix_fmt) {
-        ctx->pix_fmt = pix_fmt;
-        ctx->best_csp = pixfmt2imgfmt(pix_fmt);
-        if (!ctx->best_csp)
-            MP_ERR(vd, "lavc pixel format %s not supported.\n",
-                   av_get_pix_fmt_name(pix_fmt));
-    }
 
     int d_w, d_h;
     vf_set_dar(&d_w, &d_h, width, height, aspect);
 
     *out_params = (struct mp_image_params) {
-        .imgfmt = ctx->best_csp,
+        .imgfmt = imgfmt,
         .w = width,
         .h = height,
         .d_w = d_w,
@@ -495,6 +513,26 @@ static void update_image_params(struct dec_video *vd, AVFrame *frame,
     out_params->stereo_out = opts->video_stereo_mode;
 }
 
+static void update_image_params(struct dec_video *vd, AVFrame *frame,
+                                struct mp_image_params *out_params)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    int width = frame->width;
+    int height = frame->height;
+    float aspect = av_q2d(frame->sample_aspect_ratio) * width / height;
+    int pix_fmt = frame->format;
+
+    if (pix_fmt != ctx->pix_fmt) {
+        ctx->pix_fmt = pix_fmt;
+        ctx->best_csp = pixfmt2imgfmt(pix_fmt);
+        if (!ctx->best_csp)
+            MP_ERR(vd, "lavc pixel format %s not supported.\n",
+                   av_get_pix_fmt_name(pix_fmt));
+    }
+
+    set_image_params(vd, ctx->best_csp, width, height, aspect, out_params);
+}
+
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                            const enum AVPixelFormat *fmt)
 {
@@ -597,6 +635,39 @@ static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags)
     return 0;
 }
 
+// Wrap a mp-rawvideo packet into an image that references the packet data.
+// This avoids copying the frame if the packet itself references the source
+// (such as a memory mapped file).
+static int decode_raw(struct dec_video *vd, struct demux_packet *packet,
+                      struct mp_image **out_image)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct sh_stream *sh = vd->header;
+
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, ctx->raw_imgfmt);
+    mp_image_set_size(&img, sh->video->disp_w, sh->video->disp_h);
+    uint8_t *data = packet->buffer;
+    for (int p = 0; p < img.num_planes; p++) {
+        img.planes[p] = data;
+        img.stride[p] = ctx->raw_stride[p];
+        data += img.stride[p] * mp_image_plane_h(&img, p);
+    }
+
+    struct mp_image_params params;
+    set_image_params(vd, ctx->raw_imgfmt, img.w, img.h, 0, &params);
+    vd->codec_pts = packet->pts;
+    vd->codec_dts = packet->dts;
+
+    struct mp_image *mpi = mp_image_from_av_buffer(&img, packet->avpacket->buf);
+    if (!mpi)
+        return 0;
+    mp_image_set_params(mpi, &params);
+
+    *out_image = mp_img_swap_to_native(mpi);
+    return 1;
+}
+
 static int decode(struct dec_video *vd, struct demux_packet *packet,
                   int flags, struct mp_image **out_image)
 {
@@ -607,6 +678,10 @@ static int decode(struct dec_video *vd, struct demux_packet *packet,
     struct vd_lavc_params *lavc_param = ctx->opts->vd_lavc_params;
     AVPacket pkt;
 
+    if (ctx->raw_imgfmt && packet && packet->avpacket &&
+        packet->avpacket->buf && packet->len >= ctx->raw_frame_size)
+        return decode_raw(vd, packet, out_image);
+
     if (flags) {
         // hr-seek framedrop vs. normal framedrop
         avctx->skip_frame = flags == 2 ? AVDISCARD_NONREF : lavc_param->framedrop;
@@ -684,6 +684,32 @@ struct mp_image *mp_image_from_av_frame(struct AVFrame *av_frame)
     return mp_image_new_external_ref(&t, new_ref, frame_is_unique, frame_free);
 }
 
+static void buffer_free(void *p)
+{
+    AVBufferRef *buf = p;
+    av_buffer_unref(&buf);
+}
+
+static bool buffer_is_unique(void *p)
+{
+    AVBufferRef *buf = p;
+    return av_buffer_is_writable(buf);
+}
+
+// Create a new mp_image reference to the image data described by img, which
+// must be contained in buf. This adds a new reference to buf, and the image is
+// writeable only if buf is.
+// Returns NULL on allocation failure.
+struct mp_image *mp_image_from_av_buffer(struct mp_image *img,
+                                         struct AVBufferRef *buf)
+{
+    AVBufferRef *new_ref = av_buffer_ref(buf);
+    if (!new_ref)
+        return NULL;
+    return mp_image_new_external_ref(img, new_ref, buffer_is_unique,
+                                     buffer_free);
+}
+
 static void free_img(void *opaque, uint8_t *data)
 {
     struct mp_image *img = opaque;
@@ -103,6 +103,7 @@ def build(ctx):
         ( "audio/filter/af_bs2b.c",              "libbs2b" ),
         ( "audio/filter/af_center.c" ),
         ( "audio/filter/af_channels.c" ),
+        ( "audio/filter/af_convolver.c" ),
         ( "audio/filter/af_delay.c" ),
         ( "audio/filter/af_drc.c" ),
         ( "audio/filter/af_dummy.c" ),
@@ -124,6 +125,9 @@ def build(ctx):
         ( "audio/filter/af_surround.c" ),
         ( "audio/filter/af_sweep.c" ),
         ( "audio/filter/af_volume.c" ),
+        ( "audio/filter/dsp.c" ),
+        ( "audio/filter/fftconv.c" ),
+        ( "audio/filter/xcorr.c" ),
         ( "audio/filter/filter.c" ),
         ( "audio/filter/tools.c" ),
         ( "audio/filter/window.c" ),
@@ -181,6 +185,8 @@ def build(ctx):
         ( "demux/demux_subreader.c" ),
         ( "demux/demux_tv.c",                    "tv" ),
         ( "demux/ebml.c" ),
+        ( "demux/index_cache.c" ),
+        ( "demux/mkv_index.c" ),
         ( "demux/packet.c" ),
         ( "demux/timeline.c" ),
 
@@ -198,6 +204,7 @@ def build(ctx):
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/json.c" ),
+        ( "misc/prefetch.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
 
@@ -462,6 +469,15 @@ def build(ctx):
                 includes = _all_includes(ctx),
                 features = "c cprogram",
             )
+        # Benchmarks are built with the tests, but not run by them.
+        for bench in ctx.path.ant_glob("test/bench/*.c"):
+            ctx(
+                target   = os.path.splitext(bench.srcpath())[0],
+                source   = bench.srcpath(),
+                use      = ctx.dependencies_use() + ['objects'],
+                includes = _all_includes(ctx),
+                features = "c cprogram",
+            )
 
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')